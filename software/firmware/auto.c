@@ -0,0 +1,235 @@
+/*
+ * auto.c - part of USBasp
+ *
+ * Description....: Program-on-insert production loop
+ * Licence........: GNU GPL v2 (see Readme.txt)
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "usbasp.h"
+#include "usbdrv.h"
+#include "isp.h"
+#include "clock.h"
+#include "store.h"
+#include "auto.h"
+
+static uchar auto_job = AUTO_JOB_OFF;
+static uchar auto_hint = USBASP_PROGMODE_AUTO;
+static uchar auto_state = AUTO_STATE_OFF;
+static uchar auto_result = STORE_RESULT_NONE;
+static uint16_t auto_boards;
+static uchar auto_misses;       /* empty probes since the result */
+static uchar auto_boot;         /* loaded at start, first probe pending */
+static uchar auto_probe;        /* PROBE_* step of the presence probe */
+static uchar auto_cold;         /* data lines the unpowered socket held low */
+static uchar auto_entering;     /* signature check under way */
+static uint32_t auto_next;      /* next probe step */
+
+/* steps of the presence probe, see autoProbe() */
+#define PROBE_OFF       0
+#define PROBE_WARM      1       /* VDD alone, RESET still at 0 V */
+#define PROBE_BUSY      0xFF    /* autoProbe(): not done yet */
+
+#define PROBE_VDD       CLOCK_MS(1)     /* VDD rise, part held in reset */
+
+void autoLoad(void)
+{
+    uchar cfg[2];
+
+    eeprom_read_block(cfg, (void *) EE_ADDR_AUTO, sizeof(cfg));
+    if (!autoSet(cfg[0], cfg[1], 0))
+        autoSet(AUTO_JOB_OFF, USBASP_PROGMODE_AUTO, 0);
+    /* no probe while the host enumerates us, see autoTask() */
+    auto_boot = 1;
+    auto_next = clockDeadline(CLOCK_MS(AUTO_BOOT_MS));
+}
+
+uchar autoSet(uchar job, uchar hint, uchar save)
+{
+    uchar cfg[2];
+
+    if (job > AUTO_JOB_HOST || hint > USBASP_PROGMODE_SERIAL)
+        return 0;
+    /* the adapter powers full bus parts itself, the probe can't see them */
+    if (job != AUTO_JOB_OFF && hint == USBASP_PROGMODE_FULLBUS)
+        return 0;
+    if (save) {
+        cfg[0] = job;
+        cfg[1] = hint;
+        eeprom_update_block(cfg, (void *) EE_ADDR_AUTO, sizeof(cfg));
+    }
+    /* a probe under way is dropped, an entry ends in autoTask() */
+    if (auto_probe != PROBE_OFF) {
+        ispSensePower(0);
+        auto_probe = PROBE_OFF;
+    }
+    auto_job = job;
+    auto_hint = hint;
+    auto_state = job == AUTO_JOB_OFF ? AUTO_STATE_OFF : AUTO_STATE_WAIT;
+    auto_result = STORE_RESULT_NONE;
+    auto_boards = 0;
+    auto_boot = 0;
+    auto_next = clockNow();
+    return 1;
+}
+
+uchar autoActive(void)
+{
+    return auto_state != AUTO_STATE_OFF;
+}
+
+/* the mode of the signature check: the hint, else the one that worked
+ * last */
+static uchar autoHint(void)
+{
+    uchar rec[EE_PROGMODE_LEN];
+
+    if (auto_hint != USBASP_PROGMODE_AUTO)
+        return auto_hint;
+    eeprom_read_block(rec, (void *) EE_ADDR_PROGMODE, EE_PROGMODE_LEN);
+    if (rec[0] == EE_PROGMODE_MAGIC && rec[1] <= 0x02)
+        return rec[1] + 1;
+    return USBASP_PROGMODE_AUTO;
+}
+
+/* Presence pre-check without VPP, one step per call. An unpowered part
+ * in a VDD-switched socket holds the briefly pulled-up data lines low
+ * through its protection diodes and lets them go once VDD is up with
+ * RESET still at 0 V; an empty socket reads high both times and a short
+ * to ground low both times. This is a heuristic: a hit only earns the
+ * part a signature check. PROBE_BUSY while it runs, else 1 on a hit; the
+ * socket is unpowered by then. */
+static uchar autoProbe(void)
+{
+    uchar lines = 0;
+
+    if (!clockExpired(auto_next))
+        return PROBE_BUSY;
+    if (auto_probe == PROBE_OFF) {
+        ispSenseStart();
+        auto_cold = ~ispSense();
+        if (auto_cold) {
+            ispSensePower(1);
+            auto_probe = PROBE_WARM;
+            auto_next = clockDeadline(PROBE_VDD);
+            return PROBE_BUSY;
+        }
+    } else {
+        lines = auto_cold & ispSense();
+    }
+    ispSenseEnd();
+    auto_probe = PROBE_OFF;
+    auto_next = clockDeadline(CLOCK_MS(AUTO_PROBE_MS));
+    return lines != 0;
+}
+
+/* board done: result on the LEDs until the part is taken out */
+static void autoFinish(uchar result)
+{
+    if (result == STORE_RESULT_OK) {
+        ledRedOff();
+        ledGreenOn();
+    } else {
+        ledGreenOff();
+        ledRedOn();
+    }
+    auto_result = result;
+    auto_boards++;
+    auto_misses = 0;
+    auto_state = AUTO_STATE_REMOVE;
+}
+
+uchar autoDone(uchar result)
+{
+    if (auto_state != AUTO_STATE_PRESENT)
+        return 0;
+    autoFinish(result);
+    return 1;
+}
+
+void autoTask(uchar idle)
+{
+    uchar r;
+
+    if (auto_state == AUTO_STATE_RUN) {
+        if (!storeBusy())
+            autoFinish(storeResult());
+        return;
+    }
+    if (auto_entering) {
+        /* ispPoll() ran the entry and the ID read, VPP goes off now */
+        auto_entering = 0;
+        r = prog_modestatus;
+        ispDisconnect();
+        if (auto_state != AUTO_STATE_WAIT)
+            return;
+        if (r != PROG_MODE_OK) {
+            /* no signature: red until the socket is empty again */
+            autoFinish(STORE_RESULT_TARGET);
+            return;
+        }
+        if (auto_job == AUTO_JOB_HOST) {
+            /* both LEDs until the host reports, like a standalone run */
+            ledRedOn();
+            ledGreenOn();
+            auto_state = AUTO_STATE_PRESENT;
+            return;
+        }
+        r = storeStart();
+        if (r == STORE_RESULT_OK)
+            auto_state = AUTO_STATE_RUN;
+        else
+            autoFinish(r);
+        return;
+    }
+    if (auto_state != AUTO_STATE_WAIT && auto_state != AUTO_STATE_REMOVE)
+        return;
+    if (!idle || storeBusy()) {
+        /* whoever took the target sets its pins, just drop the probe */
+        if (auto_probe != PROBE_OFF) {
+            ispSensePower(0);
+            auto_probe = PROBE_OFF;
+        }
+        return;
+    }
+    if (auto_boot) {
+        /* first probe once the host has configured us, or without one */
+        if (!usbConfiguration && !clockExpired(auto_next))
+            return;
+        auto_boot = 0;
+        auto_next = clockNow();
+    }
+
+    r = autoProbe();
+    if (r == PROBE_BUSY)
+        return;
+    if (auto_state == AUTO_STATE_REMOVE) {
+        if (r)
+            auto_misses = 0;
+        else if (++auto_misses >= AUTO_MISSES) {
+            ledRedOff();
+            ledGreenOff();
+            auto_state = AUTO_STATE_WAIT;
+        }
+        return;
+    }
+
+    if (!r)
+        return;
+    /* a short signature read before any job: VPP only for the entry */
+    ispConnect();
+    ispStartProgrammingMode(autoHint());
+    auto_entering = 1;
+}
+
+uchar autoInfo(uchar *buf)
+{
+    buf[0] = auto_job;
+    buf[1] = auto_hint;
+    buf[2] = auto_state;
+    buf[3] = auto_result;
+    buf[4] = auto_boards;
+    buf[5] = auto_boards >> 8;
+    return USBASP_AUTO_INFO_LEN;
+}
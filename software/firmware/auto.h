@@ -0,0 +1,59 @@
+/*
+ * auto.h - program-on-insert production loop
+ *
+ * Instead of a button press or a host command per board, the firmware
+ * looks for a part in the socket by itself. Every AUTO_PROBE_MS a
+ * pre-check without VPP samples the data lines with the pull-ups on for
+ * a few microseconds and the socket unpowered, where a part holds them
+ * low through its protection diodes, and if one does, samples again
+ * after raising VDD alone for a millisecond with RESET at 0 V, where the
+ * part lets them go. It runs in steps from the main loop, so USB is
+ * served meanwhile. The first probe waits until the host has configured
+ * the programmer, or AUTO_BOOT_MS without a host.
+ *
+ * The pre-check is a heuristic, so a hit only starts a short signature
+ * read: programming mode is entered, the ID read and VPP removed again.
+ * A part that answers gets the configured job: the stored image
+ * (store.h), or, for a host job, the part is flagged for the host, which
+ * runs its session and reports the result with AUTO_ACTION_DONE. The
+ * LEDs then show pass (green) or fail (red, also for a hit without a
+ * signature) until AUTO_MISSES pre-checks in a row find the socket
+ * empty; no VPP is applied while waiting for that.
+ *
+ * The pre-check needs the part's VCC on the VDD line. The adapter powers
+ * full bus parts directly, so autoSet() refuses a job with the full bus
+ * hint; with USBASP_PROGMODE_AUTO such a part is never seen. The hint
+ * comes with the job and is used for the signature read;
+ * USBASP_PROGMODE_AUTO takes the mode remembered from the last
+ * programming mode entry and only falls back to the full detection if
+ * there is none.
+ */
+
+#ifndef __auto_h_included__
+#define __auto_h_included__
+
+#ifndef uchar
+#define	uchar	unsigned char
+#endif
+
+/* job and hint from the programmer EEPROM, call once at start */
+void autoLoad(void);
+
+/* new job (AUTO_JOB_*) and hint, kept in the EEPROM if save; 0 if invalid
+ * or a job with the full bus hint */
+uchar autoSet(uchar job, uchar hint, uchar save);
+
+/* result of a host job, STORE_RESULT_*; 0 if no part was waiting */
+uchar autoDone(uchar result);
+
+/* 1 while the loop is set */
+uchar autoActive(void);
+
+/* next probe or the end of a job; idle is 1 while no host session and
+ * no target operation is pending */
+void autoTask(uchar idle);
+
+/* USBASP_FUNC_AUTO reply, returns its length */
+uchar autoInfo(uchar *buf);
+
+#endif /* __auto_h_included__ */
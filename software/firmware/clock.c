@@ -12,12 +12,41 @@
 #include <avr/io.h>
 #include "clock.h"
 
+static uint16_t clock_hi;
+static uint32_t timeout_deadline;
+
+uint32_t clockNow(void) {
+    uint16_t lo = TCNT1;
+
+    if (CLOCK_TIFR & (1 << TOV1)) {
+        /* wrapped since the last call, TCNT1 may have been read before or
+         * after the wrap, so read it again */
+        CLOCK_TIFR = (1 << TOV1);
+        clock_hi++;
+        lo = TCNT1;
+    }
+    return ((uint32_t) clock_hi << 16) | lo;
+}
+
+uint8_t clockExpired(uint32_t deadline) {
+    return (int32_t) (clockNow() - deadline) >= 0;
+}
+
+void clockDelay(uint32_t ticks) {
+    uint32_t deadline = clockDeadline(ticks);
+
+    while (!clockExpired(deadline));
+}
+
 /* wait time * 320 us */
 void clockWait(uint8_t time) {
-    do {
-        uint8_t starttime = TCNT0;
-        // Более точный расчет с учетом F_CPU = 16MHz и предделителя 8
-        while ((uint8_t)(TCNT0 - starttime) < (F_CPU / 8000000) * 320); 
-    } while (--time);
+    clockDelay(CLOCK_US(320) * time);
 }
 
+void clockSetTimeout(uint16_t ms) {
+    timeout_deadline = clockDeadline(CLOCK_MS(ms));
+}
+
+uint8_t clockTimedOut(void) {
+    return clockExpired(timeout_deadline);
+}
@@ -14,12 +14,43 @@
 #define TCCR0B  TCCR0
 #endif
 
-/* set prescaler to 64 */
-#define clockInit()  TCCR0 = (1 << CS01) | (1 << CS00);
+/* Timer1 free running timebase, prescaler 8 (0.5 us per tick at 16 MHz).
+ * clockNow() extends TCNT1 to 32 bit by polling TOV1, so it has to be
+ * called at least once per timer wrap (~32 ms at 16 MHz), from the main
+ * context only. */
+#define CLOCK_US(us)    ((uint32_t)(us) * (F_CPU / 8000) / 1000)
+#define CLOCK_MS(ms)    ((uint32_t)(ms) * (F_CPU / 8000))
+
+#ifdef TIFR1
+#define CLOCK_TIFR      TIFR1
+#else
+#define CLOCK_TIFR      TIFR
+#endif
+
+/* set prescaler to 64 (Timer0) and 8 (Timer1) */
+#define clockInit()  TCCR0 = (1 << CS01) | (1 << CS00); TCCR1A = 0; TCCR1B = (1 << CS11);
 
 /* wait time * 320 us */
 void clockWait(uint8_t time);
 
+/* current time in Timer1 ticks */
+uint32_t clockNow(void);
+
+/* deadline ticks from now, check it with clockExpired() */
+#define clockDeadline(ticks)    (clockNow() + (ticks))
+
+/* 1 if the deadline has been reached */
+uint8_t clockExpired(uint32_t deadline);
+
+/* busy wait for ticks */
+void clockDelay(uint32_t ticks);
+
+/* start a timeout of ms milliseconds */
+void clockSetTimeout(uint16_t ms);
+
+/* 1 if the timeout has expired */
+uint8_t clockTimedOut(void);
+
 #endif /* __clock_h_included__ */
 
 
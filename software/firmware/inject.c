@@ -0,0 +1,155 @@
+/*
+ * inject.c - part of USBasp
+ *
+ * Description....: Per-unit serial number injected while programming
+ * Licence........: GNU GPL v2 (see Readme.txt)
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <string.h>
+#include "usbasp.h"
+#include "inject.h"
+
+/* USBASP_INJECT_LEN bytes as laid out in usbasp.h, naturally aligned */
+typedef struct {
+    uchar mem;
+    uchar format;
+    uchar width;
+    uchar reserved;
+    uint32_t address;
+    uint32_t counter;
+} InjectConfig;
+
+static InjectConfig inject;
+static uchar inject_value[INJECT_WIDTH_MAX];    /* formatted counter */
+static uchar inject_orig[INJECT_WIDTH_MAX];     /* image bytes replaced */
+static uchar inject_written;    /* field bytes written, bit per byte */
+static uchar inject_verified;   /* field bytes read back */
+static uchar inject_touched;    /* something written to inject.mem */
+
+static uchar injectValid(const InjectConfig *c)
+{
+    return c->mem <= INJECT_MEM_EEPROM && c->format <= INJECT_FMT_HEX &&
+           c->width >= 1 && c->width <= INJECT_WIDTH_MAX;
+}
+
+/* counter into inject_value, low digits or bytes kept if it is too wide */
+static void injectFormat(void)
+{
+    uint32_t v = inject.counter;
+    uchar i, d, w = inject.width;
+
+    for (i = 0; i < w; i++) {
+        if (inject.format == INJECT_FMT_LE) {
+            inject_value[i] = v;
+            v >>= 8;
+        } else if (inject.format == INJECT_FMT_BE) {
+            inject_value[w - 1 - i] = v;
+            v >>= 8;
+        } else if (inject.format == INJECT_FMT_DEC) {
+            inject_value[w - 1 - i] = '0' + v % 10;
+            v /= 10;
+        } else {
+            d = v & 0x0F;
+            inject_value[w - 1 - i] = d < 10 ? '0' + d : 'A' - 10 + d;
+            v >>= 4;
+        }
+    }
+}
+
+void injectLoad(void)
+{
+    eeprom_read_block(&inject, (void *) EE_ADDR_INJECT, USBASP_INJECT_LEN);
+    /* an erased EEPROM has width 0xFF, too wide for inject_value */
+    if (!injectValid(&inject))
+        memset(&inject, 0, sizeof(inject));
+    injectFormat();
+    injectReset();
+}
+
+uchar injectSet(const uchar *buf)
+{
+    InjectConfig c;
+
+    memcpy(&c, buf, USBASP_INJECT_LEN);
+    if (!injectValid(&c))
+        return 0;
+    c.reserved = 0;
+    eeprom_update_block(&c, (void *) EE_ADDR_INJECT, USBASP_INJECT_LEN);
+    inject = c;
+    injectFormat();
+    injectReset();
+    return 1;
+}
+
+uchar injectGet(uchar *buf)
+{
+    memcpy(buf, &inject, USBASP_INJECT_LEN);
+    return USBASP_INJECT_LEN;
+}
+
+void injectReset(void)
+{
+    inject_written = 0;
+    inject_verified = 0;
+    inject_touched = 0;
+}
+
+uchar injectCovers(uchar mem, uint32_t from, uint32_t to)
+{
+    return mem == inject.mem && inject.address < to &&
+           from < inject.address + inject.width;
+}
+
+uchar injectWrite(uchar mem, uint32_t address, uchar data)
+{
+    uint32_t k = address - inject.address;
+
+    if (mem != inject.mem)
+        return data;
+    inject_touched = 1;
+    if (k >= inject.width)
+        return data;
+    inject_orig[k] = data;
+    inject_written |= 1 << k;
+    inject_verified &= ~(1 << k);
+    return inject_value[k];
+}
+
+uchar injectMissing(uchar mem, uint32_t *address)
+{
+    uchar k;
+
+    if (mem != inject.mem || !inject_touched)
+        return 0;
+    for (k = 0; k < inject.width; k++) {
+        if (!(inject_written & (1 << k))) {
+            *address = inject.address + k;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+uchar injectRead(uchar mem, uint32_t address, uchar data)
+{
+    uint32_t k = address - inject.address;
+    uchar all;
+
+    if (mem != inject.mem || k >= inject.width ||
+        !(inject_written & (1 << k)) || data != inject_value[k])
+        return data;
+
+    /* the whole field is in the target, next unit next number */
+    inject_verified |= 1 << k;
+    all = (1 << inject.width) - 1;
+    if (inject_written == all && inject_verified == all) {
+        inject.counter++;
+        eeprom_update_block(&inject.counter,
+                            (void *) (EE_ADDR_INJECT + 8), sizeof(inject.counter));
+        injectFormat();
+        injectReset();
+    }
+    return inject_orig[k];
+}
@@ -0,0 +1,52 @@
+/*
+ * inject.h - per-unit serial number injected while programming
+ *
+ * The programmer EEPROM holds a counter and a template: target memory,
+ * address, width and format of a field (usbasp.h). Every flash or EEPROM
+ * byte written to the target passes injectWrite(), which puts the
+ * formatted counter in place of the image bytes inside the field and
+ * keeps the originals. Reads pass injectRead(), which gives the original
+ * back where the target holds the injected value, so the host's verify
+ * against its unchanged image still passes. Once every byte of the field
+ * has been written and read back like that, the counter counts up in the
+ * programmer EEPROM for the next unit. Hosts leave out flash pages that
+ * are blank in the image, so a field there is written over 0xFF and read
+ * back by the firmware itself when the host disconnects.
+ */
+
+#ifndef __inject_h_included__
+#define __inject_h_included__
+
+#include <stdint.h>
+
+#ifndef uchar
+#define	uchar	unsigned char
+#endif
+
+/* template and counter from the programmer EEPROM, call once at start */
+void injectLoad(void);
+
+/* new template and counter in USBASP_INJECT_LEN bytes, 0 if invalid */
+uchar injectSet(const uchar *buf);
+
+/* current template and counter, returns the length */
+uchar injectGet(uchar *buf);
+
+/* forget a field written but not verified, at the start of a session */
+void injectReset(void);
+
+/* 1 if the field lies in mem between from and to (exclusive) */
+uchar injectCovers(uchar mem, uint32_t from, uint32_t to);
+
+/* the byte to write to mem at address in place of data */
+uchar injectWrite(uchar mem, uint32_t address, uchar data);
+
+/* 1 with the address of a field byte not written yet, if anything else
+ * has been written to mem since injectReset(): the host left the field
+ * out as blank image */
+uchar injectMissing(uchar mem, uint32_t *address);
+
+/* the byte the host expects at address for data read from the target */
+uchar injectRead(uchar mem, uint32_t address, uchar data);
+
+#endif /* __inject_h_included__ */
@@ -1,40 +1,106 @@
 
 
 #include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 #include "isp.h"
 #include "clock.h"
 #include "usbasp.h"
+#include "prof.h"
+#include "trace.h"
 
 #define spiHWdisable() SPCR = 0
 
 unsigned int prog_pagesize = 0;
 uchar prog_pagecounter = 0;
+unsigned int prog_skipcounter = 0;
+uchar prog_fusestatus = FUSE_WRITE_OK;
 extern unsigned int prog_pagesize;
 extern uchar prog_pagecounter;
 uchar low_byte;
 
+//Буфер страницы EEPROM (параллельный режим)
+#define EE_PAGEBUF_SIZE		16
+static uint8_t ee_buf[EE_PAGEBUF_SIZE];
+static uint16_t ee_base;
+static uint8_t ee_count;
+static uint8_t ee_skipequal;
+
 uchar sck_sw_delay;
 uchar sck_spcr;
 uchar sck_spsr;
 uchar isp_hiaddr;
+uchar (*ispTransmit)(uchar);
 
 //Parallel
 uchar dev_type;
 
+//Отложенное завершение операции (запись страницы, стирание, фьюзы,
+//вход в режим программирования):
+//шаг выполняется из ispPoll() по наступлении isp_deadline
+static uchar (*isp_step)(void);
+static uint32_t isp_deadline;
+static uint32_t isp_timeout;
+static uint32_t isp_commit_t0;
+static uchar fuse_bt, fuse_vl, fuse_mask, fuse_tries;
+
+static void isp_defer(uchar (*step)(void), uint32_t ticks)
+{
+	isp_deadline = clockDeadline(ticks);
+	isp_step = step;
+}
+
+uchar ispPoll(void)
+{
+	uchar (*step)(void) = isp_step;
+
+	if(!step) return 0;
+	if(!clockExpired(isp_deadline)) return 1;
+	//Шаг может сам обращаться к цели, поэтому снимаем его до вызова;
+	//ненулевой результат - шаг перевзвёл isp_deadline и ждёт дальше
+	isp_step = 0;
+	if(step())
+	{
+		isp_step = step;
+		return 1;
+	}
+	return 0;
+}
+
+void ispWait(void)
+{
+	uint32_t t0;
+
+	if(!isp_step) return;
+	t0 = clockNow();
+	while(ispPoll());
+	t0 = clockNow() - t0;
+	profAdd(PROF_BUSYWAIT, t0);
+	if(t0 > 0xFFFFFF) t0 = 0xFFFFFF;
+	traceEvent(TRACE_BUSY, t0, t0 >> 8, t0 >> 16);
+}
+
+uchar ispBusy(void)
+{
+	return isp_step != 0;
+}
+
 void avr_reset(void)
 {
 	VPP_LOW
-	_delay_ms(10);
+	clockDelay(CLOCK_MS(10));
 	VPP_HIGH
 }
 
 void puls_xt1(void)
 {
+	PROF_BEGIN();
 	XTAIL_HIGH
 	_delay_us(5);
 	XTAIL_LOW
 	_delay_us(5);
+	PROF_END(PROF_PULSXT1);
 }
 
 //Отправка/приём последовательного пакета
@@ -45,7 +111,11 @@ uchar avr_serialExchange(uchar instr, uchar data)
 	command = instr << 2;
 	dat = data<<2;
 
+	ispWait();
+	PROF_BEGIN();
+
 	DATA_IN
+	SDO_HIGH	//подтяжка SDO
 	for(i = 0; i < 11; i++)
 	{
 		_delay_us(1);
@@ -61,131 +131,256 @@ uchar avr_serialExchange(uchar instr, uchar data)
 		//Защёлкиваем SDO
 		if(DATA_PIN & 0x01) request |= (1 << (10 - i));
 	}
+	PROF_END(PROF_SERIAL);
 	return (request>>3);
 }
 
-void avr_bsySerial(void)
+//Ожидание готовности по SDO, не дольше 45 мс
+static uchar avr_serialReady(void)
 {
-	unsigned int delay = 0;
-	_delay_us(50);
-	while(!(DATA_PIN & 0x01))
+	if(DATA_PIN & 0x01) return 0;
+	if(clockExpired(isp_timeout))
 	{
-		_delay_us(10);
-		delay++;
-		if(delay == 0xFFF)
-		{
-			avr_reset();
-			return;
-		}
+		traceEvent(TRACE_ERROR, TRACE_ERR_SERIALBSY, 0, 0);
+		avr_reset();
+		return 0;
 	}
+	isp_deadline = clockDeadline(CLOCK_US(10));
+	return 1;
+}
+
+static void avr_deferBsySerial(void)
+{
+	isp_timeout = clockDeadline(CLOCK_MS(45));
+	isp_defer(avr_serialReady, CLOCK_US(50));
 }
 
-uchar avr_progMode(void)
+void avr_bsySerial(void)
+{
+	avr_deferBsySerial();
+	ispWait();
+}
+
+//Нарастание 12 В на RESET с запасом; остальные паузы - минимумы из даташита
+#define VPP_RISE	CLOCK_MS(1)
+
+//Вход в режим программирования идёт шагами из ispPoll(), чтобы не держать
+//usbPoll(): mode_phase - шаг входа в режим dev_type, MODE_PHASE_ID - опрос ID
+#define MODE_PHASE_ID	0xFF
+
+uchar prog_modestatus = PROG_MODE_OK;
+static uchar mode_hint, mode_rec, mode_try, mode_phase, mode_result, mode_error;
+
+//Очередной шаг входа в режим dev_type: 0 - Full bus, 1 - Short bus,
+//2 - Serial HV. Возвращает паузу до следующего шага, 0 - вход закончен
+static uint32_t avr_enterStep(void)
 {
     uchar i;
-    uint16_t timeout = 0;
-    
-    // Full bus device - dev_type = 0
-    VPP_HIGH
-    XTAIL_LOW
-    XA0_HIGH
-    XA1_HIGH
-    _delay_ms(10);
-    
-    // Reset to low
-    VPP_LOW
-    _delay_ms(10);
-    
-    // Toggle XTAL1 at least 6 times
-    for(i = 0; i < 10; i++) {
-        puls_xt1();
-        _delay_us(10);
-    }
-    
-    // Set the Prog_enable pins to "0000"
-    PAGEL_LOW
-    XA0_LOW
-    XA1_LOW
-    BS1_LOW
-    _delay_ms(20);
-    
-    // Apply 11.5 - 12.5V to RESET
-    VPP_HIGH
-    _delay_ms(50);
-    
-    dev_type = 0x00;
-    
-    // Проверяем ID с таймаутом
-    while(avr_getId(0) != 0x1E) {
-        if (timeout++ > 1000) {
-            break; // Таймаут для Full bus
+
+    if (dev_type == 0x00) {
+        // Full bus device - dev_type = 0
+        switch (mode_phase++) {
+        case 0:
+            VPP_HIGH
+            XTAIL_LOW
+            XA0_HIGH
+            XA1_HIGH
+            return CLOCK_MS(1);
+        case 1:
+            // Reset to low
+            VPP_LOW
+            return CLOCK_US(100);
+        case 2:
+            // Toggle XTAL1 at least 6 times
+            for(i = 0; i < 10; i++) {
+                puls_xt1();
+                _delay_us(10);
+            }
+            // Set the Prog_enable pins to "0000"
+            PAGEL_LOW
+            XA0_LOW
+            XA1_LOW
+            BS1_LOW
+            return CLOCK_US(100);
+        case 3:
+            // Apply 11.5 - 12.5V to RESET: нарастание VPP + 50 мкс до команды
+            VPP_HIGH
+            return VPP_RISE;
+        }
+    } else if (dev_type == 0x01) {
+        // Short bus device - dev_type = 1
+        switch (mode_phase++) {
+        case 0:
+            VDD_LOW
+            return CLOCK_MS(1);
+        case 1:
+            XTAIL_LOW
+            PAGEL_LOW
+            XA0_LOW
+            XA1_LOW
+            BS1_LOW
+            WR_LOW
+            OE_LOW
+            VPP_LOW
+            return CLOCK_US(100);
+        case 2:
+            // VCC -> 12 В на RESET через 20 - 60 мкс: окно уже шага ispPoll
+            VDD_HIGH
+            clockDelay(CLOCK_US(40));
+            VPP_HIGH
+            return VPP_RISE;
+        case 3:
+            WR_HIGH
+            OE_HIGH
+        }
+    } else {
+        // Serial HV Programming
+        switch (mode_phase++) {
+        case 0:
+            VDD_LOW
+            SCI_LOW
+            DATA_OUT
+            SDI_LOW
+            SII_LOW
+            SDO_LOW
+            VPP_LOW
+            return CLOCK_MS(1);
+        case 1:
+            VDD_HIGH
+            VPP_HIGH
+            return VPP_RISE;
+        case 2:
+            // SDO отпущен - не раньше 300 мкс до первой инструкции
+            DATA_IN
+            return CLOCK_US(500);
         }
-        _delay_ms(1);
     }
-    if (avr_getId(0) == 0x1E) return 0;
-
-    timeout = 0;
-    // Short bus device - dev_type = 1
-    VDD_LOW
-    _delay_ms(200);
-    XA0_LOW
-    XA1_LOW
-    BS1_LOW
-    WR_LOW
-    OE_LOW
-    VPP_LOW
-    _delay_ms(20);
-    VDD_HIGH
-    _delay_ms(10);
-    VPP_HIGH
-    _delay_ms(500);
-    WR_HIGH
-    OE_HIGH
-
-    dev_type = 0x01;
-    
-    // Проверяем ID с таймаутом
-    while(avr_getId(0) != 0x1E) {
-        if (timeout++ > 1000) {
-            break; // Таймаут для Short bus
+    return 0;
+}
+
+//Следующий режим перебора в dev_type; 0 - перебор окончен
+static uchar avr_nextMode(void)
+{
+    uchar type;
+
+    do {
+        if (mode_hint != USBASP_PROGMODE_AUTO) {
+            // Режим задан хостом - без автоопределения
+            if (mode_try++) return 0;
+            type = mode_hint - 1;
+        } else {
+            // Сначала пробуем последний удачный режим
+            if (mode_try > 3) return 0;
+            if (mode_try == 0) type = mode_rec;
+            else if (mode_try - 1 != mode_rec) type = mode_try - 1;
+            else type = 0xFF;
+            mode_try++;
         }
-        _delay_ms(1);
+    } while (type == 0xFF);
+
+    dev_type = type;
+    mode_phase = 0;
+    return 1;
+}
+
+//Запоминаем удачный режим и сигнатуру в EEPROM программатора
+static void avr_saveMode(void)
+{
+    uchar rec[EE_PROGMODE_LEN];
+    uchar i;
+
+    rec[0] = EE_PROGMODE_MAGIC;
+    rec[1] = dev_type;
+    for(i = 0; i < 3; i++) rec[2 + i] = avr_getId(i);
+    eeprom_update_block(rec, (void *) EE_ADDR_PROGMODE, EE_PROGMODE_LEN);
+}
+
+static void avr_modeDone(uchar result)
+{
+    prog_modestatus = result;
+    if (result == PROG_MODE_OK) avr_saveMode();
+    else traceEvent(TRACE_ERROR, TRACE_ERR_PROGMODE, result, 0);
+}
+
+//Шаг входа в режим: выводы по avr_enterStep(), затем ID с таймаутом
+static uchar avr_modeStep(void)
+{
+    uint32_t pause;
+    uchar id;
+
+    if (mode_phase != MODE_PHASE_ID) {
+        pause = avr_enterStep();
+        if (pause) {
+            isp_deadline = clockDeadline(pause);
+            return 1;
+        }
+        // На шине только 0x00/0xFF - цели нет, долго не ждём
+        mode_phase = MODE_PHASE_ID;
+        mode_result = PROG_MODE_ERR_NOTARGET;
+        isp_timeout = clockDeadline(CLOCK_MS(PROBE_EMPTY_MS));
     }
-    if (avr_getId(0) == 0x1E) return 0;
-
-    timeout = 0;
-    // Serial HV Programming
-    VDD_LOW
-    SCI_LOW
-    DATA_OUT
-    SDI_LOW
-    SII_LOW
-    SDO_LOW
-    VPP_LOW
-    _delay_ms(10);
-    VDD_HIGH
-    VPP_HIGH
-    _delay_ms(20);
-    DATA_IN
-    _delay_us(500);
-    
-    dev_type = 0x02;
-    
-    // Проверяем ID с таймаутом
-    while(avr_getId(0) != 0x1E) {
-        if (timeout++ > 1000) {
-            break; // Таймаут для Serial HV
+
+    id = avr_getId(0);
+    if (id == 0x1E) {
+        if (avr_getId(0) == 0x1E) {
+            avr_modeDone(PROG_MODE_OK);
+            return 0;
         }
-        _delay_ms(1);
+        id = PROG_MODE_ERR_UNSTABLE;
+    } else if (id != 0x00 && id != 0xFF) {
+        id = PROG_MODE_ERR_NOSIG;
+    } else {
+        id = PROG_MODE_ERR_NOTARGET;
+    }
+    // Шина ответила - даём цели время до PROBE_ACTIVE_MS
+    if (id > mode_result) {
+        if (mode_result == PROG_MODE_ERR_NOTARGET)
+            isp_timeout = clockDeadline(CLOCK_MS(PROBE_ACTIVE_MS));
+        mode_result = id;
+    }
+    if (!clockExpired(isp_timeout)) {
+        isp_deadline = clockDeadline(CLOCK_US(100));
+        return 1;
+    }
+
+    // Запоминаем самую информативную причину и берём следующий режим
+    if (mode_result > mode_error) mode_error = mode_result;
+    if (!avr_nextMode()) {
+        avr_modeDone(mode_error); // Все методы не сработали
+        return 0;
+    }
+    isp_deadline = clockNow();
+    return 1;
+}
+
+void avr_startMode(uchar hint)
+{
+    uchar rec[EE_PROGMODE_LEN];
+
+    ispWait();
+
+    if (hint > USBASP_PROGMODE_SERIAL) {
+        prog_modestatus = PROG_MODE_ERR_HINT;
+        return;
     }
-    if (avr_getId(0) == 0x1E) return 0;
 
-    return 1; // Все методы не сработали
+    eeprom_read_block(rec, (void *) EE_ADDR_PROGMODE, EE_PROGMODE_LEN);
+    if (rec[0] != EE_PROGMODE_MAGIC || rec[1] > 0x02) rec[1] = 0xFF;
+    mode_rec = rec[1];
+    mode_hint = hint;
+    mode_try = 0;
+    mode_error = PROG_MODE_ERR_NOTARGET;
+
+    prog_modestatus = PROG_MODE_BUSY;
+    avr_nextMode();
+    isp_defer(avr_modeStep, 0);
 }
 
 //Загрузка команды
 void avr_loadComm(uchar command)
 {
+	ispWait();
+	PROF_BEGIN();
 	if(dev_type == 0x00 || dev_type == 0x01)
 	{
 		DATA_OUT
@@ -201,11 +396,14 @@ void avr_loadComm(uchar command)
 		//Даём импульс на XT1
 		puls_xt1();
 	}
+	PROF_END(PROF_LOADCOMM);
 }
 
 //Загрузка байта адреса
 void avr_loadAdd(uchar add, uchar hi_lo)
 {
+	ispWait();
+	PROF_BEGIN();
 	if(dev_type == 0x00 || dev_type == 0x01)
 	{
 		//Устанавливаем биты XA на загрузку комманды [0:0]
@@ -222,6 +420,22 @@ void avr_loadAdd(uchar add, uchar hi_lo)
 		//Даём импульс на XT1
 		puls_xt1();
 	}
+	PROF_END(PROF_LOADADD);
+}
+
+//Чтение шины данных: tOLDV и tOHDZ по 1 мкс вместо прежней 1 мс
+static uchar avr_readBus(void)
+{
+	uchar result;
+
+	DATA_IN
+	DATA_PORT = 0xFF;	//подтяжка: пустая панель читается как 0xFF
+	OE_LOW
+	_delay_us(1);
+	result = DATA_PIN;
+	OE_HIGH
+	_delay_us(1);
+	return result;
 }
 
 uchar avr_getId(uchar idadd)
@@ -233,11 +447,7 @@ uchar avr_getId(uchar idadd)
 		avr_loadComm(0x08);
 		avr_loadAdd(idadd, 0);
 		//Read first byte
-		DATA_IN
-		OE_LOW
-		_delay_ms(1);
-		result = DATA_PIN;
-		OE_HIGH
+		result = avr_readBus();
 	}
 	else
 	{
@@ -251,6 +461,37 @@ uchar avr_getId(uchar idadd)
 	return result;
 }
 
+uchar avr_getCalibration(uchar caladd)
+{
+	if(dev_type == 0x00 || dev_type == 0x01)
+	{
+		avr_loadComm(0x08);
+		avr_loadAdd(caladd, 0);
+		//BS1 = 1 - калибровочный байт
+		BS1_HIGH
+		return avr_readBus();
+	}
+
+	avr_serialExchange(0x4C, 0x08);
+	avr_serialExchange(0x0C, caladd);
+	avr_serialExchange(0x78, 0x00);
+	return avr_serialExchange(0x7C, 0x00);
+}
+
+//Сигнатура, fuse, lock и калибровочные байты одним пакетом
+uchar avr_getIdentity(uchar *buf)
+{
+	uchar i;
+
+	for(i = 0; i < 3; i++) buf[i] = avr_getId(i);
+	buf[3] = avr_getFuse(1);
+	buf[4] = avr_getFuse(0);
+	buf[5] = avr_getFuse(2);
+	buf[6] = avr_getFuse(3);
+	for(i = 0; i < 4; i++) buf[7 + i] = avr_getCalibration(i);
+	return USBASP_IDENTITY_LEN;
+}
+
 uchar avr_getFuse(uchar bt) //bt=0 HFuse, bt=1 LFuse, bt=2 EFuse, bt=3 LBits
 {
 	uchar result = 0;
@@ -284,10 +525,7 @@ uchar avr_getFuse(uchar bt) //bt=0 HFuse, bt=1 LFuse, bt=2 EFuse, bt=3 LBits
 			if(dev_type == 0x00) BS2_LOW
 			XA1_LOW
 		}
-		OE_LOW
-		_delay_ms(1);
-		result = DATA_PIN; //HIGH BITS
-		OE_HIGH
+		result = avr_readBus();
 	}
 	else
 	{
@@ -317,8 +555,88 @@ uchar avr_getFuse(uchar bt) //bt=0 HFuse, bt=1 LFuse, bt=2 EFuse, bt=3 LBits
 	return result;
 }
 
+//Номер байта для avr_getFuse() по коду команды записи
+static uchar avr_fuseIndex(uchar fs)
+{
+	if(fs == 0xA0) return 1; //Low fuse
+	if(fs == 0xA8) return 0; //High fuse
+	if(fs == 0xA4) return 2; //Ext fuse
+	return 3;                //LOCK
+}
+
+//Реализованные биты fuse и lock по сигнатуре, в порядке avr_getFuse():
+//high, low, ext, lock. Остальные биты всегда читаются как 1
+typedef struct {
+	uchar sig[2];
+	uchar bits[4];
+} FuseBits;
+
+static const FuseBits avr_fuseBits[] PROGMEM = {
+	{ { 0x93, 0x07 }, { 0xFF, 0xFF, 0x00, 0x3F } },	//ATmega8
+	{ { 0x94, 0x03 }, { 0xFF, 0xFF, 0x00, 0x3F } },	//ATmega16
+	{ { 0x95, 0x02 }, { 0xFF, 0xFF, 0x00, 0x3F } },	//ATmega32
+	{ { 0x92, 0x05 }, { 0xFF, 0xFF, 0x01, 0x3F } },	//ATmega48
+	{ { 0x93, 0x0A }, { 0xFF, 0xFF, 0x07, 0x3F } },	//ATmega88
+	{ { 0x94, 0x06 }, { 0xFF, 0xFF, 0x07, 0x3F } },	//ATmega168
+	{ { 0x95, 0x0F }, { 0xFF, 0xFF, 0x07, 0x3F } },	//ATmega328P
+	{ { 0x96, 0x09 }, { 0xFF, 0xFF, 0x07, 0x3F } },	//ATmega644
+	{ { 0x97, 0x02 }, { 0xFF, 0xFF, 0x03, 0x3F } },	//ATmega128
+	{ { 0x98, 0x01 }, { 0xFF, 0xFF, 0x07, 0x3F } },	//ATmega2560
+	{ { 0x91, 0x0A }, { 0xFF, 0xFF, 0x01, 0x03 } },	//ATtiny2313
+	{ { 0x90, 0x07 }, { 0x1F, 0xFF, 0x00, 0x03 } },	//ATtiny13
+	{ { 0x91, 0x08 }, { 0xFF, 0xFF, 0x01, 0x03 } },	//ATtiny25
+	{ { 0x92, 0x06 }, { 0xFF, 0xFF, 0x01, 0x03 } },	//ATtiny45
+	{ { 0x93, 0x0B }, { 0xFF, 0xFF, 0x01, 0x03 } },	//ATtiny85
+};
+
+//Маска сравнения для fuse bt; для неизвестного кристалла у lock
+//не сравниваются старшие биты 7:6, которых нет ни у одного AVR
+static uchar avr_fuseMask(uchar bt)
+{
+	uchar i, s1 = avr_getId(1), s2 = avr_getId(2);
+
+	for(i = 0; i < sizeof(avr_fuseBits) / sizeof(avr_fuseBits[0]); i++)
+	{
+		if(pgm_read_byte(&avr_fuseBits[i].sig[0]) == s1 &&
+		   pgm_read_byte(&avr_fuseBits[i].sig[1]) == s2)
+			return pgm_read_byte(&avr_fuseBits[i].bits[bt]);
+	}
+	return bt == 3 ? 0x3F : 0xFF;
+}
+
+//Проверка записанного фьюза чтением (не более ~25 мс)
+static uchar avr_fuseVerify(void)
+{
+	if(dev_type == 0x02 && avr_serialReady()) return 1;
+	if(!((avr_getFuse(fuse_bt) ^ fuse_vl) & fuse_mask)) prog_fusestatus = FUSE_WRITE_OK;
+	else if(++fuse_tries >= 25)
+	{
+		prog_fusestatus = FUSE_WRITE_VERIFY;
+		traceEvent(TRACE_ERROR, TRACE_ERR_FUSE, fuse_bt, 0);
+	}
+	else
+	{
+		isp_deadline = clockDeadline(CLOCK_US(100));
+		return 1;
+	}
+	return 0;
+}
+
 void avrSetFuse(uchar fs, uchar vl)
 {
+	fuse_bt = avr_fuseIndex(fs);
+	fuse_vl = vl;
+	fuse_mask = avr_fuseMask(fuse_bt);
+	fuse_tries = 0;
+
+	//Значение уже записано - не программируем
+	if(!((avr_getFuse(fuse_bt) ^ vl) & fuse_mask))
+	{
+		prog_fusestatus = FUSE_WRITE_SKIPPED;
+		return;
+	}
+	prog_fusestatus = FUSE_WRITE_BUSY;
+
 	if(dev_type == 0x00 || dev_type == 0x01) //Full bus or short bus
 	{
 		PAGEL_LOW
@@ -350,9 +668,10 @@ void avrSetFuse(uchar fs, uchar vl)
 		}
 		_delay_us(10);
 		WR_LOW
-		_delay_ms(1);
+		_delay_us(1);
 		WR_HIGH
-		_delay_ms(100);
+		//tWLRH min, дальше опрашиваем чтением
+		isp_defer(avr_fuseVerify, CLOCK_MS(4));
 	}
 	else
 	{
@@ -362,7 +681,6 @@ void avrSetFuse(uchar fs, uchar vl)
 			avr_serialExchange(0x2C, vl);
 			avr_serialExchange(0x64, 0x00);
 			avr_serialExchange(0x6C, 0x00);
-			avr_bsySerial();
 		}
 		if(fs == 0xA8) //High fuse
 		{
@@ -370,7 +688,6 @@ void avrSetFuse(uchar fs, uchar vl)
 			avr_serialExchange(0x2C, vl);
 			avr_serialExchange(0x74, 0x00);
 			avr_serialExchange(0x7C, 0x00);
-			avr_bsySerial();
 		}
 		if(fs == 0xA4) //Ext fuse
 		{
@@ -378,7 +695,6 @@ void avrSetFuse(uchar fs, uchar vl)
 			avr_serialExchange(0x2C, vl);
 			avr_serialExchange(0x66, 0x00);
 			avr_serialExchange(0x6E, 0x00);
-			avr_bsySerial();
 		}
 		if(fs == 0xE0) //LOCK Fuse
 		{
@@ -386,25 +702,50 @@ void avrSetFuse(uchar fs, uchar vl)
 		avr_serialExchange(0x2C, vl);
 		avr_serialExchange(0x64, 0x00);
 		avr_serialExchange(0x6C, 0x00);
-		avr_bsySerial();
 		}
+		isp_timeout = clockDeadline(CLOCK_MS(45));
+		isp_defer(avr_fuseVerify, CLOCK_US(50));
 	}
 }
 
+static uchar avr_stepDone(void)
+{
+	return 0;
+}
+
 void avr_erase(void)
 {
 	if(dev_type == 0x00 || dev_type == 0x01)
 	{
 		avr_loadComm(0x80);
 		WR_LOW
-		_delay_us(200);
+		clockDelay(CLOCK_US(200));
 		WR_HIGH
-		_delay_ms(150);
+		isp_defer(avr_stepDone, CLOCK_MS(150));
 	}
 	else
 	{
+		avr_serialExchange(0x4C, 0x80);
+		avr_serialExchange(0x64, 0x00);
+		avr_serialExchange(0x6C, 0x00);
+		avr_deferBsySerial();
+	}
+}
 
+//Трансляция SPI команд avrdude (USBASP_FUNC_TRANSMIT) в высоковольтный режим
+uchar ispCommand(uchar *cmd)
+{
+	if(cmd[0] == 0x30) return avr_getId(cmd[2] & 0x03);	//Signature
+	if(cmd[0] == 0x38) return avr_getCalibration(cmd[2] & 0x03);	//Calibration
+	if(cmd[0] == 0x50) return avr_getFuse(cmd[1] ? 2 : 1);	//EFuse / LFuse
+	if(cmd[0] == 0x58) return avr_getFuse(cmd[1] ? 0 : 3);	//HFuse / Lock
+	if(cmd[0] == 0xAC)
+	{
+		if(cmd[1] == 0x80) avr_erase();
+		if(cmd[1] == 0xA0 || cmd[1] == 0xA8 || cmd[1] == 0xA4 || cmd[1] == 0xE0)
+			avrSetFuse(cmd[1], cmd[3]);
 	}
+	return 0x00;
 }
 
 //
@@ -443,13 +784,68 @@ void ispConnect()
 
 void ispDisconnect()
 {
+	//Незаконченный вход в режим просто бросаем
+	if(isp_step == avr_modeStep)
+	{
+		isp_step = 0;
+		prog_modestatus = PROG_MODE_ERR_NOTARGET;
+	}
+	ispWait();
+	//Сначала снимаем VPP и питание, потом отпускаем линии управления
+	VPP_LOW
+	VDD_LOW
 	DATA_IN
 	CONTROL_DDR = 0x00;
-	VDD_LOW
-	VPP_LOW
 	POWER_DDR &= ~((1 << VDD_PIN)|(1 << VPP_PIN));
 }
 
+//Подтяжки держат линию на время выборки: это десятки постоянных времени
+//подтяжки на ёмкость линии
+#define SENSE_SETTLE	CLOCK_US(10)
+
+void ispSenseStart()
+{
+	//Все линии отпущены и без подтяжек, чтобы не питать цель через её
+	//защитные диоды; RESET на 0 В, VDD снято
+	CONTROL_PORT = 0x00;
+	CONTROL_DDR = 0x00;
+	DATA_IN
+	DATA_PORT = 0x00;
+	VPP_LOW
+	VDD_LOW
+	POWER_DDR |= (1 << VDD_PIN)|(1 << VPP_PIN);
+}
+
+uchar ispSense()
+{
+	uchar level;
+
+	//Подтяжки только на время выборки: через диоды обесточенной цели
+	//за SENSE_SETTLE успевает стечь лишь около 10 нКл
+	DATA_PORT = 0xFF;
+	clockDelay(SENSE_SETTLE);
+	level = DATA_PIN;
+	DATA_PORT = 0x00;
+	return level;
+}
+
+void ispSensePower(uchar on)
+{
+	if(on)
+	{
+		VDD_HIGH
+	}
+	else
+	{
+		VDD_LOW
+	}
+}
+
+void ispSenseEnd()
+{
+	ispDisconnect();
+}
+
 uchar ispTransmit_sw(uchar send_byte)
 {
 	return 0xFF;
@@ -460,10 +856,17 @@ uchar ispTransmit_hw(uchar send_byte)
 	return 0xFF;
 }
 
-uchar ispEnterProgrammingMode()
+void ispStartProgrammingMode(uchar hint)
 {
 	//Parallel
-	return avr_progMode();
+	avr_startMode(hint);
+}
+
+uchar ispEnterProgrammingMode(uchar hint)
+{
+	avr_startMode(hint);
+	ispWait();
+	return prog_modestatus;
 }
 
 void ispUpdateExtended(uint32_t address)
@@ -482,9 +885,14 @@ void ispUpdateExtended(uint32_t address)
 /* ---------- основная функция ---------- */
 uint8_t ispReadFlash(uint32_t address)
 {
-    return (dev_type == 0x00 || dev_type == 0x01)
-           ? parallelReadFlash(address)
-           : serialReadFlash(address);
+    uint8_t result;
+    PROF_BEGIN();
+
+    result = (dev_type == 0x00 || dev_type == 0x01)
+             ? parallelReadFlash(address)
+             : serialReadFlash(address);
+    PROF_END(PROF_READBYTE);
+    return result;
 }
 
 /* ---------- Параллельный режим ---------- */
@@ -523,14 +931,19 @@ uint8_t serialReadFlash(uint32_t address)
 
 uchar ispWriteFlash(uint32_t address, uint8_t data, uint8_t pollmode)
 {
+    uchar result;
+    PROF_BEGIN();
+
     /* ----- выбираем режим ----- */
     if (dev_type == 0x00 || dev_type == 0x01) {
         /* ---------- Параллельный режим ---------- */
-        return parallelWriteFlash(address, data, pollmode);
+        result = parallelWriteFlash(address, data, pollmode);
     } else {
         /* ---------- Serial mode (25-series) ---------- */
-        return serialWriteFlash(address, data, pollmode);
+        result = serialWriteFlash(address, data, pollmode);
     }
+    PROF_END(PROF_PAGELOAD);
+    return result;
 }
 
 /* ---------- Параллельный режим ---------- */
@@ -590,56 +1003,96 @@ uchar serialWriteFlash(uint32_t address, uint8_t data, uint8_t pollmode)
     return 0;
 }
 
+/* завершение записи страницы: No Operation через 8 мс */
+static uchar parallelPageDone(void)
+{
+    XA1_HIGH; XA0_LOW;
+    DATA_PORT = 0x00;
+    puls_xt1();
+    profAdd(PROF_PAGECOMMIT, clockNow() - isp_commit_t0);
+    return 0;
+}
+
+static uchar serialPageDone(void)
+{
+    avr_serialExchange(0x4C, 0x00);
+    profAdd(PROF_PAGECOMMIT, clockNow() - isp_commit_t0);
+    return 0;
+}
+
 uchar ispFlushPage(uint32_t address, uint8_t pollvalue)
 {
     if (dev_type == 0x00 || dev_type == 0x01) {
         /* ---------- Параллельный режим ---------- */
         avr_loadAdd((address >> 9), 1);
         ispUpdateExtended(address);
+        isp_commit_t0 = clockNow();
+        traceEvent(TRACE_COMMIT, address, address >> 8, address >> 16);
         WR_LOW;  _delay_us(1);
-        WR_HIGH; _delay_ms(8);
-        XA1_HIGH; XA0_LOW;
-        DATA_PORT = 0x00;
-        puls_xt1();
+        WR_HIGH;
+        isp_defer(parallelPageDone, CLOCK_MS(8));
         return 0;
     }
 
     /* ---------- Serial mode (25-series) ---------- */
+    isp_commit_t0 = clockNow();
+    traceEvent(TRACE_COMMIT, address, address >> 8, address >> 16);
     avr_serialExchange(0x1C, (address >> 9));
     avr_serialExchange(0x64, 0x00);
     avr_serialExchange(0x6C, 0x00);
-    _delay_ms(8);
-    avr_serialExchange(0x4C, 0x00);
+    isp_defer(serialPageDone, CLOCK_MS(8));
     return 0;   // успех
 }
 
 uchar ispReadEEPROM(uint16_t address)
 {
+    uint8_t result;
+    PROF_BEGIN();
+
     if (dev_type == 0x00 || dev_type == 0x01) {
         /* ---------- Параллельный режим ---------- */
         avr_loadComm(0x03);
-        avr_loadAdd((address & 0xFF), 1);
+        avr_loadAdd((address >> 8), 1);
         avr_loadAdd((address & 0xFF), 0);
         DATA_IN;
         BS1_LOW; OE_LOW;  _delay_us(1);
-        uint8_t result = DATA_PIN;
+        result = DATA_PIN;
         OE_HIGH;
-        return result;
+    } else {
+        /* ---------- Serial mode (25-series) ---------- */
+        avr_serialExchange(0x4C, 0x03);
+        avr_serialExchange(0x0C, (address & 0xFF));
+        avr_serialExchange(0x1C, (address >> 8));
+        avr_serialExchange(0x68, 0x00);
+        result = avr_serialExchange(0x6C, 0x00);
     }
-
-    /* ---------- Serial mode (25-series) ---------- */
-    avr_serialExchange(0x4C, 0x03);
-    avr_serialExchange(0x0C, (address & 0xFF));
-    avr_serialExchange(0x1C, (address >> 8));
-    avr_serialExchange(0x68, 0x00);
-    return avr_serialExchange(0x6C, 0x00);
+    PROF_END(PROF_READBYTE);
+    return result;
 }
 
-uchar ispWriteEEPROM(uint16_t address, uint8_t data)
+uchar ispWriteEEPROM(uint16_t address, uint8_t data, uint8_t skipequal)
 {
+    if (dev_type == 0x00 || dev_type == 0x01) {
+        /* ---------- Параллельный режим ---------- */
+        /* байты копятся в буфере, страница пишется в ispFlushEEPROM() */
+        if (ee_count && (ee_count >= EE_PAGEBUF_SIZE ||
+                         address != ee_base + ee_count ||
+                         skipequal != ee_skipequal)) {
+            ispFlushEEPROM();
+        }
+        if (ee_count == 0) {
+            ee_base = address;
+            ee_skipequal = skipequal;
+        }
+        ee_buf[ee_count++] = data;
+        return 0;
+    }
+
     /* ---------- Serial mode (25-series) ---------- */
-    /* 25-xx **не имеют** EEPROM – возвращаем 0 (успех) */
-    if (dev_type == 0x00 || dev_type == 0x01) return 0;
+    if (skipequal && ispReadEEPROM(address) == data) {
+        prog_skipcounter++;
+        return 0;
+    }
 
     avr_serialExchange(0x4C, 0x11);
     avr_serialExchange(0x0C, (address & 0xFF));
@@ -648,6 +1101,54 @@ uchar ispWriteEEPROM(uint16_t address, uint8_t data)
     avr_serialExchange(0x6D, 0x00);
     avr_serialExchange(0x64, 0x00);
     avr_serialExchange(0x6C, 0x00);
-    avr_bsySerial();
+    avr_deferBsySerial();
+    return 0;
+}
+
+static uchar eepromPageDone(void)
+{
+    avr_loadComm(0x00);                  // No Operation
+    profAdd(PROF_PAGECOMMIT, clockNow() - isp_commit_t0);
+    return 0;
+}
+
+uchar ispFlushEEPROM(void)
+{
+    uint16_t changed = 0xFFFF;          // биты байтов, которые надо писать
+    uint8_t i;
+
+    if (ee_count == 0) return 0;        // serial mode или нечего писать
+
+    /* ----- сначала читаем страницу, потом пишем только отличия ----- */
+    if (ee_skipequal) {
+        for (i = 0; i < ee_count; i++) {
+            if (ispReadEEPROM(ee_base + i) == ee_buf[i]) {
+                changed &= ~((uint16_t) 1 << i);
+                prog_skipcounter++;
+            }
+        }
+    }
+
+    if (changed & ((1UL << ee_count) - 1)) {
+        avr_loadComm(0x11);              // Write EEPROM
+        for (i = 0; i < ee_count; i++) {
+            if (!(changed & ((uint16_t) 1 << i))) continue;
+            avr_loadAdd(((ee_base + i) >> 8), 1);
+            avr_loadAdd(((ee_base + i) & 0xFF), 0);
+            XA0_HIGH; XA1_LOW; BS1_LOW;
+            DATA_PORT = ee_buf[i];
+            puls_xt1();
+            PAGEL_HIGH; _delay_us(1);   // защёлкиваем байт в буфер страницы
+            PAGEL_LOW;  _delay_us(1);
+        }
+        BS1_LOW;
+        isp_commit_t0 = clockNow();
+        traceEvent(TRACE_COMMIT, ee_base, ee_base >> 8, 0);
+        WR_LOW;  _delay_us(1);
+        WR_HIGH;
+        isp_defer(eepromPageDone, CLOCK_MS(5));
+    }
+
+    ee_count = 0;
     return 0;
 }
@@ -76,16 +76,26 @@ void avr_reset(void);
 void puls_xt1(void);
 uchar avr_serialExchange(uchar instr, uchar data);
 void avr_bsySerial(void);
-uchar avr_progMode(void);
+void avr_startMode(uchar hint);
 void avr_loadComm(uchar command);
 void avr_loadAdd(uchar add, uchar hi_lo);
 uchar avr_getId(uchar);
 uchar avr_getFuse(uchar);
+uchar avr_getCalibration(uchar);
+uchar avr_getIdentity(uchar *buf);
 void avrSetFuse(uchar, uchar);
 void avr_erase(void);
+uchar ispCommand(uchar *cmd);
+
+/* signature poll deadlines per programming mode, ms */
+#define PROBE_EMPTY_MS		20	/* bus reads only 0x00/0xFF */
+#define PROBE_ACTIVE_MS		100	/* bus answers something */
 
 extern unsigned int prog_pagesize;
 extern uchar prog_pagecounter;
+extern unsigned int prog_skipcounter;
+extern uchar prog_fusestatus;
+extern uchar prog_modestatus;
 
 
 /* Prepare connection to target device */
@@ -94,31 +104,58 @@ void ispConnect();
 /* Close connection to target device */
 void ispDisconnect();
 
+/* socket presence probe without VPP: ispSenseStart() leaves the socket
+ * unpowered with RESET at 0 V and all lines released without pull-ups;
+ * ispSense() reads the data bus with the pull-ups on for a few us only,
+ * ispSensePower() switches VDD alone, ispSenseEnd() drops it */
+void ispSenseStart(void);
+uchar ispSense(void);
+void ispSensePower(uchar on);
+void ispSenseEnd(void);
+
 /* read an write a byte from isp using software (slow) */
 uchar ispTransmit_sw(uchar send_byte);
 
 /* read an write a byte from isp using hardware (fast) */
 uchar ispTransmit_hw(uchar send_byte);
 
-/* enter programming mode */
-uchar ispEnterProgrammingMode();
+/* start entering programming mode, hint - USBASP_PROGMODE_*; ispPoll()
+ * runs the sequence, prog_modestatus is PROG_MODE_BUSY until it is done */
+void ispStartProgrammingMode(uchar hint);
+
+/* enter programming mode and wait for the PROG_MODE_* result */
+uchar ispEnterProgrammingMode(uchar hint);
 
 /* read byte from eeprom at given address */
-uchar ispReadEEPROM(unsigned int address);
+uchar ispReadEEPROM(uint16_t address);
 
 /* write byte to flash at given address */
-uchar ispWriteFlash(unsigned long address, uchar data, uchar pollmode);
+uchar ispWriteFlash(uint32_t address, uchar data, uchar pollmode);
 
-uchar ispFlushPage(unsigned long address, uchar pollvalue);
+uchar ispFlushPage(uint32_t address, uchar pollvalue);
 
 /* read byte from flash at given address */
-uchar ispReadFlash(unsigned long address);
+uchar ispReadFlash(uint32_t address);
+
+/* write byte to eeprom at given address, skipequal - skip unchanged bytes */
+uchar ispWriteEEPROM(uint16_t address, uchar data, uchar skipequal);
+
+/* program pending eeprom page (parallel mode) */
+uchar ispFlushEEPROM(void);
+
+/* run the deferred part of a started operation (page commit, erase, fuse
+ * write, mode entry) when its time has come; returns 1 while the target is
+ * still busy */
+uchar ispPoll(void);
+
+/* poll until the pending operation is finished */
+void ispWait(void);
 
-/* write byte to eeprom at given address */
-uchar ispWriteEEPROM(unsigned int address, uchar data);
+/* 1 if an operation is pending */
+uchar ispBusy(void);
 
 /* pointer to sw or hw transmit function */
-uchar (*ispTransmit)(uchar);
+extern uchar (*ispTransmit)(uchar);
 
 /* set SCK speed. call before ispConnect! */
 void ispSetSCKOption(uchar sckoption);
@@ -128,4 +165,6 @@ void ispLoadExtendedAddressByte(unsigned long address);
 
 uchar serialWriteFlash(uint32_t address, uint8_t data, uint8_t pollmode);
 uchar parallelWriteFlash(uint32_t address, uint8_t data, uint8_t pollmode);
+uint8_t serialReadFlash(uint32_t address);
+uint8_t parallelReadFlash(uint32_t address);
 #endif /* __isp_h_included__ */
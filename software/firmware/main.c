@@ -17,10 +17,12 @@
  */
 
 #include <avr/io.h>
+#include <avr/eeprom.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <avr/wdt.h>
 #include <util/delay.h>
+#include <string.h>
 
 #include "usbasp.h"
 #include "usbdrv.h"
@@ -28,6 +30,11 @@
 #include "clock.h"
 #include "tpi.h"
 #include "tpi_defs.h"
+#include "prof.h"
+#include "trace.h"
+#include "store.h"
+#include "inject.h"
+#include "auto.h"
 
 // В начале main.c, после включения заголовочных файлов
 typedef struct {
@@ -38,7 +45,12 @@ typedef struct {
     unsigned int nbytes;
     unsigned int pagesize;
     uchar blockflags;
-    uchar pagecounter;
+    unsigned int pagecounter;   /* pages can be 256 bytes */
+    unsigned int flashpage;     /* pagesize of the last flash write */
+    unsigned int eepage;        /* and of the last eeprom write */
+    uchar held[8];      /* packet bytes waiting for the target to finish */
+    uchar heldlen;
+    uchar connected;    /* host has the target, no standalone runs */
 } ProgrammingState;
 
 static ProgrammingState prog = {
@@ -49,14 +61,26 @@ static ProgrammingState prog = {
     .nbytes = 0,
     .pagesize = 0,
     .blockflags = 0,
-    .pagecounter = 0
+    .pagecounter = 0,
+    .flashpage = 0,
+    .eepage = 0,
+    .heldlen = 0,
+    .connected = 0
 };
 
 // Обновляем extern объявления для isp.c
 extern unsigned int prog_pagesize;
 extern uchar prog_pagecounter;
 
-static uchar replyBuffer[8];
+static uchar replyBuffer[16];
+static uchar tpi_guardtime = TPIPCR_GT_128b;
+
+#if defined(USB_CFG_SERIAL_NUMBER_LEN) && USB_CFG_SERIAL_NUMBER_LEN != USBASP_SERIAL_LEN
+#error "USB_CFG_SERIAL_NUMBER_LEN must be USBASP_SERIAL_LEN"
+#endif
+
+/* string descriptor 3, served from RAM, see serialLoad() */
+int usbDescriptorStringSerialNumber[1 + USBASP_SERIAL_LEN];
 
 //static uchar prog_state = PROG_STATE_IDLE;
 //static uchar prog_sck = USBASP_ISP_SCK_AUTO;
@@ -68,8 +92,94 @@ static uchar replyBuffer[8];
 //static uchar prog_blockflags;
 //uchar prog_pagecounter;
 
+static void progSetState(uchar state) {
+    traceEvent(TRACE_STATE, prog.state, state, 0);
+    prog.state = state;
+}
+
+static uchar serialValid(const uchar *s) {
+    uchar i;
+
+    for (i = 0; i < USBASP_SERIAL_LEN; i++) {
+        if (s[i] <= ' ' || s[i] > '~')
+            return 0;
+    }
+    return 1;
+}
+
+static void serialSet(const uchar *s) {
+    uchar i;
+
+    usbDescriptorStringSerialNumber[0] = USB_STRING_DESCRIPTOR_HEADER(USBASP_SERIAL_LEN);
+    for (i = 0; i < USBASP_SERIAL_LEN; i++)
+        usbDescriptorStringSerialNumber[1 + i] = s[i];
+}
+
+/* Serial number from the programmer EEPROM, must be done before the host
+ * can enumerate us */
+static void serialLoad(void) {
+    uchar s[USBASP_SERIAL_LEN];
+
+    eeprom_read_block(s, (void *) EE_ADDR_SERIAL, USBASP_SERIAL_LEN);
+    if (!serialValid(s))
+        memset(s, '0', USBASP_SERIAL_LEN);
+    serialSet(s);
+}
+
+/* A field on a page the host left out as blank never passed progWrite():
+ * write what is missing of it over the erased page now and read it back,
+ * so the unit still gets its number and the counter moves on. */
+static void progInjectFill(uchar mem) {
+    uint32_t a, first, last;
+    unsigned int page = mem == INJECT_MEM_FLASH ? prog.flashpage : prog.eepage;
+    uchar b;
+
+    if (!injectMissing(mem, &first))
+        return;
+    /* flash takes whole words */
+    if (mem == INJECT_MEM_FLASH)
+        first &= ~1UL;
+    last = first;
+    while (injectMissing(mem, &a)) {
+        if (mem == INJECT_MEM_FLASH) {
+            a &= ~1UL;
+            ispWriteFlash(a, injectWrite(mem, a, 0xFF), !page);
+            a++;
+            b = injectWrite(mem, a, 0xFF);
+            ispWriteFlash(a, b, !page);
+        } else {
+            b = injectWrite(mem, a, 0xFF);
+            ispWriteEEPROM(a, b, 0);
+        }
+        last = a;
+        /* commit at the end of the target page and of the field */
+        if (page && injectMissing(mem, &a) && a / page == last / page)
+            continue;
+        if (mem == INJECT_MEM_FLASH) {
+            if (page)
+                ispFlushPage(last, b);
+        } else {
+            ispFlushEEPROM();
+        }
+    }
+    for (a = first; a <= last; a++)
+        injectRead(mem, a, mem == INJECT_MEM_FLASH ? ispReadFlash(a) :
+                                                     ispReadEEPROM(a));
+}
+
 uchar usbFunctionSetup(uchar data[8]) {
     uchar len = 0;
+    uchar i;
+    unsigned int tpi_dly;
+
+    traceEvent(TRACE_SETUP, data[1], data[2], data[3]);
+
+    /* a standalone run owns the target until it is done */
+    if (storeBusy() && data[1] != USBASP_FUNC_STORE_INFO &&
+        data[1] != USBASP_FUNC_STORE_WRITE && data[1] != USBASP_FUNC_STORE_RUN &&
+        data[1] != USBASP_FUNC_AUTO && data[1] != USBASP_FUNC_GETSERIAL &&
+        data[1] != USBASP_FUNC_GETCAPABILITIES)
+        return 0;
 
     if (data[1] == USBASP_FUNC_CONNECT) {
         /* set SCK speed */
@@ -82,19 +192,31 @@ uchar usbFunctionSetup(uchar data[8]) {
         /* set compatibility mode of address delivering */
         prog.address_newmode = 0;  // Используем структуру
 
+        prog.connected = 1;
+        injectReset();
         ledRedOn();
         ispConnect();
 
     } else if (data[1] == USBASP_FUNC_DISCONNECT) {
+        progInjectFill(INJECT_MEM_FLASH);
+        progInjectFill(INJECT_MEM_EEPROM);
         ispDisconnect();
+        prog.connected = 0;
         ledRedOff();
 
+    } else if (data[1] == USBASP_FUNC_TRANSMIT) {
+        replyBuffer[0] = data[2];
+        replyBuffer[1] = data[3];
+        replyBuffer[2] = data[4];
+        replyBuffer[3] = ispCommand(&data[2]);
+        len = 4;
+
     } else if (data[1] == USBASP_FUNC_READFLASH) {
         if (!prog.address_newmode)  // Используем структуру
             prog.address = (data[3] << 8) | data[2];  // Используем структуру
 
         prog.nbytes = (data[7] << 8) | data[6];  // Используем структуру
-        prog.state = PROG_STATE_READFLASH;  // Используем структуру
+        progSetState(PROG_STATE_READFLASH);
         len = 0xff;
 
     } else if (data[1] == USBASP_FUNC_READEEPROM) {
@@ -102,11 +224,16 @@ uchar usbFunctionSetup(uchar data[8]) {
             prog.address = (data[3] << 8) | data[2];  // Используем структуру
 
         prog.nbytes = (data[7] << 8) | data[6];  // Используем структуру
-        prog.state = PROG_STATE_READEEPROM;  // Используем структуру
+        progSetState(PROG_STATE_READEEPROM);
         len = 0xff;
 
     } else if (data[1] == USBASP_FUNC_ENABLEPROG) {
-        replyBuffer[0] = ispEnterProgrammingMode();
+        /* avrdude reads the result from this reply, so only a host that
+         * polls GETSTATUS gets it without waiting for the sequence */
+        ispStartProgrammingMode(data[2]);
+        if (!(data[4] & USBASP_PROGMODE_POLL))
+            ispWait();
+        replyBuffer[0] = prog_modestatus;
         len = 1;
 
     } else if (data[1] == USBASP_FUNC_WRITEFLASH) {
@@ -120,24 +247,32 @@ uchar usbFunctionSetup(uchar data[8]) {
         if (prog.blockflags & PROG_BLOCKFLAG_FIRST) {  // Используем структуру
             prog.pagecounter = prog.pagesize;  // Используем структуру
         }
+        prog.flashpage = prog.pagesize;
         
         prog.nbytes = (data[7] << 8) | data[6];  // Используем структуру
-        prog.state = PROG_STATE_WRITEFLASH;  // Используем структуру
+        progSetState(PROG_STATE_WRITEFLASH);
         len = 0xff;
 
     } else if (data[1] == USBASP_FUNC_WRITEEEPROM) {
         if (!prog.address_newmode)  // Используем структуру
             prog.address = (data[3] << 8) | data[2];  // Используем структуру
 
-        prog.pagesize = 0;  // Используем структуру
-        prog.blockflags = 0;  // Используем структуру
+        prog.pagesize = data[4];
+        prog.blockflags = data[5] & 0x0F;
+        prog.pagesize += (((unsigned int) data[5] & 0xF0) << 4);
+
+        if (prog.blockflags & PROG_BLOCKFLAG_FIRST) {
+            prog_skipcounter = 0;
+        }
+        prog.eepage = prog.pagesize;
+
         prog.nbytes = (data[7] << 8) | data[6];  // Используем структуру
-        prog.state = PROG_STATE_WRITEEEPROM;  // Используем структуру
+        progSetState(PROG_STATE_WRITEEEPROM);
         len = 0xff;
 
     } else if (data[1] == USBASP_FUNC_SETLONGADDRESS) {
         prog.address_newmode = 1;  // Используем структуру
-        prog.address = *((unsigned long*) &data[2]);  // Используем структуру
+        prog.address = *((uint32_t*) &data[2]);  // Используем структуру
 
     } else if (data[1] == USBASP_FUNC_SETISPSCK) {
         prog.sck_option = data[2];  // Используем структуру
@@ -145,14 +280,18 @@ uchar usbFunctionSetup(uchar data[8]) {
         len = 1;
 
     } else if (data[1] == USBASP_FUNC_TPI_CONNECT) {
-        tpi_dly_cnt = data[2] | (data[3] << 8);
+        /* avrdude sends the bit delay as 1.5 MHz / f */
+        tpi_dly = data[2] | (data[3] << 8);
+        tpi_set_clock(tpi_dly ? 1500000UL / tpi_dly : 0);
         ISP_OUT |= (1 << ISP_RST);
         ISP_DDR |= (1 << ISP_RST);
+        prog.connected = 1;
         clockWait(3);
         ISP_OUT &= ~(1 << ISP_RST);
         ledRedOn();
         clockWait(16);
         tpi_init();
+        tpi_guardtime = tpi_set_guard();
 
     } else if (data[1] == USBASP_FUNC_TPI_DISCONNECT) {
         tpi_send_byte(TPI_OP_SSTCS(TPISR));
@@ -164,24 +303,114 @@ uchar usbFunctionSetup(uchar data[8]) {
         clockWait(5);
         ISP_DDR &= ~((1 << ISP_RST) | (1 << ISP_SCK) | (1 << ISP_MOSI));
         ISP_OUT &= ~((1 << ISP_RST) | (1 << ISP_SCK) | (1 << ISP_MOSI));
+        prog.connected = 0;
         ledRedOff();
 
+    } else if (data[1] == USBASP_FUNC_TPI_RAWREAD) {
+        replyBuffer[0] = tpi_recv_byte();
+        len = 1;
+
+    } else if (data[1] == USBASP_FUNC_TPI_RAWWRITE) {
+        tpi_send_byte(data[2]);
+
+    } else if (data[1] == USBASP_FUNC_TPI_SETCLOCK) {
+        *((uint32_t*) &replyBuffer[0]) =
+            tpi_set_clock(*((uint32_t*) &data[2]));
+        len = 4;
+
+    } else if (data[1] == USBASP_FUNC_TPI_ERASE) {
+        replyBuffer[0] = tpi_erase(data[4] ? NVMCMD_SECTION_ERASE : NVMCMD_CHIP_ERASE,
+                                   (data[3] << 8) | data[2]);
+        if (replyBuffer[0])
+            traceEvent(TRACE_ERROR, TRACE_ERR_TPIERASE, 0, 0);
+        len = 1;
+
     } else if (data[1] == USBASP_FUNC_TPI_READBLOCK) {
         prog.address = (data[3] << 8) | data[2];  // Используем структуру
         prog.nbytes = (data[7] << 8) | data[6];  // Используем структуру
-        prog.state = PROG_STATE_TPI_READ;  // Используем структуру
+        progSetState(PROG_STATE_TPI_READ);
         len = 0xff;
 
     } else if (data[1] == USBASP_FUNC_TPI_WRITEBLOCK) {
         prog.address = (data[3] << 8) | data[2];  // Используем структуру
         prog.nbytes = (data[7] << 8) | data[6];  // Используем структуру
-        prog.state = PROG_STATE_TPI_WRITE;  // Используем структуру
+        progSetState(PROG_STATE_TPI_WRITE);
         len = 0xff;
 
+    } else if (data[1] == USBASP_FUNC_GETSTATUS) {
+        replyBuffer[0] = prog_skipcounter & 0xFF;
+        replyBuffer[1] = prog_skipcounter >> 8;
+        replyBuffer[2] = prog_fusestatus;
+        replyBuffer[3] = tpi_guardtime;
+        replyBuffer[4] = prog_modestatus;
+        len = 5;
+
+#if PROF_ENABLE
+    } else if (data[1] == USBASP_FUNC_PROFILE) {
+        if (data[2] == 0) {
+            usbMsgPtr = (usbMsgPtr_t) prof_counters;
+            return sizeof(prof_counters);
+        }
+        profReset();
+
+#endif
+    } else if (data[1] == USBASP_FUNC_GETIDENTITY) {
+        len = avr_getIdentity(replyBuffer);
+
+    } else if (data[1] == USBASP_FUNC_GETSERIAL) {
+        for (i = 0; i < USBASP_SERIAL_LEN; i++)
+            replyBuffer[i] = usbDescriptorStringSerialNumber[1 + i];
+        len = USBASP_SERIAL_LEN;
+
+    } else if (data[1] == USBASP_FUNC_SETSERIAL) {
+        progSetState(PROG_STATE_SETSERIAL);
+        len = 0xff;
+
+    } else if (data[1] == USBASP_FUNC_GETINJECT) {
+        len = injectGet(replyBuffer);
+
+    } else if (data[1] == USBASP_FUNC_SETINJECT) {
+        /* collected in replyBuffer, longer than one packet */
+        prog.address = 0;
+        prog.nbytes = (data[7] << 8) | data[6];
+        if (prog.nbytes == USBASP_INJECT_LEN)
+            progSetState(PROG_STATE_SETINJECT);
+        len = 0xff;
+
+    } else if (data[1] == USBASP_FUNC_STORE_INFO) {
+        len = storeInfo(replyBuffer);
+
+    } else if (data[1] == USBASP_FUNC_STORE_WRITE) {
+        prog.address = *((uint32_t*) &data[2]);
+        prog.nbytes = (data[7] << 8) | data[6];
+        /* anything else is stalled in usbFunctionWrite() */
+        if (!storeBusy() && storeChunkValid(prog.address, prog.nbytes))
+            progSetState(PROG_STATE_STORE);
+        len = 0xff;
+
+    } else if (data[1] == USBASP_FUNC_STORE_RUN) {
+        replyBuffer[0] = prog.connected ? STORE_RESULT_BUSY : storeStart();
+        len = 1;
+
+    } else if (data[1] == USBASP_FUNC_AUTO) {
+        /* no reply for a bad job or a DONE without a part waiting */
+        if ((data[2] == AUTO_ACTION_SET && !autoSet(data[3], data[4], data[5])) ||
+            (data[2] == AUTO_ACTION_DONE && !autoDone(data[3])) ||
+            data[2] > AUTO_ACTION_DONE)
+            return 0;
+        len = autoInfo(replyBuffer);
+
     } else if (data[1] == USBASP_FUNC_GETCAPABILITIES) {
         replyBuffer[0] = USBASP_CAP_0_TPI;
-        replyBuffer[1] = 0;
-        replyBuffer[2] = 0;
+        replyBuffer[1] = USBASP_CAP_1_SKIPEQUAL | USBASP_CAP_1_IDENTITY |
+                         USBASP_CAP_1_MODEHINT | USBASP_CAP_1_TPICLOCK |
+                         USBASP_CAP_1_TPIERASE | USBASP_CAP_1_SERIAL |
+                         USBASP_CAP_1_STORE;
+#if PROF_ENABLE
+        replyBuffer[1] |= USBASP_CAP_1_PROFILE;
+#endif
+        replyBuffer[2] = USBASP_CAP_2_INJECT | USBASP_CAP_2_AUTO |
+                         USBASP_CAP_2_MODEPOLL;
         replyBuffer[3] = 0;
         len = 4;
     }
@@ -197,6 +426,7 @@ uchar usbFunctionRead(uchar *data, uchar len) {
     if ((prog.state != PROG_STATE_READFLASH) && 
         (prog.state != PROG_STATE_READEEPROM) && 
         (prog.state != PROG_STATE_TPI_READ)) {
+        traceEvent(TRACE_ERROR, TRACE_ERR_STATE, prog.state, 0);
         return 0xff;
     }
 
@@ -210,44 +440,36 @@ uchar usbFunctionRead(uchar *data, uchar len) {
     /* fill packet ISP mode */
     for (i = 0; i < len; i++) {
         if (prog.state == PROG_STATE_READFLASH) {
-            data[i] = ispReadFlash(prog.address);
+            data[i] = injectRead(INJECT_MEM_FLASH, prog.address,
+                                 ispReadFlash(prog.address));
         } else {
-            data[i] = ispReadEEPROM(prog.address);
+            data[i] = injectRead(INJECT_MEM_EEPROM, prog.address,
+                                 ispReadEEPROM(prog.address));
         }
         prog.address++;
     }
 
     /* last packet? */
     if (len < 8) {
-        prog.state = PROG_STATE_IDLE;
+        progSetState(PROG_STATE_IDLE);
     }
 
     return len;
 }
 
-uchar usbFunctionWrite(uchar *data, uchar len) {
+/* Write packet bytes to the target. Stops when a page commit is started
+ * while more packets are to come: the rest of this packet is kept in
+ * prog.held and the host is NAKed until progTask() has finished it. */
+static uchar progWrite(uchar *data, uchar len) {
     uchar retVal = 0;
     uchar i;
 
-    /* check if programmer is in correct write state */
-    if ((prog.state != PROG_STATE_WRITEFLASH) && 
-        (prog.state != PROG_STATE_WRITEEEPROM) && 
-        (prog.state != PROG_STATE_TPI_WRITE)) {
-        return 0xff;
-    }
-
-    if (prog.state == PROG_STATE_TPI_WRITE) {
-        tpi_write_block(prog.address, data, len);
-        prog.address += len;
-        prog.nbytes -= len;
-        if(prog.nbytes <= 0) {
-            prog.state = PROG_STATE_IDLE;
-            return 1;
-        }
-        return 0;
-    }
-
     for (i = 0; i < len; i++) {
+        /* per-unit field, see inject.h */
+        data[i] = injectWrite(prog.state == PROG_STATE_WRITEFLASH ?
+                              INJECT_MEM_FLASH : INJECT_MEM_EEPROM,
+                              prog.address, data[i]);
+
         if (prog.state == PROG_STATE_WRITEFLASH) {
             /* Flash */
             if (prog.pagesize == 0) {
@@ -264,27 +486,124 @@ uchar usbFunctionWrite(uchar *data, uchar len) {
             }
         } else {
             /* EEPROM */
-            ispWriteEEPROM(prog.address, data[i]);
+            ispWriteEEPROM(prog.address, data[i],
+                           prog.blockflags & PROG_BLOCKFLAG_SKIPEQUAL);
+            if ((prog.pagesize == 0) || (prog.nbytes == 1) ||
+                (((prog.address + 1) & (prog.pagesize - 1)) == 0)) {
+                /* end of eeprom page or transfer, program it */
+                ispFlushEEPROM();
+            }
         }
 
         prog.nbytes--;
+        prog.address++;
 
         if (prog.nbytes == 0) {
-            prog.state = PROG_STATE_IDLE;
-            if ((prog.blockflags & PROG_BLOCKFLAG_LAST) && 
+            if ((prog.state == PROG_STATE_WRITEFLASH) &&
+                (prog.blockflags & PROG_BLOCKFLAG_LAST) && 
                 (prog.pagecounter != prog.pagesize)) {
                 /* last block and page flush pending, so flush it now */
-                ispFlushPage(prog.address, data[i]);
+                ispFlushPage(prog.address - 1, data[i]);
             }
+            progSetState(PROG_STATE_IDLE);
             retVal = 1;
+        } else if (ispBusy() && prog.nbytes > (uchar) (len - i - 1)) {
+            /* the final packet must be acknowledged from usbFunctionWrite,
+             * so only packets followed by more data are held back */
+            prog.heldlen = len - i - 1;
+            memcpy(prog.held, &data[i + 1], prog.heldlen);
+            usbDisableAllRequests();
+            break;
         }
-
-        prog.address++;
     }
 
     return retVal;
 }
 
+/* Cooperative part of the main loop: finish pending target operations,
+ * resume a held packet once the target is ready again, step the
+ * standalone run and the program-on-insert loop. */
+static void progTask(void) {
+    uchar buf[8];
+    uchar len;
+
+    if (ispPoll())
+        return;
+    if (storeButton() && !prog.connected && prog.state == PROG_STATE_IDLE)
+        storeStart();
+    storeTask();
+    autoTask(!prog.connected && prog.state == PROG_STATE_IDLE &&
+             !usbAllRequestsAreDisabled());
+    if (usbAllRequestsAreDisabled()) {
+        len = prog.heldlen;
+        prog.heldlen = 0;
+        memcpy(buf, prog.held, len);
+        progWrite(buf, len);
+        if (!prog.heldlen)
+            usbEnableAllRequests();
+    }
+}
+
+uchar usbFunctionWrite(uchar *data, uchar len) {
+
+    /* check if programmer is in correct write state */
+    if ((prog.state != PROG_STATE_WRITEFLASH) && 
+        (prog.state != PROG_STATE_WRITEEEPROM) && 
+        (prog.state != PROG_STATE_TPI_WRITE) &&
+        (prog.state != PROG_STATE_SETSERIAL) &&
+        (prog.state != PROG_STATE_STORE) &&
+        (prog.state != PROG_STATE_SETINJECT)) {
+        traceEvent(TRACE_ERROR, TRACE_ERR_STATE, prog.state, 0);
+        return 0xff;
+    }
+
+    if (prog.state == PROG_STATE_SETSERIAL) {
+        /* the whole serial number comes in one packet */
+        progSetState(PROG_STATE_IDLE);
+        if (len != USBASP_SERIAL_LEN || !serialValid(data))
+            return 0xff;
+        eeprom_update_block(data, (void *) EE_ADDR_SERIAL, USBASP_SERIAL_LEN);
+        serialSet(data);
+        return 1;
+    }
+
+    if (prog.state == PROG_STATE_SETINJECT) {
+        if (len > prog.nbytes)
+            len = prog.nbytes;
+        memcpy(&replyBuffer[prog.address], data, len);
+        prog.address += len;
+        prog.nbytes -= len;
+        if (prog.nbytes)
+            return 0;
+        progSetState(PROG_STATE_IDLE);
+        return injectSet(replyBuffer) ? 1 : 0xff;
+    }
+
+    if (prog.state == PROG_STATE_STORE) {
+        storeFill(prog.address, data, len);
+        prog.address += len;
+        prog.nbytes -= len;
+        if (prog.nbytes == 0) {
+            progSetState(PROG_STATE_IDLE);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (prog.state == PROG_STATE_TPI_WRITE) {
+        tpi_write_block(prog.address, data, len);
+        prog.address += len;
+        prog.nbytes -= len;
+        if(prog.nbytes <= 0) {
+            progSetState(PROG_STATE_IDLE);
+            return 1;
+        }
+        return 0;
+    }
+
+    return progWrite(data, len);
+}
+
 void hardwareInit(void) {
 
 	uchar i;
@@ -304,6 +623,9 @@ void hardwareInit(void) {
 
 	/* enable pull up on jumper */
 	SLOW_SCK_PORT |= (1 << SLOW_SCK_NUM);
+
+	/* and on the standalone run button */
+	STORE_BUTTON_PORT |= (1 << STORE_BUTTON_NUM);
 }
 
 void usbHadReset() {
@@ -315,6 +637,8 @@ void usbAddressAssigned() {
 }
 
 int main(void) {
+	serialLoad();
+	injectLoad();
 	usbInit();
 
 	/* init ports */
@@ -323,12 +647,19 @@ int main(void) {
 	/* init timer */
 	clockInit();
 
+	/* program-on-insert loop, needs the timer */
+	autoLoad();
+
+	/* UART event trace */
+	traceInit();
+
 	/* start interrupts for USB */
 	sei();
 
 	/* main loop */
 	for (;;) {
 		usbPoll();
+		progTask();
 	}
 
 	return 0;
@@ -0,0 +1,17 @@
+/*
+ * prof.c - part of USBasp
+ *
+ * Description....: Per-primitive profiling counters
+ * Licence........: GNU GPL v2 (see Readme.txt)
+ */
+
+#include <avr/io.h>
+#include <string.h>
+#include "prof.h"
+
+ProfCounter prof_counters[PROF_COUNT];
+
+void profReset(void)
+{
+    memset(prof_counters, 0, sizeof(prof_counters));
+}
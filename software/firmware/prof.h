@@ -0,0 +1,63 @@
+/*
+ * prof.h - per-primitive profiling counters
+ *
+ * Each counter holds the number of calls and the accumulated Timer1 ticks
+ * (F_CPU / 8) spent in them. Counters are inclusive: avr_loadComm time
+ * also shows up in puls_xt1. Read and reset with USBASP_FUNC_PROFILE.
+ * Build with PROF_ENABLE=0 to compile them out.
+ */
+
+#ifndef __prof_h_included__
+#define __prof_h_included__
+
+#ifndef PROF_ENABLE
+#define PROF_ENABLE         1
+#endif
+
+#define PROF_LOADCOMM       0   /* avr_loadComm */
+#define PROF_LOADADD        1   /* avr_loadAdd */
+#define PROF_PULSXT1        2   /* puls_xt1 */
+#define PROF_READBYTE       3   /* flash / eeprom byte read */
+#define PROF_PAGELOAD       4   /* flash byte into the page buffer */
+#define PROF_PAGECOMMIT     5   /* page programming, start to completion */
+#define PROF_BUSYWAIT       6   /* blocked waiting for the target */
+#define PROF_SERIAL         7   /* avr_serialExchange */
+#define PROF_TPISEND        8   /* tpi_send_byte */
+#define PROF_TPIRECV        9   /* tpi_recv_byte */
+#define PROF_COUNT          10
+
+#define PROF_ENTRY_SIZE     8   /* count, ticks: uint32_t LSB first */
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t count;
+    uint32_t ticks;
+} ProfCounter;
+
+extern ProfCounter prof_counters[PROF_COUNT];
+
+/* clear all counters */
+void profReset(void);
+
+#if PROF_ENABLE
+static inline void profAdd(uint8_t id, uint32_t ticks)
+{
+    prof_counters[id].count++;
+    prof_counters[id].ticks += ticks;
+}
+
+/* short sections (< one Timer1 wrap) */
+#define PROF_BEGIN()        uint16_t prof_t0 = TCNT1
+#define PROF_END(id)        profAdd(id, (uint16_t) (TCNT1 - prof_t0))
+#else
+#define profAdd(id, ticks)  ((void) (ticks))
+#define PROF_BEGIN()
+#define PROF_END(id)
+#endif
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* __prof_h_included__ */
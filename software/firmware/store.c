@@ -0,0 +1,347 @@
+/*
+ * store.c - part of USBasp
+ *
+ * Description....: Standalone image store in spare programmer flash
+ * Licence........: GNU GPL v2 (see Readme.txt)
+ */
+
+#include <avr/io.h>
+#include <avr/boot.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "usbasp.h"
+#include "isp.h"
+#include "clock.h"
+#include "trace.h"
+#include "store.h"
+#include "inject.h"
+
+#if STORE_START % SPM_PAGESIZE || STORE_END % SPM_PAGESIZE
+#error "STORE_START and STORE_END must be SPM page aligned"
+#endif
+
+/* header as laid out in usbasp.h; every field is naturally aligned, so
+ * the host builds of the firmware see the same layout */
+typedef struct {
+    uint16_t magic;
+    uint16_t crc;
+    uchar sig[3];
+    uchar mode;
+    uint32_t flashlen;
+    uint16_t pagesize;
+    uint16_t eelen;
+    uchar eepage;
+    uchar fusemask;
+    uchar fuses[4];
+} StoreHeader;
+
+/* fuse write commands in header order: lfuse, hfuse, efuse, lock */
+static const uchar store_fusecmd[4] = { 0xA0, 0xA8, 0xA4, 0xE0 };
+
+static StoreHeader store_hdr;
+static uchar store_step = STORE_STEP_IDLE;
+static uchar store_result = STORE_RESULT_NONE;
+static uint32_t store_pos;      /* byte within the current step */
+static uint16_t store_crc;
+static uchar store_fusewait;
+
+static uchar store_pending;     /* page write waiting for store_commit */
+static uint32_t store_page;
+static uint32_t store_commit;
+
+static uchar store_btn;         /* 0 released, 1 debouncing, 2 reported */
+static uint32_t store_btntime;
+
+/* SPM only works from the boot section. Interrupts stay off while the RWW
+ * section, interrupt vectors included, can't be read. */
+#define STORE_SPM   BOOTLOADER_SECTION __attribute__((noinline))
+
+STORE_SPM static void storeSpmFill(uint32_t addr, uint16_t word)
+{
+    uchar sreg = SREG;
+
+    cli();
+    boot_page_fill(addr, word);
+    SREG = sreg;
+}
+
+STORE_SPM static void storeSpmPage(uint32_t addr)
+{
+    uchar sreg = SREG;
+
+    cli();
+    eeprom_busy_wait();
+    boot_page_erase(addr);
+    boot_spm_busy_wait();
+    boot_page_write(addr);
+    boot_spm_busy_wait();
+    boot_rww_enable();
+    SREG = sreg;
+}
+
+static uchar storeByte(uint32_t offset)
+{
+#if FLASHEND > 0xFFFF
+    return pgm_read_byte_far(STORE_START + offset);
+#else
+    return pgm_read_byte((uint16_t) (STORE_START + offset));
+#endif
+}
+
+uchar storeChunkValid(uint32_t offset, uint16_t len)
+{
+    return len && len <= USBASP_STORE_CHUNK && !((offset | len) & 1) &&
+           offset < storeSize() && len <= storeSize() - offset &&
+           offset % SPM_PAGESIZE + len <= SPM_PAGESIZE;
+}
+
+void storeFill(uint32_t offset, const uchar *data, uchar len)
+{
+    uchar i;
+
+    for (i = 0; i + 1 < len; i += 2)
+        storeSpmFill(STORE_START + offset + i, data[i] | (data[i + 1] << 8));
+
+    /* the status stage has to go out before interrupts are turned off */
+    if ((offset + len) % SPM_PAGESIZE == 0) {
+        store_page = STORE_START + offset + len - SPM_PAGESIZE;
+        store_commit = clockDeadline(CLOCK_MS(2));
+        store_pending = 1;
+    }
+}
+
+uchar storeBusy(void)
+{
+    return store_step != STORE_STEP_IDLE || store_pending;
+}
+
+static void storeSetStep(uchar step, uint32_t pos)
+{
+    store_step = step;
+    store_pos = pos;
+}
+
+uchar storeStart(void)
+{
+    uchar *p = (uchar *) &store_hdr;
+    uchar i;
+
+    if (storeBusy() || ispBusy())
+        return STORE_RESULT_BUSY;
+    for (i = 0; i < sizeof(store_hdr); i++)
+        p[i] = storeByte(i);
+    if (store_hdr.magic != USBASP_STORE_MAGIC || !store_hdr.pagesize ||
+        (store_hdr.pagesize & (store_hdr.pagesize - 1)) ||
+        (store_hdr.eepage & (store_hdr.eepage - 1)) ||
+        store_hdr.flashlen > storeSize() - USBASP_STORE_HDR_LEN ||
+        store_hdr.eelen > storeSize() - USBASP_STORE_HDR_LEN - store_hdr.flashlen)
+        return STORE_RESULT_EMPTY;
+
+    /* both LEDs while running, one of them for the result */
+    ledRedOn();
+    ledGreenOn();
+    store_crc = 0xFFFF;
+    store_fusewait = 0;
+    injectReset();
+    storeSetStep(STORE_STEP_CHECK, 4);
+    return STORE_RESULT_OK;
+}
+
+static void storeFinish(uchar result)
+{
+    if (store_step > STORE_STEP_CHECK)
+        ispDisconnect();
+    if (result != STORE_RESULT_OK) {
+        traceEvent(TRACE_ERROR, TRACE_ERR_STORE, result, store_step);
+        ledGreenOff();
+    } else {
+        ledRedOff();
+    }
+    store_result = result;
+    storeSetStep(STORE_STEP_IDLE, 0);
+}
+
+/* 1 if the image bytes from..to are all 0xFF, nothing to program after
+ * the erase */
+static uchar storeBlank(uint32_t from, uint32_t to)
+{
+    for (; from < to; from++) {
+        if (storeByte(USBASP_STORE_HDR_LEN + from) != 0xFF)
+            return 0;
+    }
+    return 1;
+}
+
+void storeTask(void)
+{
+    uint32_t base = USBASP_STORE_HDR_LEN, end;
+    uchar i, b = 0xFF;
+
+    if (store_pending) {
+        if (clockExpired(store_commit)) {
+            storeSpmPage(store_page);
+            store_pending = 0;
+        }
+        return;
+    }
+
+    switch (store_step) {
+    case STORE_STEP_CHECK:
+        end = base + store_hdr.flashlen + store_hdr.eelen;
+        for (i = 0; i < 64 && store_pos < end; i++)
+            store_crc = _crc_xmodem_update(store_crc, storeByte(store_pos++));
+        if (store_pos < end)
+            break;
+        if (store_crc != store_hdr.crc) {
+            storeFinish(STORE_RESULT_CRC);
+            break;
+        }
+        storeSetStep(STORE_STEP_ENTER, 0);
+        break;
+
+    case STORE_STEP_ENTER:
+        /* ispPoll() runs the entry, storeTask() is back once it is done */
+        if (!store_pos) {
+            ispConnect();
+            ispStartProgrammingMode(store_hdr.mode);
+            store_pos = 1;
+            break;
+        }
+        if (prog_modestatus != PROG_MODE_OK) {
+            storeFinish(STORE_RESULT_TARGET);
+            break;
+        }
+        for (i = 0; i < 3; i++) {
+            if (avr_getId(i) != store_hdr.sig[i]) {
+                storeFinish(STORE_RESULT_SIGNATURE);
+                return;
+            }
+        }
+        avr_erase();
+        storeSetStep(STORE_STEP_ERASE, 0);
+        break;
+
+    case STORE_STEP_ERASE:
+        storeSetStep(STORE_STEP_FLASH, 0);
+        break;
+
+    case STORE_STEP_FLASH:
+        /* one target page per pass */
+        if (store_pos >= store_hdr.flashlen) {
+            storeSetStep(STORE_STEP_EEPROM, 0);
+            break;
+        }
+        end = store_pos + store_hdr.pagesize;
+        if (end > store_hdr.flashlen)
+            end = store_hdr.flashlen;
+        if (storeBlank(store_pos, end) &&
+            !injectCovers(INJECT_MEM_FLASH, store_pos, end)) {
+            store_pos = end;
+            break;
+        }
+        for (; store_pos < end; store_pos++) {
+            b = injectWrite(INJECT_MEM_FLASH, store_pos, storeByte(base + store_pos));
+            ispWriteFlash(store_pos, b, 0);
+        }
+        ispFlushPage(end - 1, b);
+        break;
+
+    case STORE_STEP_EEPROM:
+        /* one byte per pass, serial mode programs each on its own */
+        if (store_pos >= store_hdr.eelen) {
+            storeSetStep(STORE_STEP_VERIFYFLASH, 0);
+            break;
+        }
+        b = storeByte(base + store_hdr.flashlen + store_pos);
+        ispWriteEEPROM(store_pos, injectWrite(INJECT_MEM_EEPROM, store_pos, b), 1);
+        store_pos++;
+        if (!store_hdr.eepage || store_pos == store_hdr.eelen ||
+            !(store_pos & (store_hdr.eepage - 1)))
+            ispFlushEEPROM();
+        break;
+
+    case STORE_STEP_VERIFYFLASH:
+        for (i = 0; i < 32 && store_pos < store_hdr.flashlen; i++, store_pos++) {
+            b = injectRead(INJECT_MEM_FLASH, store_pos, ispReadFlash(store_pos));
+            if (b != storeByte(base + store_pos)) {
+                storeFinish(STORE_RESULT_VERIFY);
+                return;
+            }
+        }
+        if (store_pos >= store_hdr.flashlen)
+            storeSetStep(STORE_STEP_VERIFYEEPROM, 0);
+        break;
+
+    case STORE_STEP_VERIFYEEPROM:
+        base += store_hdr.flashlen;
+        for (i = 0; i < 32 && store_pos < store_hdr.eelen; i++, store_pos++) {
+            b = injectRead(INJECT_MEM_EEPROM, store_pos, ispReadEEPROM(store_pos));
+            if (b != storeByte(base + store_pos)) {
+                storeFinish(STORE_RESULT_VERIFY);
+                return;
+            }
+        }
+        if (store_pos >= store_hdr.eelen)
+            storeSetStep(STORE_STEP_FUSES, 0);
+        break;
+
+    case STORE_STEP_FUSES:
+        /* after verify: the lock bits would hide the memories */
+        if (store_fusewait) {
+            store_fusewait = 0;
+            if (prog_fusestatus != FUSE_WRITE_OK &&
+                prog_fusestatus != FUSE_WRITE_SKIPPED) {
+                storeFinish(STORE_RESULT_FUSE);
+                break;
+            }
+            store_pos++;
+        }
+        while (store_pos < 4 && !(store_hdr.fusemask & (1 << store_pos)))
+            store_pos++;
+        if (store_pos == 4) {
+            storeFinish(STORE_RESULT_OK);
+            break;
+        }
+        avrSetFuse(store_fusecmd[store_pos], store_hdr.fuses[store_pos]);
+        store_fusewait = 1;
+        break;
+    }
+}
+
+uchar storeButton(void)
+{
+    if (STORE_BUTTON_PIN & (1 << STORE_BUTTON_NUM)) {
+        store_btn = 0;
+        return 0;
+    }
+    if (store_btn == 0) {
+        store_btn = 1;
+        store_btntime = clockDeadline(CLOCK_MS(20));
+    } else if (store_btn == 1 && clockExpired(store_btntime)) {
+        store_btn = 2;
+        return 1;
+    }
+    return 0;
+}
+
+uchar storeResult(void)
+{
+    return store_result;
+}
+
+uchar storeInfo(uchar *buf)
+{
+    uint32_t size = storeSize();
+
+    buf[0] = size;
+    buf[1] = size >> 8;
+    buf[2] = size >> 16;
+    buf[3] = size >> 24;
+    buf[4] = SPM_PAGESIZE & 0xFF;
+    buf[5] = SPM_PAGESIZE >> 8;
+    buf[6] = store_step;
+    buf[7] = store_result;
+    return USBASP_STORE_INFO_LEN;
+}
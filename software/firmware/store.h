@@ -0,0 +1,66 @@
+/*
+ * store.h - standalone image store in the programmer's spare flash
+ *
+ * The firmware leaves most of a larger programmer's flash unused. The
+ * host uploads a target image there once (USBASP_FUNC_STORE_WRITE):
+ * header, flash image, EEPROM image, see usbasp.h for the layout. A press
+ * of the store button or USBASP_FUNC_STORE_RUN then erases, programs and
+ * verifies a new target from it, fuses last, without any USB data
+ * transfer. The run is stepped from the main loop like the deferred
+ * target operations, so USB stays responsive to USBASP_FUNC_STORE_INFO.
+ *
+ * Store pages are programmed with SPM by storeSpmPage() in the boot
+ * section (.bootloader, placed by the Makefile), with interrupts off for
+ * the ~8 ms the RWW section is busy. The host has to stay quiet on the
+ * bus for USBASP_STORE_PAGE_MS after every chunk that completes a page.
+ */
+
+#ifndef __store_h_included__
+#define __store_h_included__
+
+#include <stdint.h>
+
+#ifndef uchar
+#define	uchar	unsigned char
+#endif
+
+/* programmer flash for the store, byte addresses from the Makefile per
+ * TARGET; ATmega16 by default: after the firmware, up to the boot section */
+#ifndef STORE_START
+#define STORE_START         0x2000UL
+#endif
+#ifndef STORE_END
+#define STORE_END           0x3800UL
+#endif
+
+/* store size in bytes */
+#define storeSize()         ((uint32_t) (STORE_END - STORE_START))
+
+/* 1 if a chunk of len bytes can be written at offset: word aligned and
+ * inside one SPM page of the store */
+uchar storeChunkValid(uint32_t offset, uint16_t len);
+
+/* copy data into the SPM page buffer; a chunk ending on a page boundary
+ * has the page programmed ~2 ms later from storeTask() */
+void storeFill(uint32_t offset, const uchar *data, uchar len);
+
+/* start a standalone run, STORE_RESULT_OK if started */
+uchar storeStart(void);
+
+/* 1 while a run or a page write is pending */
+uchar storeBusy(void);
+
+/* 1 once per debounced press of the store button */
+uchar storeButton(void);
+
+/* next step of the run or the pending page write; call from the main loop
+ * while no target operation is pending */
+void storeTask(void);
+
+/* STORE_RESULT_* of the last run */
+uchar storeResult(void);
+
+/* USBASP_FUNC_STORE_INFO reply, returns its length */
+uchar storeInfo(uchar *buf);
+
+#endif /* __store_h_included__ */
@@ -9,7 +9,7 @@
 
 
 /* Globals */
-/** Number of iterations in tpi_delay loop */
+/** Half bit delay: 0 - none, else timer paced (loop count without timer) */
 extern uint16_t tpi_dly_cnt;
 
 
@@ -18,6 +18,24 @@ extern uint16_t tpi_dly_cnt;
  * TPI init
  */
 void tpi_init(void);
+/**
+ * Set TPI clock
+ * \param hz Requested clock, 0 - fastest possible
+ * \return Achieved clock in Hz (never above the requested one)
+ */
+uint32_t tpi_set_clock(uint32_t hz);
+/**
+ * Program the shortest TPIPCR guard time the target answers reliably with
+ * \return Guard time set (TPIPCR_GT_*)
+ */
+uint8_t tpi_set_guard(void);
+/**
+ * Chip or section erase, waits for NVMBSY to clear (NVM must be enabled)
+ * \param cmd NVMCMD_CHIP_ERASE or NVMCMD_SECTION_ERASE
+ * \param addr Any address inside the section to erase
+ * \return 0 - done, 1 - NVM still busy after TPI_ERASE_TIMEOUT_MS
+ */
+uint8_t tpi_erase(uint8_t cmd, uint16_t addr);
 /**
  * Send raw byte by TPI
  * \param b Byte to send
@@ -36,8 +54,8 @@ uint8_t tpi_recv_byte(void);
  */
 void tpi_read_block(uint16_t addr, uint8_t* dptr, uint8_t len);
 /**
- * Write block
- * \param addr Address to program
+ * Write block (flash words, odd length is padded with 0xFF)
+ * \param addr Address to program, even
  * \param sptr Pointer to source block
  * \param len Length of write
  */
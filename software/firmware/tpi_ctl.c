@@ -0,0 +1,118 @@
+/**
+ * \brief TPI clock, guard time and NVM helpers
+ * \file tpi_ctl.c
+ */
+#include <avr/io.h>
+#include "clock.h"
+#include "tpi.h"
+#include "tpi_defs.h"
+
+#ifdef TPI_TIMER_TIFR
+/* Timer2 prescalers, index + 1 is the CS value */
+#ifdef __AVR_ATmega128__
+static const uint16_t tpi_prescaler[] = { 1, 8, 64, 256, 1024 };
+#else
+static const uint16_t tpi_prescaler[] = { 1, 8, 32, 64, 128, 256, 1024 };
+#endif
+#define TPI_PRESCALERS (sizeof(tpi_prescaler) / sizeof(tpi_prescaler[0]))
+#endif
+
+uint32_t tpi_set_clock(uint32_t hz)
+{
+	uint32_t half;
+#ifdef TPI_TIMER_TIFR
+	uint16_t n;
+	uint8_t i;
+
+	TPI_TIMER_TCCRB = 0;
+#endif
+
+	/* free running: as fast as tpi.S can toggle the clock */
+	if (hz == 0 || hz >= F_CPU / TPI_FREE_BIT_CYCLES) {
+		tpi_dly_cnt = 0;
+		return F_CPU / TPI_FREE_BIT_CYCLES;
+	}
+
+	/* cycles per half bit, rounded up so we never run faster */
+	half = (F_CPU / 2 + hz - 1) / hz;
+	if (half < TPI_MIN_HALF_CYCLES)
+		half = TPI_MIN_HALF_CYCLES;
+
+#ifdef TPI_TIMER_TIFR
+	for (i = 0; i < TPI_PRESCALERS - 1; i++) {
+		if ((half + tpi_prescaler[i] - 1) / tpi_prescaler[i] <= 256)
+			break;
+	}
+	n = (half + tpi_prescaler[i] - 1) / tpi_prescaler[i];
+	if (n > 256)
+		n = 256;
+
+	TPI_TIMER_TCCRA = TPI_TIMER_CTC;
+	TPI_TIMER_OCR = n - 1;
+	TPI_TIMER_TCNT = 0;
+	TPI_TIMER_TIFR = (1 << TPI_TIMER_OCF);
+	TPI_TIMER_TCCRB = TPI_TIMER_CS(i + 1);
+	tpi_dly_cnt = 1;
+
+	return F_CPU / (2UL * tpi_prescaler[i] * n);
+#else
+	/* delay loop: 4 cycles per iteration on top of the free running bit */
+	half = (half - TPI_FREE_BIT_CYCLES / 2 + 3) / 4;
+	tpi_dly_cnt = (half > 0xFFFF) ? 0xFFFF : (half ? half : 1);
+
+	return F_CPU / (TPI_FREE_BIT_CYCLES + 8UL * tpi_dly_cnt);
+#endif
+}
+
+/* guard times to try, shortest first */
+static const uint8_t tpi_guard[] = {
+	TPIPCR_GT_0b, TPIPCR_GT_2b, TPIPCR_GT_4b, TPIPCR_GT_8b,
+	TPIPCR_GT_16b, TPIPCR_GT_32b, TPIPCR_GT_64b
+};
+
+uint8_t tpi_set_guard(void)
+{
+	uint8_t i, gt;
+
+	for (i = 0; i < sizeof(tpi_guard); i++) {
+		gt = tpi_guard[i];
+		tpi_send_byte(TPI_OP_SSTCS(TPIPCR));
+		tpi_send_byte(gt);
+		/* guard time must read back and the target must keep answering */
+		tpi_send_byte(TPI_OP_SLDCS(TPIPCR));
+		if ((tpi_recv_byte() & 0x07) != gt)
+			continue;
+		tpi_send_byte(TPI_OP_SLDCS(TPIIR));
+		if (tpi_recv_byte() == TPIIR_ID)
+			return gt;
+	}
+
+	/* fall back to the reset default */
+	tpi_send_byte(TPI_OP_SSTCS(TPIPCR));
+	tpi_send_byte(TPIPCR_GT_128b);
+	return TPIPCR_GT_128b;
+}
+
+uint8_t tpi_erase(uint8_t cmd, uint16_t addr)
+{
+	/* PR <= high byte of the word at addr */
+	addr |= 1;
+	tpi_send_byte(TPI_OP_SSTPR(0));
+	tpi_send_byte(addr & 0xFF);
+	tpi_send_byte(TPI_OP_SSTPR(1));
+	tpi_send_byte(addr >> 8);
+	tpi_send_byte(TPI_OP_SOUT(NVMCMD));
+	tpi_send_byte(cmd);
+	/* dummy write starts the erase */
+	tpi_send_byte(TPI_OP_SST);
+	tpi_send_byte(0xFF);
+
+	clockSetTimeout(TPI_ERASE_TIMEOUT_MS);
+	do {
+		tpi_send_byte(TPI_OP_SIN(NVMCSR));
+		if (!(tpi_recv_byte() & NVMCSR_BSY))
+			return 0;
+	} while (!clockTimedOut());
+
+	return 1;
+}
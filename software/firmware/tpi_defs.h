@@ -36,6 +36,9 @@
 #define TPIPCR_GT_2b   0x06
 #define TPIPCR_GT_0b   0x07
 
+// TPIIR value
+#define TPIIR_ID       0x80
+
 // TPISR bits
 #define TPISR_NVMEN    0x02
 
@@ -52,6 +55,35 @@
 #define NVMCMD_SECTION_ERASE 0x14
 #define NVMCMD_WORD_WRITE    0x1D
 
+/* NVM erase timeout, ms (datasheet: chip erase < 10 ms) */
+#define TPI_ERASE_TIMEOUT_MS 50
+
+/* TPI clock timer: Timer2 in CTC mode paces the half bits.
+ * Parts without Timer2 (ATmega8515) fall back to a delay loop. */
+#if defined(TCCR2B)
+#	define TPI_TIMER_TCCRA  TCCR2A
+#	define TPI_TIMER_TCCRB  TCCR2B
+#	define TPI_TIMER_CS(cs) (cs)
+#	define TPI_TIMER_OCR    OCR2A
+#	define TPI_TIMER_TCNT   TCNT2
+#	define TPI_TIMER_TIFR   TIFR2
+#	define TPI_TIMER_OCF    OCF2A
+#elif defined(TCCR2)
+#	define TPI_TIMER_TCCRA  TCCR2
+#	define TPI_TIMER_TCCRB  TCCR2
+#	define TPI_TIMER_CS(cs) ((1 << WGM21) | (cs))
+#	define TPI_TIMER_OCR    OCR2
+#	define TPI_TIMER_TCNT   TCNT2
+#	define TPI_TIMER_TIFR   TIFR
+#	define TPI_TIMER_OCF    OCF2
+#endif
+#define TPI_TIMER_CTC    (1 << WGM21)
+
+/* CPU cycles of tpi_bit() (from the instruction counts in tpi.S):
+ * a whole bit with no delay, and the shortest half bit the timer can pace */
+#define TPI_FREE_BIT_CYCLES   44
+#define TPI_MIN_HALF_CYCLES   36
+
 
 
 
@@ -0,0 +1,124 @@
+/*
+ * trace.c - part of USBasp
+ *
+ * Description....: Ring-buffered binary event trace on the UART
+ * Licence........: GNU GPL v2 (see Readme.txt)
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "clock.h"
+#include "trace.h"
+
+#if TRACE_ENABLE
+
+#if DEBUG_LEVEL > 0
+#error "trace and oddebug both use the UART, build with TRACE=0"
+#endif
+
+/* register names of parts with a numbered USART */
+#ifdef UDR0
+#define UDR         UDR0
+#define UBRRL       UBRR0L
+#define UBRRH       UBRR0H
+#define UCSRB       UCSR0B
+#define UCSRC       UCSR0C
+#define TXEN        TXEN0
+#define TXCIE       TXCIE0
+#define UCSZ0       UCSZ00
+#define TRACE_TX_vect   USART0_TX_vect
+#elif defined(USART_TXC_vect)
+#define TRACE_TX_vect   USART_TXC_vect
+#else
+#define TRACE_TX_vect   USART_TX_vect
+#endif
+
+#ifdef URSEL
+#define TRACE_UCSRC     ((1 << URSEL) | (3 << UCSZ0))
+#else
+#define TRACE_UCSRC     (3 << UCSZ0)
+#endif
+
+#define TRACE_UBRR      ((F_CPU + 8 * TRACE_BAUD) / (16 * TRACE_BAUD) - 1)
+
+static volatile uint8_t trace_buf[TRACE_BUF_SIZE];
+static volatile uint8_t trace_head;     /* written by traceEvent() */
+static volatile uint8_t trace_tail;     /* written by the TX interrupt */
+static volatile uint8_t trace_idle = 1;
+static uint8_t trace_dropped;
+
+void traceInit(void)
+{
+    UBRRH = TRACE_UBRR >> 8;
+    UBRRL = TRACE_UBRR & 0xFF;
+    UCSRC = TRACE_UCSRC;
+    UCSRB = (1 << TXEN) | (1 << TXCIE);
+}
+
+static uint8_t trace_put(uint8_t type, uint8_t a, uint8_t b, uint8_t c,
+                         uint32_t now)
+{
+    uint8_t h = trace_head;
+    volatile uint8_t *p;
+
+    if ((uint8_t) (h - trace_tail) > TRACE_BUF_SIZE - TRACE_REC_SIZE)
+        return 0;
+
+    p = &trace_buf[h & (TRACE_BUF_SIZE - 1)];
+    p[0] = type;
+    p[1] = a;
+    p[2] = b;
+    p[3] = c;
+    p[4] = now;
+    p[5] = now >> 8;
+    p[6] = now >> 16;
+    p[7] = now >> 24;
+    trace_head = h + TRACE_REC_SIZE;
+    return 1;
+}
+
+void traceEvent(uint8_t type, uint8_t a, uint8_t b, uint8_t c)
+{
+    uint32_t now = clockNow();
+    uint8_t sreg;
+
+    if (trace_dropped) {
+        if (!trace_put(TRACE_OVERFLOW, trace_dropped, 0, 0, now)) {
+            if (trace_dropped < 0xFF)
+                trace_dropped++;
+            return;
+        }
+        trace_dropped = 0;
+    }
+    if (!trace_put(type, a, b, c, now)) {
+        trace_dropped = 1;
+        return;
+    }
+
+    /* start the transmitter if the interrupt has run dry; callers may
+     * already run with interrupts off, so restore rather than sei() */
+    sreg = SREG;
+    cli();
+    if (trace_idle) {
+        trace_idle = 0;
+        UDR = trace_buf[trace_tail & (TRACE_BUF_SIZE - 1)];
+        trace_tail++;
+    }
+    SREG = sreg;
+}
+
+/* TX complete clears its own flag, so the USB interrupt can be enabled
+ * right away without this one firing again */
+ISR(TRACE_TX_vect, ISR_NOBLOCK)
+{
+    uint8_t t = trace_tail;
+
+    if (t != trace_head) {
+        UDR = trace_buf[t & (TRACE_BUF_SIZE - 1)];
+        trace_tail = t + 1;
+    } else {
+        trace_idle = 1;
+    }
+}
+
+#endif /* TRACE_ENABLE */
@@ -0,0 +1,62 @@
+/*
+ * trace.h - binary event trace on the UART header
+ *
+ * Records are queued in a ring buffer and sent by the TX complete
+ * interrupt, so tracing never waits for the UART. When the buffer is full
+ * records are dropped and counted, the count is sent as TRACE_OVERFLOW.
+ *
+ * Record (TRACE_REC_SIZE bytes): type, arg[3], Timer1 ticks (uint32_t,
+ * LSB first, F_CPU / 8).
+ *
+ *   TRACE_SETUP     bRequest, wValue lo, wValue hi
+ *   TRACE_STATE     old prog.state, new prog.state, 0
+ *   TRACE_COMMIT    page address bits 0..23 (PROG_STATE_WRITE* target)
+ *   TRACE_BUSY      blocking wait in ticks, bits 0..23 (saturated)
+ *   TRACE_ERROR     TRACE_ERR_*, detail, 0
+ *   TRACE_OVERFLOW  dropped records, 0, 0
+ *
+ * Build with TRACE=0 to compile it out.
+ */
+
+#ifndef __trace_h_included__
+#define __trace_h_included__
+
+#include <stdint.h>
+
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE        1
+#endif
+
+#ifndef TRACE_BAUD
+#define TRACE_BAUD          250000UL
+#endif
+
+#define TRACE_BUF_SIZE      128     /* power of 2, multiple of the record */
+#define TRACE_REC_SIZE      8
+
+#define TRACE_SETUP         1
+#define TRACE_STATE         2
+#define TRACE_COMMIT        3
+#define TRACE_BUSY          4
+#define TRACE_ERROR         5
+#define TRACE_OVERFLOW      6
+
+#define TRACE_ERR_PROGMODE  1   /* detail: PROG_MODE_ERR_* */
+#define TRACE_ERR_FUSE      2   /* detail: fuse index */
+#define TRACE_ERR_SERIALBSY 3   /* serial HV busy timeout, target reset */
+#define TRACE_ERR_STATE     4   /* data packet in wrong prog.state */
+#define TRACE_ERR_TPIERASE  5   /* TPI erase timeout */
+#define TRACE_ERR_STORE     6   /* detail: STORE_RESULT_*, STORE_STEP_* */
+
+#if TRACE_ENABLE
+/* set up the UART, call before sei() */
+void traceInit(void);
+
+/* queue a record, main context only */
+void traceEvent(uint8_t type, uint8_t a, uint8_t b, uint8_t c);
+#else
+#define traceInit()
+#define traceEvent(type, a, b, c)
+#endif
+
+#endif /* __trace_h_included__ */
@@ -19,10 +19,157 @@
 #define USBASP_FUNC_TPI_RAWWRITE     14
 #define USBASP_FUNC_TPI_READBLOCK    15
 #define USBASP_FUNC_TPI_WRITEBLOCK   16
+#define USBASP_FUNC_GETSTATUS        17
+#define USBASP_FUNC_GETIDENTITY      18
+#define USBASP_FUNC_TPI_SETCLOCK     19
+#define USBASP_FUNC_TPI_ERASE        20   /* data[2..3] address, data[4] 1 - section */
+#define USBASP_FUNC_PROFILE          21   /* data[2] 0 - read counters, 1 - reset */
+#define USBASP_FUNC_GETSERIAL        22
+#define USBASP_FUNC_SETSERIAL        23   /* USBASP_SERIAL_LEN bytes OUT */
+#define USBASP_FUNC_STORE_INFO       24
+#define USBASP_FUNC_STORE_WRITE      25   /* data[2..5] store offset, OUT */
+#define USBASP_FUNC_STORE_RUN        26   /* reply STORE_RESULT_* */
+#define USBASP_FUNC_GETINJECT        27   /* reply USBASP_INJECT_LEN bytes */
+#define USBASP_FUNC_SETINJECT        28   /* USBASP_INJECT_LEN bytes OUT */
+#define USBASP_FUNC_AUTO             29   /* data[2] AUTO_ACTION_*, reply USBASP_AUTO_INFO_LEN */
 #define USBASP_FUNC_GETCAPABILITIES 127
 
 /* USBASP capabilities */
 #define USBASP_CAP_0_TPI    0x01
+#define USBASP_CAP_1_SKIPEQUAL  0x01
+#define USBASP_CAP_1_IDENTITY   0x02
+#define USBASP_CAP_1_MODEHINT   0x04
+#define USBASP_CAP_1_TPICLOCK   0x08
+#define USBASP_CAP_1_TPIERASE   0x10
+#define USBASP_CAP_1_PROFILE    0x20
+#define USBASP_CAP_1_SERIAL     0x40
+#define USBASP_CAP_1_STORE      0x80
+#define USBASP_CAP_2_INJECT     0x01
+#define USBASP_CAP_2_AUTO       0x02
+#define USBASP_CAP_2_MODEPOLL   0x04
+
+/* USBASP_FUNC_PROFILE reply: PROF_COUNT entries of call count and Timer1
+ * ticks (F_CPU / 8), both uint32_t LSB first, in PROF_* order (prof.h) */
+
+/* USBASP_FUNC_GETSTATUS reply: skipped eeprom bytes (2, LSB first),
+ * last fuse write result (FUSE_WRITE_*), TPI guard time (TPIPCR_GT_*),
+ * last ENABLEPROG result (PROG_MODE_*) */
+
+/* USBASP_FUNC_GETIDENTITY reply: signature[3], lfuse, hfuse, efuse, lock,
+ * calibration[4] */
+#define USBASP_IDENTITY_LEN     11
+
+/* USBASP_FUNC_ENABLEPROG mode hint (data[2]) */
+#define USBASP_PROGMODE_AUTO      0   /* remembered mode first, then detect */
+#define USBASP_PROGMODE_FULLBUS   1
+#define USBASP_PROGMODE_SHORTBUS  2
+#define USBASP_PROGMODE_SERIAL    3
+
+/* USBASP_FUNC_ENABLEPROG flags (data[4]) */
+#define USBASP_PROGMODE_POLL      0x01  /* reply PROG_MODE_BUSY at once, the
+                                           result follows in GETSTATUS */
+
+/* avr_progMode() results, returned by USBASP_FUNC_ENABLEPROG */
+#define PROG_MODE_OK             0
+#define PROG_MODE_ERR_NOTARGET   1   /* only 0x00/0xFF on the bus in every mode */
+#define PROG_MODE_ERR_NOSIG      2   /* bus answers, but no Atmel signature */
+#define PROG_MODE_ERR_UNSTABLE   3   /* 0x1E seen, but not read back twice */
+#define PROG_MODE_ERR_HINT       4   /* unknown USBASP_PROGMODE_* hint */
+#define PROG_MODE_BUSY           5   /* still entering, poll GETSTATUS */
+
+/* avrSetFuse() results, USBASP_FUNC_GETSTATUS byte 2 */
+#define FUSE_WRITE_OK            0   /* programmed and verified */
+#define FUSE_WRITE_SKIPPED       1   /* already had the requested value */
+#define FUSE_WRITE_VERIFY        2   /* readback differs after programming */
+#define FUSE_WRITE_BUSY          3   /* still programming, poll again */
+
+/* programmer EEPROM layout */
+#define EE_ADDR_PROGMODE    0x00  /* magic, dev_type, signature[3] */
+#define EE_PROGMODE_LEN     5
+#define EE_PROGMODE_MAGIC   0xA5
+#define EE_ADDR_SERIAL      0x08  /* USBASP_SERIAL_LEN characters */
+#define EE_ADDR_INJECT      0x10  /* USBASP_INJECT_LEN bytes */
+#define EE_ADDR_AUTO        0x1C  /* AUTO_JOB_*, mode hint */
+
+/* USBASP_FUNC_STORE_INFO reply: store size (4, LSB first), SPM page size
+ * (2), STORE_STEP_* of the running job, STORE_RESULT_* of the last one */
+#define USBASP_STORE_INFO_LEN   8
+
+/* image store: header, flash image at USBASP_STORE_HDR_LEN, EEPROM image
+ * right after it. Header, multi-byte fields LSB first: magic[2], crc[2],
+ * signature[3], mode hint, flash length[4], flash page size[2], eeprom
+ * length[2], eeprom page size, fuse mask (bit n: fuse n is written),
+ * lfuse, hfuse, efuse, lock. crc is CRC-16/CCITT (0x1021, init 0xFFFF)
+ * over everything from the signature to the end of the EEPROM image. */
+#define USBASP_STORE_MAGIC      0x4853
+#define USBASP_STORE_HDR_LEN    32
+#define USBASP_STORE_CHUNK      128   /* max USBASP_FUNC_STORE_WRITE length */
+#define USBASP_STORE_PAGE_MS    20    /* no requests after a page completes */
+
+/* standalone run steps */
+#define STORE_STEP_IDLE          0
+#define STORE_STEP_CHECK         1   /* header and crc */
+#define STORE_STEP_ENTER         2   /* programming mode, signature */
+#define STORE_STEP_ERASE         3
+#define STORE_STEP_FLASH         4
+#define STORE_STEP_EEPROM        5
+#define STORE_STEP_VERIFYFLASH   6
+#define STORE_STEP_VERIFYEEPROM  7
+#define STORE_STEP_FUSES         8
+
+/* standalone run results */
+#define STORE_RESULT_OK          0   /* passed, or STORE_RUN: started */
+#define STORE_RESULT_NONE        1   /* no run since power up */
+#define STORE_RESULT_BUSY        2   /* running, page write or USB session */
+#define STORE_RESULT_EMPTY       3   /* no valid header */
+#define STORE_RESULT_CRC         4   /* image damaged */
+#define STORE_RESULT_TARGET      5   /* no programming mode */
+#define STORE_RESULT_SIGNATURE   6   /* a different part */
+#define STORE_RESULT_VERIFY      7   /* flash or eeprom readback differs */
+#define STORE_RESULT_FUSE        8   /* fuse write not verified */
+#define STORE_RESULT_HOST        9   /* auto mode: the host job failed */
+
+/* program-on-insert loop, USBASP_FUNC_AUTO: data[2] action; SET takes
+ * the job in data[3], the mode hint of the signature read in data[4]
+ * (not full bus, see auto.h) and 1 in data[5] to keep both in the
+ * programmer EEPROM for the next power-up; DONE
+ * ends a host job with its STORE_RESULT_* in data[3]. Reply: job, hint,
+ * AUTO_STATE_*, STORE_RESULT_* of the last board, boards done since the
+ * loop was set (2, LSB first) */
+#define USBASP_AUTO_INFO_LEN     6
+#define AUTO_ACTION_QUERY        0
+#define AUTO_ACTION_SET          1
+#define AUTO_ACTION_DONE         2
+#define AUTO_JOB_OFF             0
+#define AUTO_JOB_STORE           1   /* run the stored image */
+#define AUTO_JOB_HOST            2   /* hand the part to the host */
+#define AUTO_STATE_OFF           0
+#define AUTO_STATE_WAIT          1   /* probing for a part */
+#define AUTO_STATE_RUN           2   /* stored image running */
+#define AUTO_STATE_PRESENT       3   /* part waiting for the host job */
+#define AUTO_STATE_REMOVE        4   /* result on the LEDs, probing for removal */
+#define AUTO_PROBE_MS          500   /* from the end of one probe to the next */
+#define AUTO_MISSES              2   /* empty probes that mean removed */
+#define AUTO_BOOT_MS          1000   /* first probe if no host configures us */
+
+/* USB serial number (string descriptor 3): printable ASCII without
+ * spaces, "00000000" while the EEPROM holds none */
+#define USBASP_SERIAL_LEN   8
+
+/* per-unit field injected into flash or EEPROM writes, USBASP_FUNC_SET/
+ * GETINJECT and the programmer EEPROM: mem (INJECT_MEM_*), format
+ * (INJECT_FMT_*), width 1..8, 0, target address[4], counter[4], LSB
+ * first. The counter is written over the field, and counts up once the
+ * whole field has been read back */
+#define USBASP_INJECT_LEN   12
+#define INJECT_MEM_OFF      0
+#define INJECT_MEM_FLASH    1
+#define INJECT_MEM_EEPROM   2
+#define INJECT_FMT_LE       0   /* binary, LSB first, zero extended */
+#define INJECT_FMT_BE       1   /* binary, MSB first */
+#define INJECT_FMT_DEC      2   /* ASCII decimal, leading zeros */
+#define INJECT_FMT_HEX      3   /* ASCII hex, upper case, leading zeros */
+#define INJECT_WIDTH_MAX    8
 
 /* programming state */
 #define PROG_STATE_IDLE         0
@@ -32,10 +179,14 @@
 #define PROG_STATE_WRITEEEPROM  4
 #define PROG_STATE_TPI_READ     5
 #define PROG_STATE_TPI_WRITE    6
+#define PROG_STATE_SETSERIAL    7
+#define PROG_STATE_STORE        8
+#define PROG_STATE_SETINJECT    9
 
 /* Block mode flags */
 #define PROG_BLOCKFLAG_FIRST    1
 #define PROG_BLOCKFLAG_LAST     2
+#define PROG_BLOCKFLAG_SKIPEQUAL 4   /* eeprom: don't program unchanged bytes */
 
 /* ISP SCK speed identifiers */
 #define USBASP_ISP_SCK_AUTO   0
@@ -62,4 +213,9 @@
 #define SLOW_SCK_PIN  PINB
 #define SLOW_SCK_NUM  PB3
 
+/* standalone run button to ground, internal pull-up */
+#define STORE_BUTTON_PORT PORTB
+#define STORE_BUTTON_PIN  PINB
+#define STORE_BUTTON_NUM  PB2
+
 #endif /* USBASP_H_ */
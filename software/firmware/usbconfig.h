@@ -97,7 +97,7 @@ the newest features and options.
  * You must implement the function usbFunctionWriteOut() which receives all
  * interrupt/bulk data sent to endpoint 1.
  */
-#define USB_CFG_HAVE_FLOWCONTROL        0
+#define USB_CFG_HAVE_FLOWCONTROL        1
 /* Define this to 1 if you want flowcontrol over USB data. See the definition
  * of the macros usbDisableAllRequests() and usbEnableAllRequests() in
  * usbdrv.h.
@@ -152,7 +152,7 @@ extern void usbAddressAssigned();
  * the macros. See the file USBID-License.txt before you assign a name.
  */
 /*#define USB_CFG_SERIAL_NUMBER   'N', 'o', 'n', 'e' */
-/*#define USB_CFG_SERIAL_NUMBER_LEN   0 */
+#define USB_CFG_SERIAL_NUMBER_LEN   8   /* USBASP_SERIAL_LEN */
 /* Same as above for the serial number. If you don't want a serial number,
  * undefine the macros.
  * It may be useful to provide the serial number through other means than at
@@ -225,7 +225,9 @@ extern void usbAddressAssigned();
 #define USB_CFG_DESCR_PROPS_STRING_0                0
 #define USB_CFG_DESCR_PROPS_STRING_VENDOR           0
 #define USB_CFG_DESCR_PROPS_STRING_PRODUCT          0
-#define USB_CFG_DESCR_PROPS_STRING_SERIAL_NUMBER    0
+/* loaded from the programmer EEPROM at startup, see serialLoad() in main.c */
+#define USB_CFG_DESCR_PROPS_STRING_SERIAL_NUMBER    (USB_PROP_IS_RAM | \
+                                    USB_PROP_LENGTH(2 + 2 * USB_CFG_SERIAL_NUMBER_LEN))
 #define USB_CFG_DESCR_PROPS_HID                     0
 #define USB_CFG_DESCR_PROPS_HID_REPORT              0
 #define USB_CFG_DESCR_PROPS_UNKNOWN                 0
@@ -0,0 +1,168 @@
+/*
+ * hvstation.cpp - programs the same image with several programmers at once
+ *
+ *   hvstation [-P id|sim:part]... [-a] [-p part] [-m mode] [-u us] [-e]
+ *             [-C] [-V] -U mem:op:file[:fmt]...
+ *
+ * Every -P adds a programming head by serial number or bus path, -a adds
+ * all attached programmers. sim:<part> adds a simulated programmer with
+ * the model of that part and serial number SIM00001, SIM00002, ... Each
+ * head runs the job (-e, -U as in usbasphv, reads only for fuses to "-")
+ * in its own thread on one shared copy of the images; the table lists
+ * result and timings per head, the summary the wall time against the sum
+ * of the head times. Exit status 1 if any head failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_transport.h"
+#include "station.h"
+#include "usbasp.h"
+
+using namespace usbasp;
+
+static void usage()
+{
+    fprintf(stderr, "usage: hvstation [-P id|sim:part]... [-a] [-p part] "
+            "[-m mode] [-u us] [-e] [-C] [-V] -U mem:op:file[:fmt]...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> ids;
+    std::string partName, err;
+    Job job = Job();
+    int mode = -1;
+    unsigned packetUs = 0, sims = 0;
+    bool all = false;
+    int c;
+
+    job.verify = true;
+    while ((c = getopt(argc, argv, "P:ap:m:u:eCVU:")) != -1) {
+        switch (c) {
+        case 'P': ids.push_back(optarg); break;
+        case 'a': all = true; break;
+        case 'p': partName = optarg; break;
+        case 'm':
+            if (!strcmp(optarg, "auto")) mode = USBASP_PROGMODE_AUTO;
+            else if (!strcmp(optarg, "full")) mode = USBASP_PROGMODE_FULLBUS;
+            else if (!strcmp(optarg, "short")) mode = USBASP_PROGMODE_SHORTBUS;
+            else if (!strcmp(optarg, "serial")) mode = USBASP_PROGMODE_SERIAL;
+            else usage();
+            break;
+        case 'u': packetUs = strtoul(optarg, 0, 0); break;
+        case 'e': job.erase = true; break;
+        case 'C': job.classic = true; break;
+        case 'V': job.verify = false; break;
+        case 'U': {
+            Op op;
+            if (!parseOp(optarg, op))
+                usage();
+            /* every head would write the same file */
+            if (op.op == 'r' && !(op.immediate || op.file == "-")) {
+                fprintf(stderr, "%s: only fuses can be read, to -\n", optarg);
+                return 2;
+            }
+            if (op.op == 'r' && (op.mem == "flash" || op.mem == "eeprom"))
+                usage();
+            if (!loadOp(op, err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 1;
+            }
+            job.ops.push_back(op);
+            break;
+        }
+        default: usage();
+        }
+    }
+    if (optind != argc || (ids.empty() && !all))
+        usage();
+    if (!partName.empty() && !(job.expect = findPart(partName))) {
+        fprintf(stderr, "unknown part %s\n", partName.c_str());
+        return 2;
+    }
+    job.mode = mode >= 0 ? mode : job.expect ? job.expect->mode :
+               USBASP_PROGMODE_AUTO;
+
+    /* all transports before any thread: simulated ones fork */
+    Station station;
+    std::vector<SimTransport *> simHeads;
+    if (all)
+        for (const UsbDevice &d : listUsb())
+            ids.push_back(d.path);
+    for (const std::string &id : ids) {
+        if (id.compare(0, 4, "sim:") == 0) {
+            char serial[16];
+            snprintf(serial, sizeof(serial), "SIM%05u", ++sims);
+            std::unique_ptr<SimTransport> s =
+                SimTransport::open(id.substr(4), packetUs, err, serial);
+            if (!s) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 1;
+            }
+            simHeads.push_back(s.get());
+            station.add(std::move(s));
+        } else {
+            std::unique_ptr<Transport> t = openUsb(id, err);
+            if (!t) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 1;
+            }
+            station.add(std::move(t));
+        }
+    }
+    if (!station.size()) {
+        fprintf(stderr, "no programmers\n");
+        return 1;
+    }
+
+    std::vector<HeadResult> results = station.run(job);
+
+    /* model violations fail the head that caused them */
+    for (SimTransport *sim : simHeads) {
+        if (sim->finish())
+            continue;
+        for (HeadResult &r : results) {
+            if (r.head != sim->name())
+                continue;
+            r.ok = false;
+            r.error += (r.error.empty() ? "" : "; ") + std::to_string(
+                sim->violations().size()) + " simulation violations";
+            for (size_t i = 0; i < sim->violations().size() && i < 10; i++)
+                r.error += "\n  " + sim->violations()[i];
+        }
+    }
+
+    size_t failed = 0;
+    double headMs = 0;
+    printf("%-12s %-9s %-6s %5s %9s %9s %9s %9s %9s %9s\n", "head", "serial",
+           "part", "result", "open ms", "erase ms", "ops ms", "total ms",
+           "transfers", "bytes");
+    for (const HeadResult &r : results) {
+        double ops = 0;
+        for (double ms : r.opMs)
+            ops += ms;
+        printf("%-12s %-9s %-6s %5s %9.1f %9.1f %9.1f %9.1f %9llu %9llu\n",
+               r.head.c_str(), r.serial.empty() ? "-" : r.serial.c_str(),
+               r.part.empty() ? "-" : r.part.c_str(), r.ok ? "ok" : "FAIL",
+               r.openMs, r.eraseMs, ops, r.totalMs,
+               (unsigned long long) r.stats.transfers,
+               (unsigned long long) (r.stats.bytesOut + r.stats.bytesIn));
+        headMs += r.totalMs;
+        failed += !r.ok;
+    }
+    for (const HeadResult &r : results) {
+        if (!r.error.empty())
+            printf("%s: %s\n", r.head.c_str(), r.error.c_str());
+        if (!r.output.empty())
+            printf("%s: %s", r.head.c_str(), r.output.c_str());
+    }
+    printf("%zu heads, %zu passed, %zu failed; wall %.1f ms, head time %.1f ms "
+           "(%.1fx)\n", results.size(), results.size() - failed, failed,
+           station.wallMs(), headMs,
+           station.wallMs() > 0 ? headMs / station.wallMs() : 0);
+    return failed ? 1 : 0;
+}
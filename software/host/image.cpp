@@ -0,0 +1,221 @@
+/*
+ * image.cpp - memory mapped bin/hex images
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image.h"
+
+namespace usbasp {
+
+static bool hexName(const std::string &path)
+{
+    size_t dot = path.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+
+    for (char &c : ext)
+        c = tolower(c);
+    return ext == "hex" || ext == "ihx" || ext == "ihex";
+}
+
+static int hexByte(const char *p)
+{
+    int v = 0;
+
+    for (int i = 0; i < 2; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return -1;
+    }
+    return v;
+}
+
+Image::Image()
+    : map(0), mapLength(0), bytes(0), length(0)
+{
+}
+
+Image::~Image()
+{
+    close();
+}
+
+void Image::close()
+{
+    if (map)
+        munmap(map, mapLength);
+    map = 0;
+    mapLength = 0;
+    decoded.clear();
+    bytes = 0;
+    length = 0;
+}
+
+bool Image::open(const std::string &path, std::string &err)
+{
+    struct stat st;
+    int fd;
+
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        err = path + ": " + strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        map = 0;
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    mapLength = st.st_size;
+
+    const char *text = (const char *) map;
+    if (hexName(path) || text[0] == ':') {
+        bool ok = decodeHex(text, mapLength, err);
+        munmap(map, mapLength);
+        map = 0;
+        mapLength = 0;
+        if (!ok) {
+            err = path + ": " + err;
+            return false;
+        }
+        bytes = decoded.data();
+        length = decoded.size();
+    } else {
+        madvise(map, mapLength, MADV_SEQUENTIAL);
+        bytes = (const uint8_t *) map;
+        length = mapLength;
+    }
+    return true;
+}
+
+bool Image::decodeHex(const char *text, size_t len, std::string &err)
+{
+    uint32_t base = 0;
+    size_t pos = 0;
+    int line = 0;
+
+    while (pos < len) {
+        const char *p = text + pos;
+        const char *end = (const char *) memchr(p, '\n', len - pos);
+        size_t n = end ? (size_t) (end - p) : len - pos;
+
+        pos += n + 1;
+        line++;
+        while (n && (p[n - 1] == '\r' || p[n - 1] == ' '))
+            n--;
+        if (!n)
+            continue;
+        if (p[0] != ':' || n < 11 || (n - 1) % 2) {
+            err = "line " + std::to_string(line) + ": not Intel HEX";
+            return false;
+        }
+
+        uint8_t rec[262];
+        size_t m = (n - 1) / 2;
+        uint8_t sum = 0;
+        if (m > sizeof(rec)) {
+            err = "line " + std::to_string(line) + ": record too long";
+            return false;
+        }
+        for (size_t i = 0; i < m; i++) {
+            int b = hexByte(p + 1 + 2 * i);
+            if (b < 0) {
+                err = "line " + std::to_string(line) + ": bad hex digit";
+                return false;
+            }
+            rec[i] = b;
+            sum += b;
+        }
+        if (sum || rec[0] + 5u != m) {
+            err = "line " + std::to_string(line) + ": checksum or length";
+            return false;
+        }
+
+        uint32_t addr = (rec[1] << 8) | rec[2];
+        switch (rec[3]) {
+        case 0x00:
+            addr += base;
+            if (decoded.size() < addr + rec[0])
+                decoded.resize(addr + rec[0], 0xFF);
+            memcpy(&decoded[addr], rec + 4, rec[0]);
+            break;
+        case 0x01:
+            return true;
+        case 0x02:                      /* extended segment address */
+            base = ((rec[4] << 8) | rec[5]) << 4;
+            break;
+        case 0x04:                      /* extended linear address */
+            base = ((rec[4] << 8) | rec[5]) << 16;
+            break;
+        case 0x03:
+        case 0x05:                      /* start address, not needed */
+            break;
+        default:
+            err = "line " + std::to_string(line) + ": unknown record type";
+            return false;
+        }
+    }
+    return true;
+}
+
+static void hexRecord(FILE *f, uint8_t type, uint16_t addr,
+                      const uint8_t *data, uint8_t n)
+{
+    uint8_t sum = n + (addr >> 8) + addr + type;
+
+    fprintf(f, ":%02X%04X%02X", n, addr, type);
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "%02X", data[i]);
+        sum += data[i];
+    }
+    fprintf(f, "%02X\n", (uint8_t) -sum);
+}
+
+bool saveImage(const std::string &path, const uint8_t *data, size_t len,
+               std::string &err)
+{
+    FILE *f = fopen(path.c_str(), hexName(path) ? "w" : "wb");
+
+    if (!f) {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    if (hexName(path)) {
+        for (size_t a = 0; a < len; a += 16) {
+            if (a && !(a & 0xFFFF)) {
+                uint8_t hi[2] = { (uint8_t) (a >> 24), (uint8_t) (a >> 16) };
+                hexRecord(f, 0x04, 0, hi, 2);
+            }
+            hexRecord(f, 0x00, a & 0xFFFF, data + a,
+                      len - a < 16 ? len - a : 16);
+        }
+        hexRecord(f, 0x01, 0, 0, 0);
+    } else {
+        fwrite(data, 1, len, f);
+    }
+    if (fclose(f)) {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+}
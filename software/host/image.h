@@ -0,0 +1,50 @@
+/*
+ * image.h - memory images for flash and EEPROM
+ *
+ * Files are memory mapped. Raw binaries are used in place, Intel HEX is
+ * decoded once from the mapping into a buffer padded with 0xFF. Either
+ * way the bytes stay valid and unchanged while the Image lives, so one
+ * Image can be shared by several threads.
+ */
+
+#ifndef HOST_IMAGE_H
+#define HOST_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace usbasp {
+
+class Image {
+public:
+    Image();
+    ~Image();
+    Image(const Image &) = delete;
+    Image &operator=(const Image &) = delete;
+
+    /* .hex / .ihx / .ihex by name, or by a leading ':'; binary otherwise */
+    bool open(const std::string &path, std::string &err);
+    void close();
+
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    bool decodeHex(const char *text, size_t len, std::string &err);
+
+    void *map;
+    size_t mapLength;
+    std::vector<uint8_t> decoded;
+    const uint8_t *bytes;
+    size_t length;
+};
+
+/* .hex by name, binary otherwise */
+bool saveImage(const std::string &path, const uint8_t *data, size_t len,
+               std::string &err);
+
+}
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * ops.cpp - avrdude style -U memory operations
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "ops.h"
+#include "usbasp.h"
+
+namespace usbasp {
+
+static int fuseIndex(const std::string &mem)
+{
+    static const char *const names[] = { "lfuse", "hfuse", "efuse", "lock" };
+
+    for (int i = 0; i < 4; i++)
+        if (mem == names[i])
+            return i;
+    return -1;
+}
+
+static bool compare(const std::string &what, const uint8_t *want,
+                    const uint8_t *got, size_t len, std::string &err)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (want[i] != got[i]) {
+            char s[80];
+            snprintf(s, sizeof(s), " verify error at 0x%04zx: 0x%02x != 0x%02x",
+                     i, got[i], want[i]);
+            err = what + s;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseOp(const char *arg, Op &op)
+{
+    std::string s = arg;
+    size_t a = s.find(':'), b = a == std::string::npos ? a : s.find(':', a + 1);
+
+    if (b == std::string::npos || b != a + 2)
+        return false;
+    op.mem = s.substr(0, a);
+    op.op = s[a + 1];
+    op.file = s.substr(b + 1);
+    op.immediate = false;
+    op.value = 0;
+    /* a trailing :fmt */
+    size_t c = op.file.rfind(':');
+    if (c != std::string::npos && c > 0 && c + 2 == op.file.size()) {
+        op.immediate = op.file[c + 1] == 'm';
+        op.file.resize(c);
+    }
+    return (op.op == 'r' || op.op == 'w' || op.op == 'v') &&
+           (fuseIndex(op.mem) >= 0 || op.mem == "flash" || op.mem == "eeprom");
+}
+
+bool loadOp(Op &op, std::string &err)
+{
+    if (op.op == 'r')
+        return true;
+    if (fuseIndex(op.mem) >= 0 && op.immediate) {
+        char *end;
+        unsigned long v = strtoul(op.file.c_str(), &end, 0);
+        if (op.file.empty() || *end || v > 0xFF) {
+            err = op.file + ": fuse value must be one byte";
+            return false;
+        }
+        op.value = v;
+        return true;
+    }
+    op.image = std::make_shared<Image>();
+    if (!op.image->open(op.file, err))
+        return false;
+    if (fuseIndex(op.mem) >= 0) {
+        if (op.image->size() != 1) {
+            err = op.file + ": fuse file must hold one byte";
+            return false;
+        }
+        op.value = op.image->data()[0];
+    }
+    return true;
+}
+
+bool runOp(Programmer &prog, const Op &op, bool verify, std::string &out,
+           std::string &err)
+{
+    const PartInfo *part = prog.part();
+    int fuse = fuseIndex(op.mem);
+    bool flash = op.mem == "flash";
+
+    err.clear();
+    if (fuse >= 0) {
+        uint8_t value;
+        if (op.op == 'r') {
+            if (!prog.readFuse(fuse, value))
+                return false;
+            if (op.immediate || op.file == "-") {
+                char s[32];
+                snprintf(s, sizeof(s), "%s: 0x%02x\n", op.mem.c_str(), value);
+                out += s;
+                return true;
+            }
+            return saveImage(op.file, &value, 1, err);
+        }
+        if (op.op == 'w')
+            return prog.writeFuse(fuse, op.value);
+        if (!prog.readFuse(fuse, value))
+            return false;
+        return compare(op.mem, &op.value, &value, 1, err);
+    }
+
+    size_t size = flash ? part->flashSize : part->eeSize;
+    if (op.op == 'r') {
+        std::vector<uint8_t> buf(size);
+        bool ok = flash ? prog.readFlash(0, buf.data(), size)
+                        : prog.readEeprom(0, buf.data(), size);
+        return ok && saveImage(op.file, buf.data(), size, err);
+    }
+
+    const Image &img = *op.image;
+    if (op.op == 'w') {
+        bool ok = flash ? prog.writeFlash(img.data(), img.size())
+                        : prog.writeEeprom(img.data(), img.size());
+        if (!ok || !verify)
+            return ok;
+    } else if (img.size() > size) {
+        err = op.file + " larger than the " + op.mem;
+        return false;
+    }
+    std::vector<uint8_t> back(img.size());
+    if (!(flash ? prog.readFlash(0, back.data(), back.size())
+                : prog.readEeprom(0, back.data(), back.size())))
+        return false;
+    return compare(op.mem, img.data(), back.data(), back.size(), err);
+}
+
+static const char *const injectFormats[] = { "le", "be", "dec", "hex" };
+
+bool parseInject(const char *arg, InjectField &f)
+{
+    char mem[8], fmt[4];
+    long long address, counter;
+    unsigned long width;
+    char end;
+
+    f = InjectField();
+    if (!strcmp(arg, "off"))
+        return true;
+    if (sscanf(arg, "%7[a-z]:%lli:%lu:%3[a-z]:%lli%c", mem, &address, &width,
+               fmt, &counter, &end) != 5 || address < 0 || address > 0xFFFFFFFF ||
+        counter < 0 || counter > 0xFFFFFFFF)
+        return false;
+    if (!strcmp(mem, "flash"))
+        f.mem = INJECT_MEM_FLASH;
+    else if (!strcmp(mem, "eeprom"))
+        f.mem = INJECT_MEM_EEPROM;
+    else
+        return false;
+    for (f.format = 0; f.format < 4; f.format++)
+        if (!strcmp(fmt, injectFormats[f.format]))
+            break;
+    f.width = width;
+    f.address = address;
+    f.counter = counter;
+    return f.format < 4 && width >= 1 && width <= INJECT_WIDTH_MAX;
+}
+
+std::string injectDescription(const InjectField &f)
+{
+    char s[80];
+
+    if (f.mem == INJECT_MEM_OFF || f.format > INJECT_FMT_HEX)
+        return "off";
+    snprintf(s, sizeof(s), "%s 0x%04x, %u %s, next %lu",
+             f.mem == INJECT_MEM_FLASH ? "flash" : "eeprom",
+             (unsigned) f.address, f.width, injectFormats[f.format],
+             (unsigned long) f.counter);
+    return s;
+}
+
+static void put(std::vector<uint8_t> &buf, size_t at, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        buf[at + i] = value >> (8 * i);
+}
+
+bool buildStore(const PartInfo &part, uint8_t mode, const std::vector<Op> &ops,
+                std::vector<uint8_t> &out, std::string &err)
+{
+    const Image *flash = 0, *eeprom = 0;
+    uint8_t mask = 0, fuses[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+
+    for (const Op &op : ops) {
+        int fuse = fuseIndex(op.mem);
+        if (op.op != 'w') {
+            err = op.mem + ":" + op.op + ": only writes can be stored";
+            return false;
+        }
+        if (fuse >= 0) {
+            mask |= 1 << fuse;
+            fuses[fuse] = op.value;
+        } else if (op.mem == "flash") {
+            flash = op.image.get();
+        } else {
+            eeprom = op.image.get();
+        }
+    }
+    size_t flashLen = flash ? flash->size() : 0, eeLen = eeprom ? eeprom->size() : 0;
+    if (flashLen > part.flashSize || eeLen > part.eeSize) {
+        err = std::string("image larger than the ") + part.name +
+              (flashLen > part.flashSize ? " flash" : " eeprom");
+        return false;
+    }
+
+    out.assign(USBASP_STORE_HDR_LEN, 0);
+    put(out, 0, USBASP_STORE_MAGIC, 2);
+    memcpy(&out[4], part.sig, 3);
+    out[7] = mode;
+    put(out, 8, flashLen, 4);
+    put(out, 12, part.pageSize, 2);
+    put(out, 14, eeLen, 2);
+    out[16] = part.eePage;
+    out[17] = mask;
+    memcpy(&out[18], fuses, 4);
+    if (flash)
+        out.insert(out.end(), flash->data(), flash->data() + flashLen);
+    if (eeprom)
+        out.insert(out.end(), eeprom->data(), eeprom->data() + eeLen);
+
+    /* CRC-16/CCITT as _crc_xmodem_update() from 0xFFFF */
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 4; i < out.size(); i++) {
+        crc ^= out[i] << 8;
+        for (int b = 0; b < 8; b++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    put(out, 2, crc, 2);
+    return true;
+}
+
+}
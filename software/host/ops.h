@@ -0,0 +1,54 @@
+/*
+ * ops.h - avrdude style -U memory operations
+ *
+ * mem:op:file[:fmt] with mem flash, eeprom, lfuse, hfuse, efuse or lock
+ * and op r, w or v. fmt m takes a fuse value on the command line, files
+ * are Intel HEX by name or content and raw binary otherwise. The files
+ * of w and v operations are opened once by loadOp() and can then be run
+ * on several programmers at the same time.
+ */
+
+#ifndef HOST_OPS_H
+#define HOST_OPS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "image.h"
+#include "programmer.h"
+
+namespace usbasp {
+
+struct Op {
+    std::string mem, file;
+    char op;
+    bool immediate;
+    uint8_t value;                  /* fuse w/v */
+    std::shared_ptr<Image> image;   /* flash/eeprom w/v */
+};
+
+bool parseOp(const char *arg, Op &op);
+
+/* opens the file or parses the value of a w or v operation */
+bool loadOp(Op &op, std::string &err);
+
+/* Written memories are read back and compared if verify is set. Fuse
+ * reads to "-" are appended to out as "mem: 0xNN". */
+bool runOp(Programmer &prog, const Op &op, bool verify, std::string &out,
+           std::string &err);
+
+/* mem:address:width:format:counter with mem flash or eeprom and format
+ * le, be, dec or hex, or "off" */
+bool parseInject(const char *arg, InjectField &field);
+
+/* "eeprom 0x0010, 8 dec, next 00001000" */
+std::string injectDescription(const InjectField &field);
+
+/* image store contents (usbasp.h) for the loaded write operations of ops:
+ * flash, eeprom and fuses, lock last, for the part given */
+bool buildStore(const PartInfo &part, uint8_t mode, const std::vector<Op> &ops,
+                std::vector<uint8_t> &out, std::string &err);
+
+}
+
+#endif
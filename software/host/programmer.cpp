@@ -0,0 +1,547 @@
+/*
+ * programmer.cpp - USBasp HV programmer client
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include "programmer.h"
+#include "usbasp.h"
+
+namespace usbasp {
+
+/* avrdude's USBASP_READBLOCKSIZE / USBASP_WRITEBLOCKSIZE */
+static const unsigned BLOCKSIZE = 200;
+/* GETSTATUS polls while a fuse is being written */
+static const unsigned FUSE_POLLS = 50;
+/* GETSTATUS polls while ENABLEPROG is still entering, 5 ms apart */
+static const unsigned MODE_POLLS = 100;
+/* STORE_INFO polls while a standalone run is going, 20 ms apart */
+static const unsigned STORE_POLLS = 3000;
+
+static const PartInfo partTable[] = {
+    { "ATmega16", "m16", { 0x1E, 0x94, 0x03 }, 16384, 128, 512, 4, USBASP_PROGMODE_FULLBUS },
+    { "ATmega32", "m32", { 0x1E, 0x95, 0x02 }, 32768, 128, 1024, 4, USBASP_PROGMODE_FULLBUS },
+    { "ATmega644", "m644", { 0x1E, 0x96, 0x09 }, 65536, 256, 2048, 8, USBASP_PROGMODE_FULLBUS },
+    { "ATmega128", "m128", { 0x1E, 0x97, 0x02 }, 131072, 256, 4096, 8, USBASP_PROGMODE_FULLBUS },
+    { "ATmega2560", "m2560", { 0x1E, 0x98, 0x01 }, 262144, 256, 4096, 8, USBASP_PROGMODE_FULLBUS },
+    { "ATtiny2313", "t2313", { 0x1E, 0x91, 0x0A }, 2048, 32, 128, 4, USBASP_PROGMODE_SHORTBUS },
+    { "ATtiny13", "t13", { 0x1E, 0x90, 0x07 }, 1024, 32, 64, 4, USBASP_PROGMODE_SERIAL },
+    { "ATtiny25", "t25", { 0x1E, 0x91, 0x08 }, 2048, 32, 128, 4, USBASP_PROGMODE_SERIAL },
+    { "ATtiny45", "t45", { 0x1E, 0x92, 0x06 }, 4096, 64, 256, 4, USBASP_PROGMODE_SERIAL },
+    { "ATtiny85", "t85", { 0x1E, 0x93, 0x0B }, 8192, 64, 512, 4, USBASP_PROGMODE_SERIAL },
+};
+
+const PartInfo *findPart(const uint8_t sig[3])
+{
+    for (const PartInfo &p : partTable)
+        if (!memcmp(p.sig, sig, 3))
+            return &p;
+    return 0;
+}
+
+const PartInfo *findPart(const std::string &id)
+{
+    for (const PartInfo &p : partTable)
+        if (id == p.id)
+            return &p;
+    return 0;
+}
+
+static const char *progModeError(uint8_t r)
+{
+    switch (r) {
+    case PROG_MODE_ERR_NOTARGET: return "no target on the bus";
+    case PROG_MODE_ERR_NOSIG: return "no Atmel signature";
+    case PROG_MODE_ERR_UNSTABLE: return "signature not stable";
+    case PROG_MODE_ERR_HINT: return "mode hint not supported";
+    case PROG_MODE_BUSY: return "programming mode entry timed out";
+    }
+    return "programming mode not entered";
+}
+
+const char *storeResultName(uint8_t result)
+{
+    switch (result) {
+    case STORE_RESULT_OK: return "passed";
+    case STORE_RESULT_NONE: return "no run yet";
+    case STORE_RESULT_BUSY: return "programmer busy";
+    case STORE_RESULT_EMPTY: return "no image stored";
+    case STORE_RESULT_CRC: return "stored image damaged";
+    case STORE_RESULT_TARGET: return "no target";
+    case STORE_RESULT_SIGNATURE: return "wrong part";
+    case STORE_RESULT_VERIFY: return "verify failed";
+    case STORE_RESULT_FUSE: return "fuse write failed";
+    case STORE_RESULT_HOST: return "host job failed";
+    }
+    return "unknown result";
+}
+
+Programmer::Programmer(Transport &t)
+    : classic(false), skipBlank(true), tr(t), capsValid(false), erased(false),
+      connected(false), caps(), id(), info(0), field(), st(), done(0), total(0)
+{
+}
+
+bool Programmer::fail(const std::string &what)
+{
+    err = tr.name() + ": " + what;
+    return false;
+}
+
+int Programmer::control(bool in, uint8_t func, uint16_t value, uint16_t index,
+                        uint8_t *data, uint16_t length)
+{
+    int r = tr.control(in, func, value, index, data, length);
+
+    st.transfers++;
+    if (r > 0)
+        (in ? st.bytesIn : st.bytesOut) += r;
+    return r;
+}
+
+bool Programmer::transmit(uint8_t a, uint8_t b, uint8_t c, uint8_t d,
+                          uint8_t *reply)
+{
+    uint8_t buf[4];
+
+    if (control(true, USBASP_FUNC_TRANSMIT, a | (b << 8), c | (d << 8),
+                buf, 4) != 4)
+        return fail("TRANSMIT failed");
+    if (reply)
+        *reply = buf[3];
+    return true;
+}
+
+bool Programmer::identify()
+{
+    uint8_t buf[USBASP_IDENTITY_LEN];
+
+    if (fast() && (caps[1] & USBASP_CAP_1_IDENTITY)) {
+        if (control(true, USBASP_FUNC_GETIDENTITY, 0, 0, buf, sizeof(buf)) !=
+            (int) sizeof(buf))
+            return fail("GETIDENTITY failed");
+        memcpy(id.sig, buf, 3);
+        memcpy(id.fuse, buf + 3, 4);
+        memcpy(id.cal, buf + 7, 4);
+        return true;
+    }
+
+    /* the ISP instructions isp.c maps onto HV reads */
+    for (int i = 0; i < 3; i++)
+        if (!transmit(0x30, 0, i, 0, &id.sig[i]))
+            return false;
+    for (int i = 0; i < 4; i++)
+        if (!readFuse(i, id.fuse[i]))
+            return false;
+    for (int i = 0; i < 4; i++)
+        if (!transmit(0x38, 0, i, 0, &id.cal[i]))
+            return false;
+    return true;
+}
+
+void Programmer::probe()
+{
+    capsValid = control(true, USBASP_FUNC_GETCAPABILITIES, 0, 0, caps, 4) == 4;
+    if (!capsValid)
+        memset(caps, 0, sizeof(caps));
+    if (!(caps[2] & USBASP_CAP_2_INJECT) || !readInject(field))
+        field.mem = INJECT_MEM_OFF;
+}
+
+bool Programmer::open(uint8_t hint)
+{
+    uint8_t buf[5];
+    uint16_t flags = 0;
+
+    probe();
+
+    if (control(true, USBASP_FUNC_CONNECT, 0, 0, buf, 4) < 0)
+        return fail("CONNECT failed");
+    connected = true;
+
+    if (!fast() || !(caps[1] & USBASP_CAP_1_MODEHINT))
+        hint = USBASP_PROGMODE_AUTO;
+    if (fast() && (caps[2] & USBASP_CAP_2_MODEPOLL))
+        flags = USBASP_PROGMODE_POLL;
+    if (control(true, USBASP_FUNC_ENABLEPROG, hint, flags, buf, 1) != 1)
+        return fail("ENABLEPROG failed");
+    /* the firmware keeps serving USB while it tries the modes */
+    for (unsigned i = 0; i < MODE_POLLS && buf[0] == PROG_MODE_BUSY; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (control(true, USBASP_FUNC_GETSTATUS, 0, 0, buf, 5) != 5)
+            return fail("GETSTATUS failed");
+        buf[0] = buf[4];
+    }
+    if (buf[0] != PROG_MODE_OK)
+        return fail(progModeError(buf[0]));
+
+    if (!identify())
+        return false;
+    info = findPart(id.sig);
+    if (!info) {
+        char s[64];
+        snprintf(s, sizeof(s), "unknown signature %02X %02X %02X",
+                 id.sig[0], id.sig[1], id.sig[2]);
+        return fail(s);
+    }
+    erased = false;
+    return true;
+}
+
+void Programmer::close()
+{
+    uint8_t buf[4];
+
+    if (connected)
+        control(true, USBASP_FUNC_DISCONNECT, 0, 0, buf, 4);
+    connected = false;
+}
+
+bool Programmer::chipErase()
+{
+    /* the firmware waits for the erase before the next request */
+    if (!transmit(0xAC, 0x80, 0, 0) || !transmit(0x30, 0, 0, 0))
+        return false;
+    erased = true;
+    return true;
+}
+
+bool Programmer::setAddress(uint32_t addr)
+{
+    return control(false, USBASP_FUNC_SETLONGADDRESS, addr & 0xFFFF,
+                   addr >> 16, 0, 0) >= 0 || fail("SETLONGADDRESS failed");
+}
+
+bool Programmer::readMemory(uint8_t func, uint32_t addr, uint8_t *out, size_t len)
+{
+    if (!setAddress(addr))
+        return false;
+    for (size_t off = 0; off < len; off += BLOCKSIZE) {
+        uint16_t n = std::min<size_t>(BLOCKSIZE, len - off);
+        /* the address keeps counting after SETLONGADDRESS */
+        if (control(true, func, (addr + off) & 0xFFFF, 0, out + off, n) != n)
+            return fail("read failed at 0x" + std::to_string(addr + off));
+        done += n;
+        if (progress)
+            progress(done, total);
+    }
+    return true;
+}
+
+/* one contiguous run of whole pages, first and last block flagged */
+bool Programmer::writeRun(uint8_t func, uint32_t addr, const uint8_t *data,
+                          size_t len, uint16_t pageSize, uint8_t extraFlags)
+{
+    if (!setAddress(addr))
+        return false;
+    for (size_t off = 0; off < len; off += BLOCKSIZE) {
+        uint16_t n = std::min<size_t>(BLOCKSIZE, len - off);
+        uint8_t flags = extraFlags;
+        if (off == 0)
+            flags |= PROG_BLOCKFLAG_FIRST;
+        if (off + n == len)
+            flags |= PROG_BLOCKFLAG_LAST;
+        uint16_t index = (pageSize & 0xFF) | (flags << 8) |
+                         ((pageSize & 0xF00) << 4);
+        if (control(false, func, (addr + off) & 0xFFFF, index,
+                    (uint8_t *) data + off, n) != n)
+            return fail("write failed at 0x" + std::to_string(addr + off));
+        done += n;
+        if (progress)
+            progress(done, total);
+    }
+    return true;
+}
+
+bool Programmer::writeFlash(const uint8_t *data, size_t len)
+{
+    unsigned page = info->pageSize;
+
+    if (len > info->flashSize)
+        return fail("image larger than the flash");
+    done = 0;
+    total = len;
+    size_t runStart = 0;
+    for (size_t a = 0; a < len; a += page) {
+        size_t n = std::min<size_t>(page, len - a);
+        bool blank = erased && skipBlank &&
+                     std::all_of(data + a, data + a + n,
+                                 [](uint8_t b) { return b == 0xFF; }) &&
+                     !(fast() && field.mem == INJECT_MEM_FLASH &&
+                       field.address < a + n && a < field.address + field.width);
+        if (blank) {
+            if (a > runStart &&
+                !writeRun(USBASP_FUNC_WRITEFLASH, runStart, data + runStart,
+                          a - runStart, page, 0))
+                return false;
+            runStart = a + n;
+            st.pagesSkipped++;
+            done += n;
+        }
+    }
+    if (len > runStart &&
+        !writeRun(USBASP_FUNC_WRITEFLASH, runStart, data + runStart,
+                  len - runStart, page, 0))
+        return false;
+    /* a following read waits for the last page commit */
+    return true;
+}
+
+bool Programmer::readFlash(uint32_t addr, uint8_t *out, size_t len)
+{
+    done = 0;
+    total = len;
+    return readMemory(USBASP_FUNC_READFLASH, addr, out, len);
+}
+
+bool Programmer::writeEeprom(const uint8_t *data, size_t len)
+{
+    uint8_t flags = fast() && (caps[1] & USBASP_CAP_1_SKIPEQUAL) ?
+                    PROG_BLOCKFLAG_SKIPEQUAL : 0;
+
+    if (len > info->eeSize)
+        return fail("image larger than the EEPROM");
+    done = 0;
+    total = len;
+    return writeRun(USBASP_FUNC_WRITEEEPROM, 0, data, len, info->eePage, flags);
+}
+
+bool Programmer::readEeprom(uint32_t addr, uint8_t *out, size_t len)
+{
+    done = 0;
+    total = len;
+    return readMemory(USBASP_FUNC_READEEPROM, addr, out, len);
+}
+
+bool Programmer::readSerial(std::string &serial)
+{
+    char buf[USBASP_SERIAL_LEN];
+
+    if (!capsValid || !(caps[1] & USBASP_CAP_1_SERIAL))
+        return fail("firmware has no serial number");
+    if (control(true, USBASP_FUNC_GETSERIAL, 0, 0, (uint8_t *) buf,
+                sizeof(buf)) != (int) sizeof(buf))
+        return fail("GETSERIAL failed");
+    serial.assign(buf, sizeof(buf));
+    return true;
+}
+
+bool Programmer::writeSerial(const std::string &serial)
+{
+    if (!capsValid || !(caps[1] & USBASP_CAP_1_SERIAL))
+        return fail("firmware has no serial number");
+    if (serial.size() != USBASP_SERIAL_LEN ||
+        !std::all_of(serial.begin(), serial.end(),
+                     [](char c) { return c > ' ' && c <= '~'; }))
+        return fail("serial number must be " +
+                    std::to_string(USBASP_SERIAL_LEN) +
+                    " printable characters without spaces");
+    if (control(false, USBASP_FUNC_SETSERIAL, 0, 0, (uint8_t *) serial.data(),
+                serial.size()) != (int) serial.size())
+        return fail("SETSERIAL failed");
+    return true;
+}
+
+bool Programmer::storeInfo(StoreInfo &info)
+{
+    uint8_t buf[USBASP_STORE_INFO_LEN];
+
+    if (!capsValid || !(caps[1] & USBASP_CAP_1_STORE))
+        return fail("firmware has no image store");
+    if (control(true, USBASP_FUNC_STORE_INFO, 0, 0, buf, sizeof(buf)) !=
+        (int) sizeof(buf))
+        return fail("STORE_INFO failed");
+    info.size = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+    info.pageSize = buf[4] | (buf[5] << 8);
+    info.step = buf[6];
+    info.result = buf[7];
+    return true;
+}
+
+bool Programmer::storeUpload(const std::vector<uint8_t> &image)
+{
+    StoreInfo info;
+
+    if (!storeInfo(info))
+        return false;
+    if (image.size() > info.size)
+        return fail("image needs " + std::to_string(image.size()) +
+                    " bytes, the store holds " + std::to_string(info.size));
+    if (!info.pageSize || info.pageSize % 2)
+        return fail("bad store page size");
+
+    /* whole pages, a chunk never crosses one */
+    std::vector<uint8_t> padded(image);
+    padded.resize((image.size() + info.pageSize - 1) / info.pageSize *
+                  info.pageSize, 0xFF);
+    uint16_t chunk = std::min<uint16_t>(info.pageSize, USBASP_STORE_CHUNK);
+    done = 0;
+    total = padded.size();
+    for (uint32_t off = 0, n; off < padded.size(); off += n) {
+        n = std::min<uint32_t>(chunk, info.pageSize - off % info.pageSize);
+        if (control(false, USBASP_FUNC_STORE_WRITE, off & 0xFFFF, off >> 16,
+                    &padded[off], n) != (int) n)
+            return fail("STORE_WRITE failed");
+        /* the firmware programs the page with interrupts off */
+        if ((off + n) % info.pageSize == 0)
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(USBASP_STORE_PAGE_MS));
+        done += n;
+        if (progress)
+            progress(done, total);
+    }
+    return true;
+}
+
+bool Programmer::storeRun(uint8_t &result)
+{
+    StoreInfo info;
+    uint8_t r;
+
+    if (!storeInfo(info))
+        return false;
+    if (control(true, USBASP_FUNC_STORE_RUN, 0, 0, &r, 1) != 1)
+        return fail("STORE_RUN failed");
+    if (r != STORE_RESULT_OK)
+        return fail(std::string("standalone run not started: ") +
+                    storeResultName(r));
+    for (unsigned i = 0; i < STORE_POLLS; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        if (!storeInfo(info))
+            return false;
+        if (info.step == STORE_STEP_IDLE) {
+            result = info.result;
+            return true;
+        }
+    }
+    return fail("standalone run did not finish");
+}
+
+bool Programmer::readInject(InjectField &f)
+{
+    uint8_t buf[USBASP_INJECT_LEN];
+
+    if (!capsValid || !(caps[2] & USBASP_CAP_2_INJECT))
+        return fail("firmware has no serial number injection");
+    if (control(true, USBASP_FUNC_GETINJECT, 0, 0, buf, sizeof(buf)) !=
+        (int) sizeof(buf))
+        return fail("GETINJECT failed");
+    f.mem = buf[0];
+    f.format = buf[1];
+    f.width = buf[2];
+    f.address = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t) buf[7] << 24);
+    f.counter = buf[8] | (buf[9] << 8) | (buf[10] << 16) | ((uint32_t) buf[11] << 24);
+    return true;
+}
+
+bool Programmer::writeInject(const InjectField &f)
+{
+    uint8_t buf[USBASP_INJECT_LEN] = {
+        f.mem, f.format, f.width, 0,
+        (uint8_t) f.address, (uint8_t) (f.address >> 8),
+        (uint8_t) (f.address >> 16), (uint8_t) (f.address >> 24),
+        (uint8_t) f.counter, (uint8_t) (f.counter >> 8),
+        (uint8_t) (f.counter >> 16), (uint8_t) (f.counter >> 24)
+    };
+
+    if (!capsValid || !(caps[2] & USBASP_CAP_2_INJECT))
+        return fail("firmware has no serial number injection");
+    if (control(false, USBASP_FUNC_SETINJECT, 0, 0, buf, sizeof(buf)) !=
+        (int) sizeof(buf))
+        return fail("SETINJECT failed (bad field?)");
+    field = f;
+    return true;
+}
+
+/* one USBASP_FUNC_AUTO request, the reply into info */
+static bool autoReply(const uint8_t *buf, AutoInfo &info)
+{
+    info.job = buf[0];
+    info.hint = buf[1];
+    info.state = buf[2];
+    info.result = buf[3];
+    info.boards = buf[4] | (buf[5] << 8);
+    return true;
+}
+
+bool Programmer::autoInfo(AutoInfo &info)
+{
+    uint8_t buf[USBASP_AUTO_INFO_LEN];
+
+    if (!capsValid || !(caps[2] & USBASP_CAP_2_AUTO))
+        return fail("firmware has no program-on-insert loop");
+    if (control(true, USBASP_FUNC_AUTO, AUTO_ACTION_QUERY, 0, buf,
+                sizeof(buf)) != (int) sizeof(buf))
+        return fail("AUTO query failed");
+    return autoReply(buf, info);
+}
+
+bool Programmer::autoSet(uint8_t job, uint8_t hint, bool save, AutoInfo &info)
+{
+    uint8_t buf[USBASP_AUTO_INFO_LEN];
+
+    if (!capsValid || !(caps[2] & USBASP_CAP_2_AUTO))
+        return fail("firmware has no program-on-insert loop");
+    if (job != AUTO_JOB_OFF && hint == USBASP_PROGMODE_FULLBUS)
+        return fail("program-on-insert needs a VDD-switched part, the "
+                    "adapter powers full bus parts directly");
+    if (control(true, USBASP_FUNC_AUTO, AUTO_ACTION_SET | (job << 8),
+                hint | (save << 8), buf, sizeof(buf)) != (int) sizeof(buf))
+        return fail("AUTO set failed");
+    return autoReply(buf, info);
+}
+
+bool Programmer::autoDone(uint8_t result, AutoInfo &info)
+{
+    uint8_t buf[USBASP_AUTO_INFO_LEN];
+
+    if (!capsValid || !(caps[2] & USBASP_CAP_2_AUTO))
+        return fail("firmware has no program-on-insert loop");
+    if (control(true, USBASP_FUNC_AUTO, AUTO_ACTION_DONE | (result << 8), 0,
+                buf, sizeof(buf)) != (int) sizeof(buf))
+        return fail("AUTO done failed (no part waiting?)");
+    return autoReply(buf, info);
+}
+
+bool Programmer::readFuse(int which, uint8_t &value)
+{
+    static const uint8_t cmd[4][2] = {
+        { 0x50, 0x00 }, { 0x58, 0x08 }, { 0x50, 0x08 }, { 0x58, 0x00 }
+    };
+
+    return transmit(cmd[which][0], cmd[which][1], 0, 0, &value);
+}
+
+bool Programmer::writeFuse(int which, uint8_t value)
+{
+    static const uint8_t cmd[4] = { 0xA0, 0xA8, 0xA4, 0xE0 };
+    uint8_t back, status[4];
+
+    if (!transmit(0xAC, cmd[which], 0, value))
+        return false;
+    if (fast()) {
+        /* isp.c reports the write and its verify in GETSTATUS */
+        for (unsigned i = 0; i < FUSE_POLLS; i++) {
+            if (control(true, USBASP_FUNC_GETSTATUS, 0, 0, status, 4) != 4)
+                return fail("GETSTATUS failed");
+            if (status[2] != FUSE_WRITE_BUSY)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        if (status[2] == FUSE_WRITE_OK || status[2] == FUSE_WRITE_SKIPPED) {
+            id.fuse[which] = value;
+            return true;
+        }
+        if (status[2] == FUSE_WRITE_VERIFY)
+            return fail("fuse verify failed");
+    }
+    if (!readFuse(which, back))
+        return false;
+    if (back != value)
+        return fail("fuse reads back differently");
+    id.fuse[which] = value;
+    return true;
+}
+
+}
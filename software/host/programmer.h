@@ -0,0 +1,162 @@
+/*
+ * programmer.h - USBasp HV programmer client
+ *
+ * Reads USBASP_FUNC_GETCAPABILITIES and uses what the firmware offers:
+ * the ENABLEPROG mode hint instead of autodetection, GETIDENTITY instead
+ * of eleven TRANSMITs, SKIPEQUAL EEPROM blocks and the GETSTATUS fuse
+ * and mode entry results. Without capabilities (or with classic set) it
+ * speaks the protocol avrdude uses. Independent of the firmware, flash
+ * pages that are blank after a chip erase are not sent, and the long
+ * address is set once per contiguous run instead of before every block.
+ *
+ * Calls return false on failure with the reason in error().
+ */
+
+#ifndef HOST_PROGRAMMER_H
+#define HOST_PROGRAMMER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "transport.h"
+
+namespace usbasp {
+
+struct PartInfo {
+    const char *name;
+    const char *id;             /* avrdude style short name */
+    uint8_t sig[3];
+    uint32_t flashSize;
+    uint16_t pageSize;
+    uint16_t eeSize;
+    uint8_t eePage;
+    uint8_t mode;               /* USBASP_PROGMODE_* */
+};
+
+/* NULL if unknown */
+const PartInfo *findPart(const uint8_t sig[3]);
+const PartInfo *findPart(const std::string &id);
+
+struct Identity {
+    uint8_t sig[3];
+    uint8_t fuse[4];            /* low, high, ext, lock */
+    uint8_t cal[4];
+};
+
+enum { FUSE_LOW, FUSE_HIGH, FUSE_EXT, FUSE_LOCK };
+
+struct StoreInfo {
+    uint32_t size;              /* bytes of programmer flash */
+    uint16_t pageSize;          /* SPM page */
+    uint8_t step;               /* STORE_STEP_* of the running job */
+    uint8_t result;             /* STORE_RESULT_* of the last one */
+};
+
+const char *storeResultName(uint8_t result);
+
+/* program-on-insert loop (usbasp.h, USBASP_FUNC_AUTO) */
+struct AutoInfo {
+    uint8_t job;                /* AUTO_JOB_* */
+    uint8_t hint;               /* USBASP_PROGMODE_* of the check */
+    uint8_t state;              /* AUTO_STATE_* */
+    uint8_t result;             /* STORE_RESULT_* of the last board */
+    uint16_t boards;            /* done since the loop was set */
+};
+
+/* per-unit field the firmware writes over the image (usbasp.h) */
+struct InjectField {
+    uint8_t mem;                /* INJECT_MEM_* */
+    uint8_t format;             /* INJECT_FMT_* */
+    uint8_t width;
+    uint32_t address;
+    uint32_t counter;           /* value for the next unit */
+};
+
+struct ClientStats {
+    uint64_t transfers;
+    uint64_t bytesOut, bytesIn;
+    uint64_t pagesSkipped;      /* blank after erase, not sent */
+};
+
+class Programmer {
+public:
+    explicit Programmer(Transport &t);
+
+    bool classic;               /* ignore capabilities */
+    bool skipBlank;             /* don't send 0xFF pages after an erase */
+    std::function<void(size_t done, size_t total)> progress;
+
+    /* reads the capabilities, no target needed */
+    void probe();
+    /* probe, connect, programming mode, identify the part; hint is a
+     * USBASP_PROGMODE_*, AUTO lets the firmware detect */
+    bool open(uint8_t hint);
+    void close();
+
+    bool fast() const { return capsValid && !classic; }
+    const uint8_t *capabilities() const { return caps; }
+    const Identity &identity() const { return id; }
+    const PartInfo *part() const { return info; }
+
+    bool chipErase();
+    bool writeFlash(const uint8_t *data, size_t len);
+    bool readFlash(uint32_t addr, uint8_t *out, size_t len);
+    bool writeEeprom(const uint8_t *data, size_t len);
+    bool readEeprom(uint32_t addr, uint8_t *out, size_t len);
+    bool readFuse(int which, uint8_t &value);
+    bool writeFuse(int which, uint8_t value);
+
+    /* USB serial number in the programmer's EEPROM (USBASP_CAP_1_SERIAL);
+     * a new one shows up at the next enumeration */
+    bool readSerial(std::string &serial);
+    bool writeSerial(const std::string &serial);
+
+    /* standalone image store (USBASP_CAP_1_STORE), no target needed:
+     * upload an image made by buildStore(), start a run on the target
+     * attached and wait for its STORE_RESULT_* */
+    bool storeInfo(StoreInfo &info);
+    bool storeUpload(const std::vector<uint8_t> &image);
+    bool storeRun(uint8_t &result);
+
+    /* per-unit field (USBASP_CAP_2_INJECT), no target needed; the field read
+     * by probe() keeps its flash page from being skipped as blank, except in
+     * classic mode, where like avrdude the firmware fills it in */
+    bool readInject(InjectField &field);
+    bool writeInject(const InjectField &field);
+
+    /* program-on-insert loop (USBASP_CAP_2_AUTO), no target needed: set the
+     * job and the mode hint of the host job's check, read the state, end a
+     * host job with its STORE_RESULT_* once the firmware reported a part */
+    bool autoInfo(AutoInfo &info);
+    bool autoSet(uint8_t job, uint8_t hint, bool save, AutoInfo &info);
+    bool autoDone(uint8_t result, AutoInfo &info);
+
+    const std::string &error() const { return err; }
+    const ClientStats &stats() const { return st; }
+    Transport &transport() { return tr; }
+
+private:
+    int control(bool in, uint8_t func, uint16_t value, uint16_t index,
+                uint8_t *data, uint16_t length);
+    bool transmit(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t *reply = 0);
+    bool setAddress(uint32_t addr);
+    bool readMemory(uint8_t func, uint32_t addr, uint8_t *out, size_t len);
+    bool writeRun(uint8_t func, uint32_t addr, const uint8_t *data, size_t len,
+                  uint16_t pageSize, uint8_t extraFlags);
+    bool identify();
+    bool fail(const std::string &what);
+
+    Transport &tr;
+    bool capsValid, erased, connected;
+    uint8_t caps[4];
+    Identity id;
+    const PartInfo *info;
+    InjectField field;
+    std::string err;
+    ClientStats st;
+    size_t done, total;
+};
+
+}
+
+#endif
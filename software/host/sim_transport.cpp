@@ -0,0 +1,234 @@
+/*
+ * sim_transport.cpp - forked firmware simulation behind a socket pair
+ *
+ * Request:  in, request, value[2], index[2], length[2], OUT data
+ * Reply:    result[4] (bytes moved or -1), IN data
+ * When the parent shuts its side down the child finishes the firmware's
+ * pending work and answers with simulated ns[8], count[4] and count
+ * times length[4] + violation text.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "avr_serial.h"
+#include "isp.h"
+#include "store.h"
+#include "auto.h"
+#include "sim_transport.h"
+#include "usbasp.h"
+#include "usbhost.h"
+
+namespace usbasp {
+
+static bool readAll(int fd, void *buf, size_t n)
+{
+    uint8_t *p = (uint8_t *) buf;
+
+    while (n) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *buf, size_t n)
+{
+    const uint8_t *p = (const uint8_t *) buf;
+
+    while (n) {
+        ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool readable(int fd)
+{
+    struct pollfd p = { fd, POLLIN, 0 };
+
+    return poll(&p, 1, 0) > 0;
+}
+
+static void runChild(int fd, const sim::Part &part, sim::ns_t packetNs,
+                     const std::string &serial, bool clamp)
+{
+    sim::reset();
+    memcpy(&sim::eeprom[EE_ADDR_SERIAL], serial.data(), serial.size());
+    sim::ParallelAvr parallel(part);
+    sim::SerialAvr hvsp(part);
+    sim::ParallelAvr &target = part.bus == sim::SERIAL_HV ? hvsp : parallel;
+    target.clampUnpowered = clamp;
+    sim::attach(&target);
+
+    sim::UsbHost host;
+    bool closed = false;
+    host.packetNs = packetNs;
+    /* block for the next request only while the firmware has nothing
+     * left to do, so deferred page writes, standalone runs and the
+     * program-on-insert probes still happen in time */
+    host.refill = [&]() {
+        uint8_t h[8];
+        if (closed || ((ispBusy() || storeBusy() || autoActive()) &&
+                       !readable(fd)))
+            return false;
+        if (!readAll(fd, h, sizeof(h))) {
+            /* nobody left to turn the loop off, the run would not end */
+            autoSet(AUTO_JOB_OFF, USBASP_PROGMODE_AUTO, 0);
+            closed = true;
+            return false;
+        }
+        sim::Transfer t = sim::Transfer();
+        t.setup[0] = h[0] ? 0xC0 : 0x40;
+        memcpy(t.setup + 1, h + 1, 7);
+        if (!h[0]) {
+            t.data.resize(t.length());
+            if (!readAll(fd, t.data.data(), t.data.size())) {
+                closed = true;
+                return false;
+            }
+        }
+        host.script.push_back(t);
+        return true;
+    };
+    host.onDone = [&](sim::Transfer &t) {
+        int32_t r = t.stalled ? -1 : t.in() ? (int32_t) t.data.size() : t.length();
+        writeAll(fd, &r, sizeof(r));
+        if (t.in() && r > 0)
+            writeAll(fd, t.data.data(), r);
+        /* replies are not looked at again */
+        t.data.clear();
+        t.data.shrink_to_fit();
+    };
+    sim::ns_t t0 = sim::now();
+    host.run();
+
+    uint64_t ns = sim::now() - t0;
+    uint32_t count = target.violations.size();
+    writeAll(fd, &ns, sizeof(ns));
+    writeAll(fd, &count, sizeof(count));
+    for (const std::string &v : target.violations) {
+        uint32_t n = v.size();
+        writeAll(fd, &n, sizeof(n));
+        writeAll(fd, v.data(), n);
+    }
+}
+
+std::unique_ptr<SimTransport> SimTransport::open(const std::string &name,
+                                                 unsigned packetUs,
+                                                 std::string &err,
+                                                 const std::string &serial)
+{
+    size_t plus = name.find('+');
+    std::string partName = name.substr(0, plus);
+    bool clamp = plus != std::string::npos;
+    const sim::Part *part = sim::findPart(partName.c_str());
+    int sv[2];
+
+    if (clamp && name.compare(plus, std::string::npos, "+clamp") != 0) {
+        err = "sim: unknown model option " + name.substr(plus);
+        return 0;
+    }
+    if (!part || part->bus == sim::TPI) {
+        err = "sim: no HV model for part " + partName;
+        return 0;
+    }
+    if (!serial.empty() && serial.size() != USBASP_SERIAL_LEN) {
+        err = "sim: serial number must be " +
+              std::to_string(USBASP_SERIAL_LEN) + " characters";
+        return 0;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        err = std::string("sim: ") + strerror(errno);
+        return 0;
+    }
+    fflush(0);
+    pid_t pid = fork();
+    if (pid < 0) {
+        err = std::string("sim: ") + strerror(errno);
+        ::close(sv[0]);
+        ::close(sv[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        /* the sockets of earlier transports too, or their children
+         * would never see the parent shut down */
+        close_range(3, sv[1] - 1, 0);
+        close_range(sv[1] + 1, ~0U, 0);
+        runChild(sv[1], *part, packetUs * 1000ULL, serial, clamp);
+        _exit(0);
+    }
+    ::close(sv[1]);
+    return std::unique_ptr<SimTransport>(
+        new SimTransport(sv[0], pid, serial.empty() ? "sim:" + name : serial));
+}
+
+SimTransport::SimTransport(int f, pid_t p, const std::string &n)
+    : fd(f), pid(p), id(n), simNs(0)
+{
+}
+
+SimTransport::~SimTransport()
+{
+    finish();
+}
+
+int SimTransport::control(bool in, uint8_t request, uint16_t value,
+                          uint16_t index, uint8_t *data, uint16_t length)
+{
+    uint8_t h[8] = { in, request, (uint8_t) value, (uint8_t) (value >> 8),
+                     (uint8_t) index, (uint8_t) (index >> 8),
+                     (uint8_t) length, (uint8_t) (length >> 8) };
+    int32_t r;
+
+    if (fd < 0 || !writeAll(fd, h, sizeof(h)) ||
+        (!in && length && !writeAll(fd, data, length)) ||
+        !readAll(fd, &r, sizeof(r)))
+        return -1;
+    if (in && r > 0 && !readAll(fd, data, r))
+        return -1;
+    return r;
+}
+
+bool SimTransport::finish()
+{
+    uint32_t count;
+    int status;
+    bool ok;
+
+    if (fd < 0)
+        return false;
+    shutdown(fd, SHUT_WR);
+    ok = readAll(fd, &simNs, sizeof(simNs)) && readAll(fd, &count, sizeof(count));
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint32_t n;
+        std::string v;
+        ok = readAll(fd, &n, sizeof(n));
+        v.resize(ok ? n : 0);
+        ok = ok && readAll(fd, &v[0], n);
+        if (ok)
+            found.push_back(v);
+    }
+    ::close(fd);
+    fd = -1;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status))
+        ok = false;
+    return ok && found.empty();
+}
+
+}
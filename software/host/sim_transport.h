@@ -0,0 +1,54 @@
+/*
+ * sim_transport.h - the firmware's host build as a programmer
+ *
+ * Forks a child that runs the software/sim build of the firmware against
+ * the model of one part and forwards each control transfer to it over a
+ * socket pair. The simulation state is global to a process, so every
+ * SimTransport gets its own; several of them can run side by side. Open
+ * them before starting threads.
+ */
+
+#ifndef HOST_SIM_TRANSPORT_H
+#define HOST_SIM_TRANSPORT_H
+
+#include <sys/types.h>
+#include "transport.h"
+
+namespace usbasp {
+
+class SimTransport : public Transport {
+public:
+    /* part by avrdude id (sim/parts.cpp), with +clamp the model holds its
+     * data lines low while VDD is off (ParallelAvr::clampUnpowered);
+     * packetUs as bench_hv -u, a serial number (USBASP_SERIAL_LEN
+     * characters) is put into the programmer EEPROM and names the
+     * transport; NULL and a message in err if the part is unknown */
+    static std::unique_ptr<SimTransport> open(const std::string &part,
+                                              unsigned packetUs,
+                                              std::string &err,
+                                              const std::string &serial = "");
+    ~SimTransport() override;
+
+    int control(bool in, uint8_t request, uint16_t value, uint16_t index,
+                uint8_t *data, uint16_t length) override;
+    std::string name() const override { return id; }
+
+    /* ends the simulation and collects its results; false if the child
+     * died or the model saw timing/protocol violations */
+    bool finish();
+    double simulatedMs() const { return simNs / 1e6; }
+    const std::vector<std::string> &violations() const { return found; }
+
+private:
+    SimTransport(int fd, pid_t pid, const std::string &id);
+
+    int fd;
+    pid_t pid;
+    std::string id;
+    uint64_t simNs;
+    std::vector<std::string> found;
+};
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * station.cpp - one job on several programmers at once
+ */
+
+#include <chrono>
+#include <thread>
+#include "station.h"
+
+namespace usbasp {
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+static void runHead(Transport &tr, const Job &job, HeadResult &r)
+{
+    Programmer prog(tr);
+    Clock::time_point t0 = Clock::now(), t;
+    std::string err;
+
+    r.head = tr.name();
+    r.ok = false;
+    prog.classic = job.classic;
+    prog.probe();
+    if (!prog.readSerial(r.serial))
+        r.serial.clear();
+
+    if (!prog.open(job.mode)) {
+        r.error = prog.error();
+        goto done;
+    }
+    r.openMs = msSince(t0);
+    r.part = prog.part()->id;
+    if (job.expect && job.expect != prog.part()) {
+        r.error = std::string("expected ") + job.expect->name + ", found " +
+                  prog.part()->name;
+        goto done;
+    }
+    if (job.erase) {
+        t = Clock::now();
+        if (!prog.chipErase()) {
+            r.error = prog.error();
+            goto done;
+        }
+        r.eraseMs = msSince(t);
+    }
+    for (const Op &op : job.ops) {
+        t = Clock::now();
+        if (!runOp(prog, op, job.verify, r.output, err)) {
+            r.error = op.mem + ":" + op.op + ": " +
+                      (err.empty() ? prog.error() : err);
+            goto done;
+        }
+        r.opMs.push_back(msSince(t));
+    }
+    r.ok = true;
+
+done:
+    prog.close();
+    r.stats = prog.stats();
+    r.totalMs = msSince(t0);
+}
+
+void Station::add(std::unique_ptr<Transport> t)
+{
+    heads.push_back(std::move(t));
+}
+
+std::vector<HeadResult> Station::run(const Job &job)
+{
+    std::vector<HeadResult> results(heads.size());
+    std::vector<std::thread> threads;
+    Clock::time_point t0 = Clock::now();
+
+    for (size_t i = 0; i < heads.size(); i++)
+        threads.emplace_back(runHead, std::ref(*heads[i]), std::cref(job),
+                             std::ref(results[i]));
+    for (std::thread &th : threads)
+        th.join();
+    wall = msSince(t0);
+    return results;
+}
+
+}
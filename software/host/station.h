@@ -0,0 +1,56 @@
+/*
+ * station.h - one job on several programmers at once
+ *
+ * A Station owns the transports of all its programming heads and runs the
+ * same job on each of them in its own thread. The images of the job's
+ * operations are loaded once and shared read-only by all threads. Every
+ * head reports its own result, error and timings; nothing is shared
+ * between heads while the job runs, so a slow or failing head does not
+ * hold up the others.
+ */
+
+#ifndef HOST_STATION_H
+#define HOST_STATION_H
+
+#include <vector>
+#include "ops.h"
+
+namespace usbasp {
+
+struct Job {
+    uint8_t mode;               /* USBASP_PROGMODE_* hint */
+    const PartInfo *expect;     /* NULL: any part */
+    bool erase, classic, verify;
+    std::vector<Op> ops;        /* loaded, no file reads */
+};
+
+struct HeadResult {
+    std::string head;           /* transport name */
+    std::string serial;         /* from GETSERIAL, empty without */
+    std::string part;
+    bool ok;
+    std::string error, output;
+    double openMs, eraseMs, totalMs;
+    std::vector<double> opMs;   /* per Job::ops entry done */
+    ClientStats stats;
+};
+
+class Station {
+public:
+    /* transports must be opened before the first run() */
+    void add(std::unique_ptr<Transport> t);
+    size_t size() const { return heads.size(); }
+    Transport &head(size_t i) { return *heads[i]; }
+
+    /* runs job on every head in parallel, results in head order */
+    std::vector<HeadResult> run(const Job &job);
+    double wallMs() const { return wall; }
+
+private:
+    std::vector<std::unique_ptr<Transport>> heads;
+    double wall = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * transport.h - how the host library reaches a programmer
+ *
+ * A transport carries USBasp vendor control transfers. UsbTransport talks
+ * to real hardware through libusb (built with LIBUSB=1), SimTransport in
+ * sim_transport.h to the firmware's host build from software/sim.
+ */
+
+#ifndef HOST_TRANSPORT_H
+#define HOST_TRANSPORT_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace usbasp {
+
+class Transport {
+public:
+    virtual ~Transport() {}
+
+    /* bytes moved, -1 on error or STALL */
+    virtual int control(bool in, uint8_t request, uint16_t value,
+                        uint16_t index, uint8_t *data, uint16_t length) = 0;
+
+    /* serial number or bus path, for messages */
+    virtual std::string name() const = 0;
+};
+
+/* VID/PID of the USBasp (obdev shared IDs, usbconfig.h) */
+const uint16_t USBASP_VID = 0x16C0;
+const uint16_t USBASP_PID = 0x05DC;
+const char *const USBASP_PRODUCT = "USBasp";
+
+struct UsbDevice {
+    std::string path;           /* "bus-port.port..." */
+    std::string serial;         /* empty if the firmware has none */
+};
+
+/* attached programmers; empty without libusb */
+std::vector<UsbDevice> listUsb();
+
+/* by serial number or bus path, first one found if id is empty; NULL and
+ * a message in err if none matches */
+std::unique_ptr<Transport> openUsb(const std::string &id, std::string &err);
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * transport_usb.cpp - libusb transport
+ */
+
+#include "transport.h"
+
+#if HAVE_LIBUSB
+
+#include <libusb.h>
+
+namespace usbasp {
+
+/* vendor requests can wait for a chip erase or fuse write */
+static const unsigned TIMEOUT_MS = 5000;
+
+static libusb_context *context()
+{
+    static libusb_context *ctx;
+
+    if (!ctx && libusb_init(&ctx) < 0)
+        ctx = 0;
+    return ctx;
+}
+
+static std::string pathOf(libusb_device *dev)
+{
+    uint8_t ports[8];
+    int n = libusb_get_port_numbers(dev, ports, sizeof(ports));
+    std::string p = std::to_string(libusb_get_bus_number(dev));
+
+    for (int i = 0; i < n; i++)
+        p += (i ? "." : "-") + std::to_string(ports[i]);
+    return p;
+}
+
+static std::string stringOf(libusb_device_handle *h, uint8_t index)
+{
+    unsigned char buf[128];
+
+    if (!index || libusb_get_string_descriptor_ascii(h, index, buf, sizeof(buf)) < 0)
+        return "";
+    return (const char *) buf;
+}
+
+class UsbTransport : public Transport {
+public:
+    UsbTransport(libusb_device_handle *h, const std::string &n) : handle(h), id(n) {}
+    ~UsbTransport() override { libusb_close(handle); }
+
+    int control(bool in, uint8_t request, uint16_t value, uint16_t index,
+                uint8_t *data, uint16_t length) override
+    {
+        uint8_t type = LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE |
+                       (in ? LIBUSB_ENDPOINT_IN : LIBUSB_ENDPOINT_OUT);
+        int r = libusb_control_transfer(handle, type, request, value, index,
+                                        data, length, TIMEOUT_MS);
+        return r < 0 ? -1 : r;
+    }
+
+    std::string name() const override { return id; }
+
+private:
+    libusb_device_handle *handle;
+    std::string id;
+};
+
+/* calls f(handle, path, serial) for every USBasp until it
+ * returns true; f closes the handle or keeps it */
+template <typename F>
+static void forEach(F f)
+{
+    libusb_device **list;
+    libusb_context *ctx = context();
+
+    if (!ctx)
+        return;
+    ssize_t n = libusb_get_device_list(ctx, &list);
+    for (ssize_t i = 0; i < n; i++) {
+        libusb_device_descriptor d;
+        libusb_device_handle *h;
+
+        if (libusb_get_device_descriptor(list[i], &d) < 0 ||
+            d.idVendor != USBASP_VID || d.idProduct != USBASP_PID ||
+            libusb_open(list[i], &h) < 0)
+            continue;
+        if (stringOf(h, d.iProduct) != USBASP_PRODUCT) {
+            libusb_close(h);
+            continue;
+        }
+        if (f(h, pathOf(list[i]), stringOf(h, d.iSerialNumber)))
+            break;
+    }
+    libusb_free_device_list(list, 1);
+}
+
+std::vector<UsbDevice> listUsb()
+{
+    std::vector<UsbDevice> out;
+
+    forEach([&](libusb_device_handle *h, const std::string &path,
+                const std::string &serial) {
+        out.push_back(UsbDevice{ path, serial });
+        libusb_close(h);
+        return false;
+    });
+    return out;
+}
+
+std::unique_ptr<Transport> openUsb(const std::string &id, std::string &err)
+{
+    std::unique_ptr<Transport> t;
+
+    forEach([&](libusb_device_handle *h, const std::string &path,
+                const std::string &serial) {
+        if (!id.empty() && id != path && id != serial) {
+            libusb_close(h);
+            return false;
+        }
+        t.reset(new UsbTransport(h, serial.empty() ? path : serial));
+        return true;
+    });
+    if (!t)
+        err = id.empty() ? "no USBasp found" : "no USBasp " + id;
+    return t;
+}
+
+}
+
+#else
+
+namespace usbasp {
+
+std::vector<UsbDevice> listUsb()
+{
+    return std::vector<UsbDevice>();
+}
+
+std::unique_ptr<Transport> openUsb(const std::string &id, std::string &err)
+{
+    (void) id;
+    err = "built without libusb (make LIBUSB=1)";
+    return std::unique_ptr<Transport>();
+}
+
+}
+
+#endif
@@ -0,0 +1,342 @@
+/*
+ * usbasphv.cpp - command line client for the USBasp HV programmer
+ *
+ *   usbasphv [-P id|sim:part] [-p part] [-m mode] [-u us] [-e] [-C] [-V]
+ *            [-q] [-N serial] [-I field] [-S] [-R] [-A job [-n boards]]
+ *            [-U mem:op:file[:fmt]]... | -l
+ *
+ * -P picks the programmer by serial number or bus path (first one found
+ * by default); sim:<part> runs the host build of the firmware against
+ * the model of that part instead, with -u as the USB packet time;
+ * sim:<part>+clamp makes the part hold its data lines low while
+ * unpowered, which is what the -A socket probe looks for. -p
+ * names the expected part and passes its bus as the ENABLEPROG hint, -m
+ * gives the hint directly (auto, full, short, serial). mem is flash,
+ * eeprom, lfuse, hfuse, efuse or lock, op r, w or v; fmt m takes a fuse
+ * value on the command line, files are Intel HEX by name or content and
+ * raw binary otherwise. Written memories are verified unless -V; -C
+ * ignores the firmware's capabilities and talks like avrdude. -N stores
+ * a new USB serial number in the programmer; without -e or -U no target
+ * is needed for that. -I mem:address:width:format:counter sets the
+ * per-unit field the firmware writes over the image, mem flash or eeprom,
+ * format le, be, dec or hex; the counter counts up after each verified
+ * unit, -I off turns it off. -S stores the -U writes of the part named
+ * by -p in the programmer's flash instead, for standalone runs that
+ * erase, program and verify a target without the host; -R starts such a
+ * run and waits for its result. -A sets the program-on-insert loop,
+ * where the firmware probes the socket and starts a job on every part
+ * put in: store runs the stored image, host runs the -e and -U job from
+ * here on each part, off ends the loop. -n stops after that many boards
+ * and turns the loop off again; -A store without -n keeps the loop in
+ * the programmer for use without a host, -A host without -n runs until
+ * interrupted. A host job checks each part with the mode of -p or -m,
+ * else the last one that worked. -l lists the attached programmers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "ops.h"
+#include "sim_transport.h"
+#include "usbasp.h"
+
+using namespace usbasp;
+
+static void usage()
+{
+    fprintf(stderr, "usage: usbasphv [-P id|sim:part] [-p part] [-m mode] "
+            "[-u us] [-e] [-C] [-V] [-q] [-N serial] [-I field] [-S] [-R] "
+            "[-A job [-n boards]] [-U mem:op:file[:fmt]]... | -l\n");
+    exit(2);
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+/* open the part in the socket, erase and run the -U operations; 1 if
+ * anything failed */
+static int runJob(Programmer &prog, const std::string &name, uint8_t mode,
+                  const PartInfo *expect, bool erase, bool verify,
+                  const std::vector<Op> &ops)
+{
+    std::string err;
+
+    if (!prog.open(mode)) {
+        fprintf(stderr, "%s\n", prog.error().c_str());
+        return 1;
+    }
+    const Identity &ident = prog.identity();
+    printf("%s: %s, signature %02X %02X %02X, fuses %02X %02X %02X, "
+           "lock %02X, %s protocol\n", name.c_str(),
+           prog.part()->name, ident.sig[0], ident.sig[1], ident.sig[2],
+           ident.fuse[FUSE_LOW], ident.fuse[FUSE_HIGH],
+           ident.fuse[FUSE_EXT], ident.fuse[FUSE_LOCK],
+           prog.fast() ? "extended" : "classic");
+    if (expect && expect != prog.part()) {
+        fprintf(stderr, "expected %s\n", expect->name);
+        return 1;
+    }
+    if (erase) {
+        auto t = std::chrono::steady_clock::now();
+        if (!prog.chipErase()) {
+            fprintf(stderr, "%s\n", prog.error().c_str());
+            return 1;
+        }
+        printf("chip erase: %.1f ms\n", msSince(t));
+    }
+    for (const Op &op : ops) {
+        auto t = std::chrono::steady_clock::now();
+        std::string out;
+        if (!runOp(prog, op, verify, out, err)) {
+            fprintf(stderr, "%s\n",
+                    err.empty() ? prog.error().c_str() : err.c_str());
+            return 1;
+        }
+        fputs(out.c_str(), stdout);
+        printf("%s:%c:%s: %.1f ms\n", op.mem.c_str(), op.op,
+               op.file.c_str(), msSince(t));
+    }
+    return 0;
+}
+
+/* -A: set the loop and follow it board by board, running the job here
+ * for a host job; 1 if the loop could not be set or a board failed */
+static int autoLoop(Programmer &prog, const std::string &name, uint8_t job,
+                    uint8_t mode, unsigned boards, const PartInfo *expect,
+                    bool erase, bool verify, const std::vector<Op> &ops)
+{
+    static const char *const jobName[] = { "off", "store", "host" };
+    bool keep = job == AUTO_JOB_OFF || (job == AUTO_JOB_STORE && !boards);
+    unsigned seen = 0;
+    int fail = 0;
+    AutoInfo info;
+
+    prog.probe();
+    if (!prog.autoSet(job, mode, keep, info)) {
+        fprintf(stderr, "%s\n", prog.error().c_str());
+        return 1;
+    }
+    printf("%s: program-on-insert %s%s\n", name.c_str(), jobName[job],
+           keep ? ", kept in the programmer" : "");
+    if (keep)
+        return 0;
+
+    auto t = std::chrono::steady_clock::now();
+    while (!boards || seen < boards) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        if (!prog.autoInfo(info))
+            break;
+        if (job == AUTO_JOB_HOST && info.state == AUTO_STATE_PRESENT) {
+            int r = runJob(prog, name, mode, expect, erase, verify, ops);
+            prog.close();
+            if (!prog.autoDone(r ? STORE_RESULT_HOST : STORE_RESULT_OK, info))
+                break;
+        }
+        if (info.boards == (uint16_t) seen)
+            continue;
+        seen = info.boards;
+        printf("%s: board %u %s: %.1f ms\n", name.c_str(), seen,
+               storeResultName(info.result), msSince(t));
+        fail |= info.result != STORE_RESULT_OK;
+        t = std::chrono::steady_clock::now();
+    }
+    if ((boards && seen < boards) ||
+        !prog.autoSet(AUTO_JOB_OFF, mode, false, info)) {
+        fprintf(stderr, "%s\n", prog.error().c_str());
+        return 1;
+    }
+    return fail;
+}
+
+int main(int argc, char **argv)
+{
+    std::string id, partName, newSerial;
+    std::vector<Op> ops;
+    int mode = -1, autoJob = -1;
+    unsigned packetUs = 0, boards = 0;
+    bool erase = false, classic = false, verify = true, quiet = false;
+    bool store = false, run = false, setInject = false;
+    InjectField field;
+    int c;
+
+    while ((c = getopt(argc, argv, "P:p:m:u:eCVqN:I:SRA:n:U:l")) != -1) {
+        switch (c) {
+        case 'P': id = optarg; break;
+        case 'p': partName = optarg; break;
+        case 'm':
+            if (!strcmp(optarg, "auto")) mode = USBASP_PROGMODE_AUTO;
+            else if (!strcmp(optarg, "full")) mode = USBASP_PROGMODE_FULLBUS;
+            else if (!strcmp(optarg, "short")) mode = USBASP_PROGMODE_SHORTBUS;
+            else if (!strcmp(optarg, "serial")) mode = USBASP_PROGMODE_SERIAL;
+            else usage();
+            break;
+        case 'u': packetUs = strtoul(optarg, 0, 0); break;
+        case 'e': erase = true; break;
+        case 'C': classic = true; break;
+        case 'V': verify = false; break;
+        case 'q': quiet = true; break;
+        case 'N': newSerial = optarg; break;
+        case 'I':
+            if (!parseInject(optarg, field))
+                usage();
+            setInject = true;
+            break;
+        case 'S': store = true; break;
+        case 'R': run = true; break;
+        case 'A':
+            if (!strcmp(optarg, "off")) autoJob = AUTO_JOB_OFF;
+            else if (!strcmp(optarg, "store")) autoJob = AUTO_JOB_STORE;
+            else if (!strcmp(optarg, "host")) autoJob = AUTO_JOB_HOST;
+            else usage();
+            break;
+        case 'n': boards = strtoul(optarg, 0, 0); break;
+        case 'U': {
+            Op op;
+            std::string err;
+            if (!parseOp(optarg, op))
+                usage();
+            if (!loadOp(op, err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 1;
+            }
+            ops.push_back(op);
+            break;
+        }
+        case 'l':
+            for (const UsbDevice &d : listUsb())
+                printf("%s\t%s\n", d.path.c_str(),
+                       d.serial.empty() ? "-" : d.serial.c_str());
+            return 0;
+        default: usage();
+        }
+    }
+    if (optind != argc || (run && !store && !ops.empty()))
+        usage();
+    /* only a host job runs -e and -U without -S */
+    if (autoJob >= 0 && (run || (autoJob == AUTO_JOB_HOST && store) ||
+                         (autoJob != AUTO_JOB_HOST && !store &&
+                          (erase || !ops.empty()))))
+        usage();
+
+    const PartInfo *expect = 0;
+    if (!partName.empty() && !(expect = findPart(partName))) {
+        fprintf(stderr, "unknown part %s\n", partName.c_str());
+        return 2;
+    }
+    if (mode < 0)
+        mode = expect ? expect->mode : USBASP_PROGMODE_AUTO;
+
+    std::string err;
+    std::vector<uint8_t> image;
+    if (store && (!expect || !buildStore(*expect, mode, ops, image, err))) {
+        fprintf(stderr, "%s\n", expect ? err.c_str() : "-S needs -p");
+        return expect ? 1 : 2;
+    }
+
+    std::unique_ptr<Transport> tr;
+    SimTransport *sim = 0;
+    if (id.compare(0, 4, "sim:") == 0) {
+        std::unique_ptr<SimTransport> s = SimTransport::open(id.substr(4),
+                                                             packetUs, err);
+        sim = s.get();
+        tr = std::move(s);
+    } else {
+        tr = openUsb(id, err);
+    }
+    if (!tr) {
+        fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+
+    Programmer prog(*tr);
+    prog.classic = classic;
+    if (!quiet)
+        prog.progress = [](size_t done, size_t total) {
+            fprintf(stderr, "\r%zu/%zu", done, total);
+            if (done == total)
+                fprintf(stderr, "\n");
+        };
+
+    auto t0 = std::chrono::steady_clock::now();
+    int fail = 0;
+    if (!newSerial.empty()) {
+        std::string old, now;
+        prog.probe();
+        if (!prog.readSerial(old) || !prog.writeSerial(newSerial) ||
+            !prog.readSerial(now)) {
+            fprintf(stderr, "%s\n", prog.error().c_str());
+            return 1;
+        }
+        printf("%s: serial number %s -> %s\n", tr->name().c_str(), old.c_str(),
+               now.c_str());
+    }
+    if (setInject) {
+        prog.probe();
+        if (!prog.writeInject(field)) {
+            fprintf(stderr, "%s\n", prog.error().c_str());
+            return 1;
+        }
+        printf("%s: inject %s\n", tr->name().c_str(),
+               injectDescription(field).c_str());
+    }
+    if ((!newSerial.empty() || setInject) && !erase && ops.empty() && !store &&
+        !run && autoJob < 0)
+        return 0;
+    if (store || run) {
+        uint8_t result;
+        prog.probe();
+        if (store) {
+            if (!prog.storeUpload(image)) {
+                fprintf(stderr, "%s\n", prog.error().c_str());
+                return 1;
+            }
+            printf("%s: stored %zu bytes for %s: %.1f ms\n", tr->name().c_str(),
+                   image.size(), expect->name, msSince(t0));
+        }
+        if (run) {
+            auto t = std::chrono::steady_clock::now();
+            if (!prog.storeRun(result)) {
+                fprintf(stderr, "%s\n", prog.error().c_str());
+                fail = 1;
+            } else {
+                printf("%s: standalone run %s: %.1f ms\n", tr->name().c_str(),
+                       storeResultName(result), msSince(t));
+                fail = result != STORE_RESULT_OK;
+            }
+        }
+    }
+    if (autoJob >= 0)
+        fail = fail || autoLoop(prog, tr->name(), autoJob, mode, boards, expect,
+                                erase, verify, ops);
+    else if (!store && !run)
+        fail = runJob(prog, tr->name(), mode, expect, erase, verify, ops);
+    prog.close();
+    if (prog.readInject(field) && field.mem != INJECT_MEM_OFF)
+        printf("%s: inject %s\n", tr->name().c_str(),
+               injectDescription(field).c_str());
+
+    const ClientStats &st = prog.stats();
+    printf("%llu transfers, %llu bytes out, %llu bytes in, %llu blank pages "
+           "skipped, %.1f ms\n", (unsigned long long) st.transfers,
+           (unsigned long long) st.bytesOut, (unsigned long long) st.bytesIn,
+           (unsigned long long) st.pagesSkipped, msSince(t0));
+    if (sim) {
+        bool ok = sim->finish();
+        printf("%.3f ms simulated\n", sim->simulatedMs());
+        if (!ok) {
+            printf("FAIL: simulation ended with %zu violations\n",
+                   sim->violations().size());
+            for (size_t i = 0; i < sim->violations().size() && i < 20; i++)
+                printf("  %s\n", sim->violations()[i].c_str());
+            fail = 1;
+        }
+    }
+    return fail;
+}
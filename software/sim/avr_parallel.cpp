@@ -0,0 +1,302 @@
+/*
+ * avr_parallel.cpp - parallel HV programming model (ATmega datasheet,
+ * "Parallel Programming Parameters, Pin Mapping, and Commands")
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include "avr_parallel.h"
+
+namespace sim {
+
+ParallelAvr::ParallelAvr(const Part &p)
+    : part(p), flash(p.flashWords * 2, 0xFF), eeprom(p.eeSize, 0xFF),
+      lock(p.fuses[3]), strobes(), clampUnpowered(false), prog(false), cmd(0),
+      addrLo(0), addrHi(0), addrExt(0), dataLo(0), dataHi(0),
+      pageBuf(p.pageWords, 0xFFFF),
+      pageLoaded(p.pageWords), eeBuf(p.eePage, 0xFF), eeLoaded(p.eePage),
+      busyUntil(0), prevCtl(0), prevData(0), prevDdr(0), prevPwr(0), tData(0),
+      tCtl(), tVpp(0)
+{
+    for (int i = 0; i < 3; i++)
+        fuse[i] = p.fuses[i];
+}
+
+void ParallelAvr::violation(const char *what)
+{
+    char buf[160];
+
+    snprintf(buf, sizeof(buf), "%10.3f us: %s (cmd 0x%02X)",
+             now() / 1000.0, what, cmd);
+    violations.push_back(buf);
+}
+
+/* programming mode entered: latches cleared, page buffers empty */
+void ParallelAvr::enter()
+{
+    prog = true;
+    cmd = 0;
+    std::fill(pageLoaded.begin(), pageLoaded.end(), false);
+    std::fill(eeLoaded.begin(), eeLoaded.end(), false);
+}
+
+/* short bus parts have BS2 on the XA1 pin */
+uint8_t ParallelAvr::bs2(uint8_t ctl) const
+{
+    return part.bus == SHORT_BUS ? (ctl & PIN_XA1) : (ctl & PIN_BS2);
+}
+
+uint32_t ParallelAvr::wordAddress() const
+{
+    return (((uint32_t) addrExt << 16) | (addrHi << 8) | addrLo) %
+           part.flashWords;
+}
+
+uint8_t ParallelAvr::readValue(uint8_t ctl)
+{
+    uint8_t b1 = ctl & PIN_BS1, b2 = bs2(ctl);
+
+    switch (cmd) {
+    case 0x02:
+        return flash[wordAddress() * 2 + (b1 ? 1 : 0)];
+    case 0x03:
+        return eeprom[((addrHi << 8) | addrLo) % part.eeSize];
+    case 0x08:
+        if (b1)
+            return part.cal[addrLo & 3];
+        return addrLo < 3 ? part.sig[addrLo] : 0xFF;
+    case 0x04:
+        /* unimplemented bits read as 1 whatever was written */
+        if (!b2 && !b1) return fuse[0] | ~part.fuseBits[0];
+        if (b2 && b1) return fuse[1] | ~part.fuseBits[1];
+        if (b2) return fuse[2] | ~part.fuseBits[2];
+        return lock | ~part.fuseBits[3];
+    }
+    return 0xFF;
+}
+
+void ParallelAvr::drive(int port, uint8_t &mask, uint8_t &value)
+{
+    uint8_t ctl = portOut(PC);
+
+    if (clampUnpowered && port == PA && !(portOut(PD) & PIN_VDD) &&
+        !part.externalVdd) {
+        mask = 0xFF;
+        value = 0;
+        return;
+    }
+    if (port != PA || !prog || (ctl & PIN_OE) || !(portDdr(PC) & PIN_OE))
+        return;
+    if (now() - tCtl[6] < part.t.tOLDV)
+        violation("data read before tOLDV");
+    if (busy())
+        violation("read while busy");
+    mask = 0xFF;
+    value = readValue(ctl);
+}
+
+void ParallelAvr::xtal1(uint8_t ctl, uint8_t data, uint8_t ddr)
+{
+    ns_t t = now();
+
+    strobes.xtal1++;
+    if (busy()) {
+        violation("XTAL1 strobe while busy");
+        return;
+    }
+    if (ddr != 0xFF && (ctl & (PIN_XA0 | PIN_XA1)) != (PIN_XA0 | PIN_XA1))
+        violation("XTAL1 strobe with data bus not driven");
+    if (t - tData < part.t.tDVXH)
+        violation("data setup to XTAL1 (tDVXH)");
+    for (int b : { 0, 3, 4, 5 })
+        if (t - tCtl[b] < part.t.tDVXH)
+            violation("XA/BS setup to XTAL1 (tBVXH)");
+
+    switch (ctl & (PIN_XA0 | PIN_XA1)) {
+    case PIN_XA1:                               /* load command */
+        cmd = data;
+        break;
+    case 0:                                     /* load address */
+        if (ctl & PIN_BS1)
+            addrHi = data;
+        else if (part.bus == FULL_BUS && (ctl & PIN_BS2))
+            addrExt = data;
+        else
+            addrLo = data;
+        break;
+    case PIN_XA0:                               /* load data */
+        if (ctl & PIN_BS1)
+            dataHi = data;
+        else
+            dataLo = data;
+        break;
+    }
+}
+
+void ParallelAvr::pagel()
+{
+    strobes.pagel++;
+    if (cmd == 0x10) {
+        unsigned i = addrLo & (part.pageWords - 1);
+        pageBuf[i] = dataLo | (dataHi << 8);
+        pageLoaded[i] = true;
+    } else if (cmd == 0x11) {
+        unsigned i = ((addrHi << 8) | addrLo) & (part.eePage - 1);
+        eeBuf[i] = dataLo;
+        eeLoaded[i] = true;
+    } else {
+        violation("PAGEL without a page write command");
+    }
+}
+
+void ParallelAvr::write(uint8_t ctl)
+{
+    uint8_t b1 = ctl & PIN_BS1, b2 = bs2(ctl);
+    ns_t t = now();
+
+    strobes.wr++;
+    if (busy()) {
+        violation("WR while busy");
+        return;
+    }
+
+    switch (cmd) {
+    case 0x80:
+        std::fill(flash.begin(), flash.end(), 0xFF);
+        std::fill(eeprom.begin(), eeprom.end(), 0xFF);
+        lock = 0xFF;
+        busyUntil = t + part.tWLRH_CE;
+        break;
+    case 0x40:
+        if (!b2 && !b1) fuse[0] = dataLo;
+        else if (!b2 && b1) fuse[1] = dataLo;
+        else if (b2 && !b1) fuse[2] = dataLo;
+        else violation("fuse write with BS2 = BS1 = 1");
+        busyUntil = t + part.tWLRH;
+        break;
+    case 0x20:
+        lock &= dataLo;
+        busyUntil = t + part.tWLRH;
+        break;
+    case 0x10: {
+        uint32_t base = wordAddress() & ~(uint32_t) (part.pageWords - 1);
+        for (unsigned i = 0; i < part.pageWords; i++) {
+            if (!pageLoaded[i])
+                continue;
+            /* programming only clears bits */
+            flash[(base + i) * 2] &= pageBuf[i];
+            flash[(base + i) * 2 + 1] &= pageBuf[i] >> 8;
+            pageBuf[i] = 0xFFFF;
+            pageLoaded[i] = false;
+        }
+        busyUntil = t + part.tWLRH_FLASH;
+        break;
+    }
+    case 0x11: {
+        unsigned base = ((addrHi << 8) | addrLo) & ~(part.eePage - 1);
+        for (unsigned i = 0; i < part.eePage; i++) {
+            if (!eeLoaded[i])
+                continue;
+            eeprom[(base + i) % part.eeSize] = eeBuf[i];
+            eeLoaded[i] = false;
+        }
+        busyUntil = t + part.tWLRH_EE;
+        break;
+    }
+    default:
+        violation("WR with a command that does not program");
+    }
+}
+
+void ParallelAvr::update()
+{
+    uint8_t ctl = portOut(PC), data = portOut(PA), ddr = portDdr(PA);
+    uint8_t pwr = portOut(PD);
+    uint8_t rise = ctl & ~prevCtl, fall = ~ctl & prevCtl;
+    ns_t t = now(), last[8];
+
+    if (data != prevData || ddr != prevDdr)
+        tData = t;
+    for (int b = 0; b < 8; b++) {
+        last[b] = tCtl[b];
+        if ((rise | fall) & (1 << b))
+            tCtl[b] = t;
+    }
+
+    const Timing &tm = part.t;
+    const uint8_t progEnable = PIN_PAGEL | PIN_XA1 | PIN_XA0 | PIN_BS1;
+    const uint8_t bs = PIN_BS1 | (part.bus == SHORT_BUS ? PIN_XA1 : PIN_BS2);
+    bool powered = (pwr & PIN_VDD) || part.externalVdd;
+    if (!powered || !(pwr & PIN_VPP)) {
+        prog = false;
+    } else if (!(prevPwr & PIN_VPP) || (!(prevPwr & PIN_VDD) && !part.externalVdd)) {
+        /* Prog_enable pins PAGEL, XA1, XA0, BS1 = 0000 at VPP rise */
+        prog = !(ctl & progEnable);
+        if (prog) {
+            enter();
+            tVpp = t;
+            for (int b : { 0, 1, 3, 4 })
+                if (t - tCtl[b] < tm.tPEVP)
+                    violation("Prog_enable setup to VPP (tPEVP)");
+        }
+    }
+
+    if (prog) {
+        uint8_t changed = rise | fall;
+        bool dataChanged = data != prevData || ddr != prevDdr;
+
+        if ((changed & progEnable) && t - tVpp < tm.tVPPE)
+            violation("Prog_enable hold after VPP (tVPPE)");
+        if (rise & PIN_XTAL1) {
+            if (t - tVpp < tm.tVPCMD)
+                violation("command too soon after VPP (tVPCMD)");
+            if (t - last[2] < tm.tXLXH)
+                violation("XTAL1 low to high (tXLXH)");
+            if (t - tCtl[1] < tm.tPLXH)
+                violation("PAGEL low to XTAL1 high (tPLXH)");
+            xtal1(ctl, data, ddr);
+        }
+        if ((fall & PIN_XTAL1) && t - last[2] < tm.tXHXL)
+            violation("XTAL1 high pulse (tXHXL)");
+        /* latched on the rising edge, held until tXLDX after the fall */
+        if ((dataChanged || (changed & (PIN_XA0 | PIN_XA1 | bs))) &&
+            ((prevCtl & PIN_XTAL1) || t - tCtl[2] < tm.tXLDX))
+            violation("data/control hold after XTAL1 low (tXLDX)");
+
+        if (rise & PIN_PAGEL) {
+            if (t - tCtl[4] < tm.tBVPH)
+                violation("BS1 setup to PAGEL high (tBVPH)");
+            pagel();
+        }
+        if ((fall & PIN_PAGEL) && t - last[1] < tm.tPHPL)
+            violation("PAGEL high pulse (tPHPL)");
+        if ((changed & PIN_BS1) &&
+            ((prevCtl & PIN_PAGEL) || t - tCtl[1] < tm.tPLBX))
+            violation("BS1 hold after PAGEL low (tPLBX)");
+
+        if (fall & PIN_WR) {
+            if (t - tCtl[1] < tm.tPLWL)
+                violation("PAGEL low to WR low (tPLWL)");
+            for (int b = 0; b < 8; b++)
+                if ((bs & (1 << b)) && t - tCtl[b] < tm.tBVWL)
+                    violation("BS1/BS2 setup to WR low (tBVWL)");
+            write(ctl);
+        }
+        if ((rise & PIN_WR) && t - last[7] < tm.tWLWH)
+            violation("WR low pulse (tWLWH)");
+        if ((changed & bs) && !(ctl & PIN_WR) && t - tCtl[7] < tm.tWLBX)
+            violation("BS1/BS2 hold after WR low (tWLBX)");
+
+        if (fall & PIN_OE)
+            strobes.oe++;
+        if (!(ctl & PIN_OE) && ddr && ((prevCtl & PIN_OE) || !prevDdr))
+            violation("bus contention: OE low with data port driven");
+    }
+
+    prevCtl = ctl;
+    prevData = data;
+    prevDdr = ddr;
+    prevPwr = pwr;
+}
+
+}
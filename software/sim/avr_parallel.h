@@ -0,0 +1,78 @@
+/*
+ * avr_parallel.h - behavioral model of an AVR in parallel HV programming
+ *
+ * Pin mapping follows isp.h: data on PORTA, XA0/PAGEL/XTAL1/XA1/BS1/BS2/
+ * OE/WR on PORTC bits 0..7, VDD on PD6, VPP on PD7. Short bus parts share
+ * BS2 with XA1.
+ */
+
+#ifndef SIM_AVR_PARALLEL_H
+#define SIM_AVR_PARALLEL_H
+
+#include <string>
+#include <vector>
+#include "parts.h"
+
+namespace sim {
+
+enum {
+    PIN_XA0 = 1 << 0, PIN_PAGEL = 1 << 1, PIN_XTAL1 = 1 << 2,
+    PIN_XA1 = 1 << 3, PIN_BS1 = 1 << 4, PIN_BS2 = 1 << 5,
+    PIN_OE = 1 << 6, PIN_WR = 1 << 7
+};
+
+enum { PIN_VDD = 1 << 6, PIN_VPP = 1 << 7 };
+
+struct Strobes {
+    uint64_t xtal1, pagel, wr, oe;
+    uint64_t frames;            /* serial HV instruction frames */
+};
+
+class ParallelAvr : public Device {
+public:
+    explicit ParallelAvr(const Part &part);
+
+    void update() override;
+    void drive(int port, uint8_t &mask, uint8_t &value) override;
+
+    const Part &part;
+    std::vector<uint8_t> flash;
+    std::vector<uint8_t> eeprom;
+    uint8_t fuse[3], lock;
+
+    Strobes strobes;
+    std::vector<std::string> violations;
+
+    /* off by default: with VDD switched off the part's protection diodes
+     * hold its data pins (SDO for serial HV) low, as the program-on-insert
+     * probe expects of an unpowered part in the socket */
+    bool clampUnpowered;
+
+    bool progMode() const { return prog; }
+    bool busy() const { return now() < busyUntil; }
+
+protected:
+    void violation(const char *what);
+    uint8_t bs2(uint8_t ctl) const;
+    uint32_t wordAddress() const;
+    uint8_t readValue(uint8_t ctl);
+    void xtal1(uint8_t ctl, uint8_t data, uint8_t ddr);
+    void pagel();
+    void write(uint8_t ctl);
+    void enter();
+
+    bool prog;
+    uint8_t cmd, addrLo, addrHi, addrExt, dataLo, dataHi;
+    std::vector<uint16_t> pageBuf;
+    std::vector<bool> pageLoaded;
+    std::vector<uint8_t> eeBuf;
+    std::vector<bool> eeLoaded;
+    ns_t busyUntil;
+
+    uint8_t prevCtl, prevData, prevDdr, prevPwr;
+    ns_t tData, tCtl[8], tVpp;
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * avr_serial.cpp - serial HV programming model (ATtiny13/25/45/85
+ * datasheets, "High-voltage Serial Programming")
+ */
+
+#include "avr_serial.h"
+
+namespace sim {
+
+SerialAvr::SerialAvr(const Part &p)
+    : ParallelAvr(p), sdoOwned(false), rises(0), falls(0), sii(0), sdi(0),
+      out(0), sdo(0), prevFrameCtl(PIN_OE | PIN_WR), tEnter(0), tVdd(0),
+      tSciRise(0), tSciFall(0), tInput(0), firstFrame(false)
+{
+}
+
+/* SII byte to parallel control lines */
+static uint8_t controlLines(uint8_t instr)
+{
+    uint8_t ctl = 0;
+
+    if (instr & 0x01) ctl |= PIN_PAGEL;
+    if (instr & 0x02) ctl |= PIN_BS2;
+    if (instr & 0x04) ctl |= PIN_OE;
+    if (instr & 0x08) ctl |= PIN_WR;
+    if (instr & 0x10) ctl |= PIN_BS1;
+    if (instr & 0x20) ctl |= PIN_XA0;
+    if (instr & 0x40) ctl |= PIN_XA1;
+    return ctl;
+}
+
+void SerialAvr::frame(uint8_t instr, uint8_t data)
+{
+    uint8_t ctl = controlLines(instr);
+    uint8_t rise = ctl & ~prevFrameCtl, fall = ~ctl & prevFrameCtl;
+
+    strobes.frames++;
+    if (instr & 0x80)
+        violation("SII instruction with bit 7 set");
+    if ((ctl & (PIN_XA0 | PIN_XA1)) != (PIN_XA0 | PIN_XA1))
+        xtal1(ctl, data, 0xFF);
+    if (rise & PIN_PAGEL)
+        pagel();
+    if (fall & PIN_WR)
+        write(ctl);
+    if (!(ctl & PIN_OE)) {
+        if (fall & PIN_OE)
+            strobes.oe++;
+        if (busy())
+            violation("read while busy");
+        out = readValue(ctl);
+    }
+    prevFrameCtl = ctl;
+}
+
+void SerialAvr::drive(int port, uint8_t &mask, uint8_t &value)
+{
+    if (clampUnpowered && port == PA && !(portOut(PD) & PIN_VDD)) {
+        mask = PIN_SDO;
+        value = 0;
+        return;
+    }
+    if (port != PA || !prog || !sdoOwned)
+        return;
+    mask = PIN_SDO;
+    if (rises == 0 && falls == 0)
+        value = busy() ? 0 : PIN_SDO;
+    else
+        value = sdo ? PIN_SDO : 0;
+}
+
+void SerialAvr::update()
+{
+    uint8_t ctl = portOut(PC), pwr = portOut(PD);
+    uint8_t ddrA = portDdr(PA), outA = portOut(PA);
+    uint8_t rise = ctl & ~prevCtl, fall = ~ctl & prevCtl;
+    ns_t t = now();
+
+    if ((pwr & PIN_VDD) && !(prevPwr & PIN_VDD))
+        tVdd = t;
+    if (!(pwr & PIN_VDD) || !(pwr & PIN_VPP)) {
+        prog = false;
+        sdoOwned = false;
+    } else if (!(prevPwr & PIN_VPP)) {
+        /* Prog_enable: SDI, SII, SDO = 000 and VCC just before VPP */
+        if (!(ctl & (PIN_SII | PIN_SDI)) && (ddrA & PIN_SDO) &&
+            !(outA & PIN_SDO) && t - tVdd <= part.t.tVCCVP) {
+            enter();
+            tEnter = t;
+            rises = falls = 0;
+            sii = sdi = 0;
+            out = 0;
+            prevFrameCtl = PIN_OE | PIN_WR;
+            firstFrame = true;
+        }
+    }
+
+    if (prog) {
+        if ((ddrA & PIN_SDO) && !(prevDdr & PIN_SDO) && sdoOwned)
+            violation("bus contention: SDO driven by the programmer");
+        if (!(ddrA & PIN_SDO) && !sdoOwned) {
+            if (t - tEnter < part.t.tSDOHOLD)
+                violation("SDO released before Prog_enable hold time");
+            sdoOwned = true;
+        }
+        if ((ctl ^ prevCtl) & (PIN_SII | PIN_SDI)) {
+            tInput = t;
+            if ((ctl & PIN_SCI) && t - tSciRise < part.t.tSHIX)
+                violation("SDI/SII hold after SCI high (tSHIX)");
+        }
+        if (rise & PIN_SCI) {
+            if (firstFrame && t - tEnter < part.t.tFIRST)
+                violation("instruction less than 300 us after entry");
+            firstFrame = false;
+            if (t - tInput < part.t.tIVSH)
+                violation("SDI/SII setup to SCI high (tIVSH)");
+            if (t - tSciFall < part.t.tSLSH)
+                violation("SCI low pulse (tSLSH)");
+            tSciRise = t;
+            sii = (sii << 1) | ((ctl & PIN_SII) ? 1 : 0);
+            sdi = (sdi << 1) | ((ctl & PIN_SDI) ? 1 : 0);
+            if (++rises == 11) {
+                if ((sii | sdi) & 0x403)
+                    violation("serial frame without zero start/stop bits");
+                frame((sii >> 2) & 0xFF, (sdi >> 2) & 0xFF);
+            }
+        }
+        if ((fall & PIN_SCI) && rises) {
+            if (t - tSciRise < part.t.tSHSL)
+                violation("SCI high pulse (tSHSL)");
+            tSciFall = t;
+            falls++;
+            if (falls <= 8)
+                sdo = (out >> (8 - falls)) & 1;
+            else
+                sdo = 0;
+            if (falls == 11)
+                rises = falls = 0;
+        }
+    }
+
+    prevCtl = ctl;
+    prevDdr = ddrA;
+    prevPwr = pwr;
+}
+
+}
@@ -0,0 +1,46 @@
+/*
+ * avr_serial.h - behavioral model of an ATtiny in serial HV programming
+ *
+ * Pin mapping follows isp.h: SII on PC0, SDI on PC1, SCI on PC3, SDO on
+ * PA0, VDD on PD6, VPP on PD7. A frame is 11 SCI clocks: a zero, eight
+ * bits MSB first and two zeros on SII and SDI, sampled on the rising
+ * edge. The SII byte is the parallel interface control lines (PAGEL, BS2,
+ * OE, WR, BS1, XA0, XA1 from bit 0 up), so the latches, page buffers and
+ * memories are ParallelAvr's. A byte read by an OE low frame is shifted
+ * out on SDO during the next frame, D7 first after the first falling
+ * edge; between frames SDO is RDY/BSY.
+ */
+
+#ifndef SIM_AVR_SERIAL_H
+#define SIM_AVR_SERIAL_H
+
+#include "avr_parallel.h"
+
+namespace sim {
+
+enum { PIN_SII = 1 << 0, PIN_SDI = 1 << 1, PIN_SCI = 1 << 3, PIN_SDO = 1 << 0 };
+
+class SerialAvr : public ParallelAvr {
+public:
+    explicit SerialAvr(const Part &part);
+
+    void update() override;
+    void drive(int port, uint8_t &mask, uint8_t &value) override;
+
+private:
+    void frame(uint8_t instr, uint8_t data);
+
+    bool sdoOwned;              /* host released SDO after entry */
+    unsigned rises, falls;      /* SCI edges in the current frame */
+    uint16_t sii, sdi;
+    uint8_t out;                /* shifted out during the current frame */
+    uint8_t sdo;
+    uint8_t prevFrameCtl;
+
+    ns_t tEnter, tVdd, tSciRise, tSciFall, tInput;
+    bool firstFrame;
+};
+
+}
+
+#endif
@@ -0,0 +1,361 @@
+/*
+ * avr_tpi.cpp - TPI and NVM controller model (ATtiny4/5/9/10 datasheet,
+ * "Programming interface" and "Memory programming")
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include "avr_tpi.h"
+#include "tpi_defs.h"
+
+namespace sim {
+
+/* TPICLK at most 2 MHz */
+static const ns_t tCLK_PULSE = 250;
+/* idle bits needed after RESET low before the first frame */
+static const unsigned TPI_ENABLE_IDLE = 16;
+/* low bits in a row that make a break */
+static const unsigned TPI_BREAK = 12;
+/* NVM program enable key, in the order SKEY sends it */
+static const uint64_t TPI_NVM_KEY = 0xFF88D8CD45AB8912ULL;
+/* TPIPCR.GT: idle bits before an answer */
+static const unsigned guardBits[8] = { 128, 64, 32, 16, 8, 4, 2, 0 };
+/* tx[] value for a guard bit: line not driven */
+static const uint8_t TX_IDLE = 2;
+
+TpiAvr::TpiAvr(const Part &p)
+    : part(p), flash(p.flashWords * 2, 0xFF), config(p.fuses[0]),
+      lock(p.fuses[3]), stats(), reset(false), active(false), error(false),
+      idle(0), zeros(0), rxBit(-1), rxShift(0), txLevel(TX_IDLE),
+      txFrame(false), arg(NONE), sio(0), keyBytes(0), key(0), pr(0),
+      tpisr(0), tpipcr(0), nvmcmd(0), io(), sram(), wordLow(0xFF),
+      busyUntil(0), prevB(0), prevDdrB(0), tRise(0), tFall(0)
+{
+}
+
+void TpiAvr::violation(const char *what)
+{
+    char buf[160];
+
+    snprintf(buf, sizeof(buf), "%10.3f us: %s (PR 0x%04X)",
+             now() / 1000.0, what, pr);
+    violations.push_back(buf);
+}
+
+void TpiAvr::drive(int port, uint8_t &mask, uint8_t &value)
+{
+    if (port != PB || !reset || txLevel == TX_IDLE)
+        return;
+    mask = PIN_TPIDATA;
+    value = txLevel ? PIN_TPIDATA : 0;
+}
+
+void TpiAvr::answer(uint8_t b)
+{
+    uint8_t parity = 0;
+
+    stats.txFrames++;
+    tx.clear();
+    /* built back to front: stop bits first, guard bits last */
+    tx.push_back(1);
+    tx.push_back(1);
+    for (int i = 0; i < 8; i++)
+        parity ^= (b >> i) & 1;
+    tx.push_back(parity);
+    for (int i = 7; i >= 0; i--)
+        tx.push_back((b >> i) & 1);
+    tx.push_back(0);
+    tx.insert(tx.end(), guardBits[tpipcr & 7], TX_IDLE);
+}
+
+uint8_t TpiAvr::load(uint16_t addr)
+{
+    if (addr < 0x40) {
+        if (addr == NVMCSR)
+            return busy() ? NVMCSR_BSY : 0;
+        if (addr == NVMCMD)
+            return nvmcmd;
+        return io[addr];
+    }
+    if (addr < 0x60)
+        return sram[addr - 0x40];
+    if (addr < TPI_NVM_LOCK)
+        return 0;
+
+    if (!(tpisr & TPISR_NVMEN)) {
+        violation("NVM read with NVM programming disabled");
+        return 0xFF;
+    }
+    if (busy())
+        violation("NVM read while busy");
+    if (addr >= TPI_FLASH) {
+        if ((size_t) (addr - TPI_FLASH) < flash.size())
+            return flash[addr - TPI_FLASH];
+        return 0xFF;
+    }
+    if (addr == TPI_NVM_LOCK)
+        return lock;
+    if (addr == TPI_CONFIG)
+        return config;
+    if (addr == TPI_CALIBRATION)
+        return part.cal[0];
+    if (addr >= TPI_DEVICE_ID && addr < TPI_DEVICE_ID + 3)
+        return part.sig[addr - TPI_DEVICE_ID];
+    return 0xFF;
+}
+
+void TpiAvr::nvmWrite(uint16_t addr, uint8_t b)
+{
+    bool inFlash = addr >= TPI_FLASH && (size_t) (addr - TPI_FLASH) < flash.size();
+    ns_t t = now();
+
+    if (!(tpisr & TPISR_NVMEN)) {
+        violation("NVM write with NVM programming disabled");
+        return;
+    }
+    if (busy()) {
+        violation("NVM write while busy");
+        return;
+    }
+
+    switch (nvmcmd) {
+    case NVMCMD_CHIP_ERASE:
+        std::fill(flash.begin(), flash.end(), 0xFF);
+        lock = 0xFF;
+        busyUntil = t + part.tWLRH_CE;
+        stats.erases++;
+        break;
+    case NVMCMD_SECTION_ERASE:
+        if (inFlash)
+            std::fill(flash.begin(), flash.end(), 0xFF);
+        else if ((addr & ~1) == TPI_CONFIG)
+            config = 0xFF;
+        else
+            violation("section erase outside flash and configuration");
+        busyUntil = t + part.tWLRH;
+        stats.erases++;
+        break;
+    case NVMCMD_WORD_WRITE:
+        if (!(addr & 1)) {
+            wordLow = b;
+            break;
+        }
+        /* programming only clears bits */
+        if (inFlash) {
+            flash[(addr - TPI_FLASH) & ~1] &= wordLow;
+            flash[addr - TPI_FLASH] &= b;
+        } else if ((addr & ~1) == TPI_CONFIG) {
+            config &= wordLow;
+        } else if ((addr & ~1) == TPI_NVM_LOCK) {
+            lock &= wordLow;
+        } else {
+            violation("word write outside flash, configuration and lock");
+        }
+        wordLow = 0xFF;
+        busyUntil = t + part.tWLRH_FLASH;
+        stats.wordWrites++;
+        break;
+    default:
+        violation("NVM write without a write command in NVMCMD");
+    }
+}
+
+void TpiAvr::store(uint16_t addr, uint8_t b)
+{
+    if (addr < 0x40) {
+        if (addr == NVMCMD)
+            nvmcmd = b;
+        else if (addr != NVMCSR)
+            io[addr] = b;
+    } else if (addr < 0x60) {
+        sram[addr - 0x40] = b;
+    } else if (addr >= TPI_NVM_LOCK) {
+        nvmWrite(addr, b);
+    }
+}
+
+void TpiAvr::received(uint8_t b)
+{
+    Arg a = arg;
+
+    stats.rxFrames++;
+    arg = NONE;
+    switch (a) {
+    case SST:
+        store(pr, b);
+        if (sio)
+            pr++;
+        return;
+    case SSTPR0:
+        pr = (pr & 0xFF00) | b;
+        return;
+    case SSTPR1:
+        pr = (pr & 0x00FF) | (b << 8);
+        return;
+    case SOUT:
+        store(sio, b);
+        return;
+    case SSTCS:
+        if (sio == TPISR)
+            tpisr &= b;             /* NVMEN is only set by the key */
+        else if (sio == TPIPCR)
+            tpipcr = b & 0x07;
+        return;
+    case SKEY:
+        key = (key << 8) | b;
+        if (++keyBytes < 8) {
+            arg = SKEY;
+        } else if (key == TPI_NVM_KEY) {
+            tpisr |= TPISR_NVMEN;
+        } else {
+            violation("wrong NVM program enable key");
+        }
+        return;
+    case NONE:
+        break;
+    }
+
+    if (b == TPI_OP_SKEY) {
+        arg = SKEY;
+        keyBytes = 0;
+        key = 0;
+    } else if ((b & 0xF0) == 0x80) {                /* SLDCS */
+        uint8_t r = b & 0x0F;
+        answer(r == TPISR ? tpisr : r == TPIPCR ? tpipcr :
+               r == TPIIR ? TPIIR_ID : 0);
+    } else if ((b & 0xF0) == 0xC0) {                /* SSTCS */
+        arg = SSTCS;
+        sio = b & 0x0F;
+    } else if ((b & 0x90) == 0x10) {                /* SIN */
+        answer(load(((b >> 1) & 0x30) | (b & 0x0F)));
+    } else if ((b & 0x90) == 0x90) {                /* SOUT */
+        arg = SOUT;
+        sio = ((b >> 1) & 0x30) | (b & 0x0F);
+    } else if ((b & 0xFB) == TPI_OP_SLD) {          /* SLD, SLD_INC */
+        answer(load(pr));
+        if (b & 0x04)
+            pr++;
+    } else if ((b & 0xFB) == TPI_OP_SST) {          /* SST, SST_INC */
+        arg = SST;
+        sio = b & 0x04;
+    } else if ((b & 0xFE) == TPI_OP_SSTPR(0)) {
+        arg = (b & 1) ? SSTPR1 : SSTPR0;
+    } else {
+        violation("unknown TPI instruction");
+    }
+}
+
+/* one bit sampled on the rising clock edge */
+void TpiAvr::bit(uint8_t level)
+{
+    zeros = level ? 0 : zeros + 1;
+
+    if (!active) {
+        if (!level) {
+            violation("frame before 16 idle bits after RESET");
+            idle = 0;
+        } else if (++idle >= TPI_ENABLE_IDLE) {
+            active = true;
+        }
+        return;
+    }
+
+    if (txFrame || !tx.empty()) {
+        if (prevDdrB & PIN_TPIDATA)
+            violation("programmer drives TPIDATA during the answer");
+        return;
+    }
+
+    if (zeros == TPI_BREAK) {
+        stats.breaks++;
+        violation("break from the programmer");
+        rxBit = -1;
+        arg = NONE;
+        error = false;
+        return;
+    }
+    if (error)
+        return;
+
+    if (rxBit < 0) {
+        if (!level) {
+            rxBit = 0;
+            rxShift = 0;
+        }
+        return;
+    }
+    rxShift |= level << rxBit;
+    if (++rxBit < 11)
+        return;
+
+    rxBit = -1;
+    uint8_t b = rxShift & 0xFF, parity = (rxShift >> 8) & 1;
+    for (int i = 0; i < 8; i++)
+        parity ^= (b >> i) & 1;
+    if (parity) {
+        violation("parity error");
+        error = true;
+    } else if (((rxShift >> 9) & 3) != 3) {
+        violation("missing stop bits");
+        error = true;
+    } else {
+        received(b);
+    }
+}
+
+void TpiAvr::update()
+{
+    uint8_t out = portOut(PB), ddr = portDdr(PB);
+    uint8_t clk = out & PIN_TPICLK;
+    bool rst = (ddr & PIN_TPIRST) && !(out & PIN_TPIRST);
+    ns_t t = now();
+
+    if (rst && !reset) {
+        reset = true;
+        active = false;
+        error = false;
+        idle = zeros = 0;
+        rxBit = -1;
+        tx.clear();
+        txLevel = TX_IDLE;
+        txFrame = false;
+        arg = NONE;
+        tpisr = tpipcr = 0;
+    } else if (!rst && reset) {
+        reset = false;
+        active = false;
+        tpisr = 0;
+        txLevel = TX_IDLE;
+    }
+
+    if (reset) {
+        if ((prevB & PIN_TPICLK) && clk &&
+            (((ddr ^ prevDdrB) | (out ^ prevB)) & PIN_TPIDATA))
+            violation("TPIDATA changed while TPICLK high");
+        if (clk && !(prevB & PIN_TPICLK)) {
+            if (t - tFall < tCLK_PULSE)
+                violation("TPICLK low pulse");
+            tRise = t;
+            stats.clocks++;
+            bit((pinLevel(PB) & PIN_TPIDATA) ? 1 : 0);
+        } else if (!clk && (prevB & PIN_TPICLK)) {
+            if (t - tRise < tCLK_PULSE)
+                violation("TPICLK high pulse");
+            tFall = t;
+            /* the answer changes on the falling edge */
+            if (!tx.empty()) {
+                txLevel = tx.back();
+                tx.pop_back();
+                txFrame = txLevel != TX_IDLE;
+            } else {
+                txLevel = TX_IDLE;
+                txFrame = false;
+            }
+        }
+    }
+
+    prevB = out;
+    prevDdrB = ddr;
+}
+
+}
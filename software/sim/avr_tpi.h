@@ -0,0 +1,91 @@
+/*
+ * avr_tpi.h - behavioral model of an ATtiny4/5/9/10 on the TPI
+ *
+ * Pin mapping follows isp.h and tpi.S: RESET on PB4, TPICLK on PB7 (SCK),
+ * TPIDATA on PB5 (MOSI). The TPI is enabled by holding RESET low and
+ * clocking at least 16 idle bits. Frames are a start bit, 8 data bits
+ * LSB first, even parity and two stop bits, sampled on the rising clock
+ * edge; answers go out after the TPIPCR guard time, changing on the
+ * falling edge. The NVM controller executes NVMCMD on writes to the NVM
+ * part of the data space and keeps NVMCSR.BSY for the part's busy times.
+ */
+
+#ifndef SIM_AVR_TPI_H
+#define SIM_AVR_TPI_H
+
+#include <string>
+#include <vector>
+#include "parts.h"
+
+namespace sim {
+
+enum { PIN_TPIRST = 1 << 4, PIN_TPIDATA = 1 << 5, PIN_TPICLK = 1 << 7 };
+
+/* data space of the ATtiny4/5/9/10 */
+const uint16_t TPI_NVM_LOCK = 0x3F00;
+const uint16_t TPI_CONFIG = 0x3F40;
+const uint16_t TPI_CALIBRATION = 0x3F80;
+const uint16_t TPI_DEVICE_ID = 0x3FC0;
+const uint16_t TPI_FLASH = 0x4000;
+
+struct TpiStats {
+    uint64_t clocks;            /* TPICLK rising edges */
+    uint64_t rxFrames, txFrames;
+    uint64_t breaks;
+    uint64_t wordWrites, erases;
+};
+
+class TpiAvr : public Device {
+public:
+    explicit TpiAvr(const Part &part);
+
+    void update() override;
+    void drive(int port, uint8_t &mask, uint8_t &value) override;
+
+    const Part &part;
+    std::vector<uint8_t> flash;
+    uint8_t config, lock;
+
+    TpiStats stats;
+    std::vector<std::string> violations;
+
+    bool enabled() const { return active; }
+    bool busy() const { return now() < busyUntil; }
+
+private:
+    enum Arg { NONE, SST, SSTPR0, SSTPR1, SOUT, SSTCS, SKEY };
+
+    void violation(const char *what);
+    void bit(uint8_t level);
+    void received(uint8_t b);
+    void answer(uint8_t b);
+    uint8_t load(uint16_t addr);
+    void store(uint16_t addr, uint8_t b);
+    void nvmWrite(uint16_t addr, uint8_t b);
+
+    bool reset, active, error;
+    unsigned idle;              /* idle bits since reset or last frame */
+    unsigned zeros;             /* consecutive low bits (break) */
+    int rxBit;                  /* -1 between frames, else bits received */
+    uint16_t rxShift;
+    std::vector<uint8_t> tx;    /* bits still to be sent, back first */
+    uint8_t txLevel;
+    bool txFrame;               /* past the guard time */
+
+    Arg arg;
+    uint8_t sio;                /* SOUT / SSTCS address */
+    unsigned keyBytes;
+    uint64_t key;
+    uint16_t pr;
+    uint8_t tpisr, tpipcr;
+    uint8_t nvmcmd, io[64], sram[32];
+    uint8_t wordLow;
+    ns_t busyUntil;
+
+    uint8_t prevB, prevDdrB;
+    ns_t tRise, tFall;
+};
+
+}
+
+#endif
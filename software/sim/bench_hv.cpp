@@ -0,0 +1,184 @@
+/*
+ * bench_hv.cpp - throughput benchmark of the parallel and serial HV paths
+ *
+ * Runs an avrdude style session (mode entry, chip erase, flash write and
+ * read back, EEPROM write and read back) through the host build of the
+ * firmware against the ParallelAvr or SerialAvr model and prints
+ * simulated time and strobes per byte for each phase. Fails on data
+ * mismatches and on timing violations reported by the model; -w writes
+ * the bus waveform to a VCD file, -o the session as a capture for replay.
+ *
+ *   bench_hv [-p part] [-n flash bytes] [-e eeprom bytes] [-u usb us]
+ *            [-w vcd file] [-o capture]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include "avr_serial.h"
+#include "capture.h"
+#include "session.h"
+#include "usbasp.h"
+#include "vcd.h"
+
+using namespace sim;
+
+struct Phase {
+    ns_t t0, t1;
+    Strobes s0, s1;
+    uint64_t bytes;
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: bench_hv [-p part] [-n flash bytes] "
+            "[-e eeprom bytes] [-u usb packet us] [-w vcd file] "
+            "[-o capture]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const Part *part = findPart("m16");
+    uint32_t flashBytes = 8192, eeBytes = 256;
+    ns_t packetNs = 0;
+    const char *vcdPath = 0, *capPath = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "p:n:e:u:w:o:")) != -1) {
+        switch (c) {
+        case 'p': part = findPart(optarg); break;
+        case 'n': flashBytes = strtoul(optarg, 0, 0); break;
+        case 'e': eeBytes = strtoul(optarg, 0, 0); break;
+        case 'u': packetNs = strtoul(optarg, 0, 0) * 1000; break;
+        case 'w': vcdPath = optarg; break;
+        case 'o': capPath = optarg; break;
+        default: usage();
+        }
+    }
+    if (!part || part->bus > SERIAL_HV)
+        usage();
+    if (flashBytes > part->flashWords * 2)
+        flashBytes = part->flashWords * 2;
+    if (eeBytes > part->eeSize)
+        eeBytes = part->eeSize;
+
+    reset();
+    ParallelAvr parallel(*part);
+    SerialAvr serial(*part);
+    ParallelAvr &avr = part->bus == SERIAL_HV ? serial : parallel;
+    attach(&avr);
+    VcdTrace vcd;
+    if (vcdPath) {
+        if (!vcd.open(vcdPath)) {
+            perror(vcdPath);
+            return 2;
+        }
+        attach(&vcd);
+    }
+
+    std::vector<uint8_t> image(flashBytes), eedata(eeBytes);
+    srand(1);
+    for (auto &b : image) b = rand();
+    for (auto &b : eedata) b = rand();
+
+    Session s;
+    s.tag = "enter";
+    s.connect();
+    s.enableProg(part->bus == FULL_BUS ? USBASP_PROGMODE_FULLBUS :
+                 part->bus == SHORT_BUS ? USBASP_PROGMODE_SHORTBUS :
+                 USBASP_PROGMODE_SERIAL);
+    s.tag = "erase";
+    s.chipErase();
+    s.transmit(0x30, 0, 0, 0);          /* waits for the erase */
+    s.tag = "flash write";
+    s.writeFlash(0, image, part->pageWords * 2);
+    s.transmit(0x30, 0, 0, 0);          /* waits for the last page */
+    s.tag = "flash read";
+    s.readFlash(0, flashBytes);
+    s.tag = "eeprom write";
+    s.writeEeprom(0, eedata, part->eePage);
+    s.transmit(0x30, 0, 0, 0);
+    s.tag = "eeprom read";
+    s.readEeprom(0, eeBytes);
+    s.tag = "";
+    s.disconnect();
+
+    std::map<std::string, Phase> phases;
+    std::vector<std::string> order;
+    UsbHost host;
+    host.packetNs = packetNs;
+    host.script = s.transfers;
+    host.onStart = [&](Transfer &t) {
+        if (!phases.count(t.tag)) {
+            phases[t.tag] = Phase{ now(), 0, avr.strobes, {}, 0 };
+            order.push_back(t.tag);
+        }
+    };
+    host.onDone = [&](Transfer &t) {
+        Phase &p = phases[t.tag];
+        p.t1 = now();
+        p.s1 = avr.strobes;
+        uint8_t f = t.setup[1];
+        if (f == USBASP_FUNC_READFLASH || f == USBASP_FUNC_WRITEFLASH ||
+            f == USBASP_FUNC_READEEPROM || f == USBASP_FUNC_WRITEEEPROM)
+            p.bytes += t.length();
+    };
+    host.run();
+
+    int fail = 0;
+    if (memcmp(avr.flash.data(), image.data(), flashBytes)) {
+        printf("FAIL: flash contents differ from the image\n");
+        fail = 1;
+    }
+    if (Session::collect(host.script, USBASP_FUNC_READFLASH, "flash read") != image) {
+        printf("FAIL: flash read back differs\n");
+        fail = 1;
+    }
+    if (memcmp(avr.eeprom.data(), eedata.data(), eeBytes)) {
+        printf("FAIL: eeprom contents differ\n");
+        fail = 1;
+    }
+    if (Session::collect(host.script, USBASP_FUNC_READEEPROM, "eeprom read") != eedata) {
+        printf("FAIL: eeprom read back differs\n");
+        fail = 1;
+    }
+
+    static const char *const busName[] = { "full bus", "short bus",
+                                           "serial HV" };
+    printf("%s, %s, USB packet %.0f us\n", part->name, busName[part->bus],
+           packetNs / 1000.0);
+    printf("%-13s %7s %10s %9s %7s %7s %6s %7s %7s\n", "phase", "bytes",
+           "ms", "us/byte", "XTAL1/B", "PAGEL/B", "WR", "OE/B", "frame/B");
+    for (const std::string &name : order) {
+        if (name.empty())
+            continue;
+        const Phase &p = phases[name];
+        double ms = (p.t1 - p.t0) / 1e6;
+        double n = p.bytes ? p.bytes : 1;
+        printf("%-13s %7llu %10.3f %9.2f %7.2f %7.2f %6llu %7.2f %7.2f\n",
+               name.c_str(), (unsigned long long) p.bytes, ms,
+               p.bytes ? ms * 1000 / n : 0.0,
+               (p.s1.xtal1 - p.s0.xtal1) / n, (p.s1.pagel - p.s0.pagel) / n,
+               (unsigned long long) (p.s1.wr - p.s0.wr),
+               (p.s1.oe - p.s0.oe) / n, (p.s1.frames - p.s0.frames) / n);
+    }
+    printf("USB: %llu transfers, %llu packets, %llu NAKs\n",
+           (unsigned long long) host.stats.transfers,
+           (unsigned long long) host.stats.packets,
+           (unsigned long long) host.stats.naks);
+
+    if (!avr.violations.empty()) {
+        printf("FAIL: %zu timing/protocol violations\n", avr.violations.size());
+        for (size_t i = 0; i < avr.violations.size() && i < 20; i++)
+            printf("  %s\n", avr.violations[i].c_str());
+        fail = 1;
+    }
+    if (capPath && !writeCapture(capPath, host.script)) {
+        perror(capPath);
+        fail = 1;
+    }
+    return fail;
+}
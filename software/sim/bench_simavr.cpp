@@ -0,0 +1,261 @@
+/*
+ * bench_simavr.cpp - cycle accurate benchmark of the compiled firmware
+ *
+ * Loads a hex file given with -f (make simavr passes the firmware built
+ * from this tree for each variant) or the prebuilt release images from
+ * ../compiled, which predate the tree and are labelled as such, into
+ * simavr and runs the same avrdude style session as bench_hv, but over
+ * a bit level low speed USB host on D+/D-, so V-USB's interrupt
+ * handler and usbPoll() run as compiled code. The ParallelAvr/SerialAvr
+ * model hangs off PORTA/PORTC/PORTD of the simulated programmer.
+ * Prints CPU cycles per phase, per flash/EEPROM byte, per page commit
+ * and for mode entry, and the share of cycles spent with interrupts
+ * disabled. Fails on data mismatches and model violations; -w writes the
+ * bus waveform to a VCD file.
+ *
+ *   bench_simavr [-v variant | -f hex -m mcu] [-p part] [-n flash bytes]
+ *                [-e eeprom bytes] [-U port,d+,d-] [-w vcd file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_hex.h>
+#include "avr_serial.h"
+#include "session.h"
+#include "simavr_core.h"
+#include "usb_lowspeed.h"
+#include "usbasp.h"
+#include "vcd.h"
+
+using namespace sim;
+
+struct Variant {
+    const char *name;           /* as in the hex file names */
+    const char *mcu;            /* simavr core */
+};
+
+/* USBAsp_<name>_16MHz_parallel.hex; all of them sample D- on PIND bit 3 */
+static const Variant variants[] = {
+    { "m16", "atmega16" },
+    { "m32", "atmega32" },
+    { "m644", "atmega644" },
+    { "m128", "atmega128" },
+    { "m2560", "atmega2560" },
+    { "m8515", "atmega8515" },
+    { "m8535", "atmega8535" },
+};
+
+struct Phase {
+    uint64_t c0, c1, off0, off1;
+    Strobes s0, s1;
+    uint64_t bytes;
+};
+
+static const Part *part;
+static uint32_t flashBytes = 8192, eeBytes = 256;
+static char usbPort = 'D';
+static int usbDplus = 2, usbDminus = 3;
+static const char *vcdPath;
+
+static void usage()
+{
+    fprintf(stderr, "usage: bench_simavr [-v variant | -f hex -m mcu] "
+            "[-p part] [-n flash bytes] [-e eeprom bytes] [-U port,d+,d-] "
+            "[-w vcd file]\n");
+    exit(2);
+}
+
+/* 0 ok, 1 failed, -1 not run */
+static int bench(const char *name, const char *mcu, const char *hex)
+{
+    avr_t *avr = avr_make_mcu_by_name(mcu);
+    if (!avr) {
+        printf("%s: simavr has no %s core, skipped\n", name, mcu);
+        return -1;
+    }
+    avr_init(avr);
+    avr->frequency = 16000000;
+
+    uint32_t size, start;
+    uint8_t *code = read_ihex_file(hex, &size, &start);
+    if (!code) {
+        printf("%s: cannot read %s\n", name, hex);
+        return 1;
+    }
+    avr_loadcode(avr, code, size, start);
+    free(code);
+
+    reset();
+    simavrConnect(avr);
+    ParallelAvr parallel(*part);
+    SerialAvr serial(*part);
+    ParallelAvr &target = part->bus == SERIAL_HV ? serial : parallel;
+    attach(&target);
+    VcdTrace vcd;
+    if (vcdPath && vcd.open(vcdPath))
+        attach(&vcd);
+
+    std::vector<uint8_t> image(flashBytes), eedata(eeBytes);
+    srand(1);
+    for (auto &b : image) b = rand();
+    for (auto &b : eedata) b = rand();
+
+    Session s;
+    s.tag = "enter";
+    s.connect();
+    s.enableProg(part->bus == FULL_BUS ? USBASP_PROGMODE_FULLBUS :
+                 part->bus == SHORT_BUS ? USBASP_PROGMODE_SHORTBUS :
+                 USBASP_PROGMODE_SERIAL);
+    s.tag = "erase";
+    s.chipErase();
+    s.transmit(0x30, 0, 0, 0);
+    s.tag = "flash write";
+    s.writeFlash(0, image, part->pageWords * 2);
+    s.transmit(0x30, 0, 0, 0);
+    s.tag = "flash read";
+    s.readFlash(0, flashBytes);
+    s.tag = "eeprom write";
+    s.writeEeprom(0, eedata, part->eePage);
+    s.transmit(0x30, 0, 0, 0);
+    s.tag = "eeprom read";
+    s.readEeprom(0, eeBytes);
+    s.tag = "";
+    s.disconnect();
+
+    LowSpeedHost host(avr, usbPort, usbDplus, usbDminus);
+    std::map<std::string, Phase> phases;
+    std::vector<std::string> order;
+    int fail = 0;
+    try {
+        host.runUs(300000);             /* hardwareInit()'s 255 ms disconnect */
+        host.busReset();
+        for (Transfer &t : s.transfers) {
+            if (!phases.count(t.tag)) {
+                phases[t.tag] = Phase{ host.cycles(), 0, host.irqOffCycles, 0,
+                                       target.strobes, {}, 0 };
+                order.push_back(t.tag);
+            }
+            if (!host.control(t) && !t.stalled) {
+                printf("%s: transfer 0x%02X not answered\n", name, t.setup[1]);
+                fail = 1;
+                break;
+            }
+            Phase &p = phases[t.tag];
+            p.c1 = host.cycles();
+            p.off1 = host.irqOffCycles;
+            p.s1 = target.strobes;
+            uint8_t f = t.setup[1];
+            if (f == USBASP_FUNC_READFLASH || f == USBASP_FUNC_WRITEFLASH ||
+                f == USBASP_FUNC_READEEPROM || f == USBASP_FUNC_WRITEEEPROM)
+                p.bytes += t.length();
+        }
+    } catch (Stop &) {
+        printf("%s: simulated MCU stopped (state %d)\n", name, avr->state);
+        fail = 1;
+    }
+    detach(&target);
+    detach(&vcd);
+
+    if (!fail) {
+        if (memcmp(target.flash.data(), image.data(), flashBytes)) {
+            printf("FAIL: flash contents differ from the image\n");
+            fail = 1;
+        }
+        if (Session::collect(s.transfers, USBASP_FUNC_READFLASH, "flash read") != image) {
+            printf("FAIL: flash read back differs\n");
+            fail = 1;
+        }
+        if (memcmp(target.eeprom.data(), eedata.data(), eeBytes)) {
+            printf("FAIL: eeprom contents differ\n");
+            fail = 1;
+        }
+        if (Session::collect(s.transfers, USBASP_FUNC_READEEPROM, "eeprom read") != eedata) {
+            printf("FAIL: eeprom read back differs\n");
+            fail = 1;
+        }
+    }
+
+    printf("%s (%s) -> %s, %.0f MHz\n", name, mcu, part->name,
+           avr->frequency / 1e6);
+    printf("%-13s %7s %11s %9s %9s %8s\n", "phase", "bytes", "cycles",
+           "cycles/B", "cyc/page", "irq off");
+    for (const std::string &tag : order) {
+        if (tag.empty())
+            continue;
+        const Phase &p = phases[tag];
+        uint64_t c = p.c1 - p.c0;
+        uint64_t pages = p.s1.wr - p.s0.wr;
+        printf("%-13s %7llu %11llu %9.1f %9.0f %7.1f%%\n", tag.c_str(),
+               (unsigned long long) p.bytes, (unsigned long long) c,
+               p.bytes ? (double) c / p.bytes : 0.0,
+               pages ? (double) c / pages : 0.0,
+               c ? 100.0 * (p.off1 - p.off0) / c : 0.0);
+    }
+    printf("USB: %llu transfers, %llu packets, %llu NAKs\n",
+           (unsigned long long) host.stats.transfers,
+           (unsigned long long) host.stats.packets,
+           (unsigned long long) host.stats.naks);
+
+    if (!target.violations.empty()) {
+        printf("FAIL: %zu timing/protocol violations\n", target.violations.size());
+        for (size_t i = 0; i < target.violations.size() && i < 20; i++)
+            printf("  %s\n", target.violations[i].c_str());
+        fail = 1;
+    }
+    avr_terminate(avr);
+    return fail;
+}
+
+int main(int argc, char **argv)
+{
+    const char *variant = 0, *hex = 0, *mcu = 0;
+    int c;
+
+    part = findPart("m16");
+    while ((c = getopt(argc, argv, "v:f:m:p:n:e:U:w:")) != -1) {
+        switch (c) {
+        case 'v': variant = optarg; break;
+        case 'f': hex = optarg; break;
+        case 'm': mcu = optarg; break;
+        case 'p': part = findPart(optarg); break;
+        case 'n': flashBytes = strtoul(optarg, 0, 0); break;
+        case 'e': eeBytes = strtoul(optarg, 0, 0); break;
+        case 'w': vcdPath = optarg; break;
+        case 'U':
+            if (sscanf(optarg, "%c,%d,%d", &usbPort, &usbDplus, &usbDminus) != 3)
+                usage();
+            break;
+        default: usage();
+        }
+    }
+    if (!part || part->bus > SERIAL_HV || (hex && !mcu))
+        usage();
+    if (flashBytes > part->flashWords * 2)
+        flashBytes = part->flashWords * 2;
+    if (eeBytes > part->eeSize)
+        eeBytes = part->eeSize;
+
+    if (hex)
+        return bench(hex, mcu, hex) > 0;
+
+    int fail = 0, found = 0;
+    for (const Variant &v : variants) {
+        if (variant && strcmp(variant, v.name))
+            continue;
+        found = 1;
+        std::string file = std::string("../compiled/USBAsp_") + v.name +
+                           "_16MHz_parallel.hex";
+        std::string label = std::string(v.name) + " prebuilt release";
+        if (bench(label.c_str(), v.mcu, file.c_str()) > 0)
+            fail = 1;
+        printf("\n");
+    }
+    if (!found)
+        usage();
+    return fail;
+}
@@ -0,0 +1,156 @@
+/*
+ * bench_tpi.cpp - throughput benchmark of the TPI paths
+ *
+ * Runs an avrdude style TPI session (connect, NVM enable and signature
+ * read, chip erase, flash write and read back) through the host build of
+ * the firmware and the C port of tpi.S against the TpiAvr model and
+ * prints simulated time, TPI clocks and frames per byte for each phase.
+ * Fails on data mismatches and on protocol violations reported by the
+ * model.
+ *
+ *   bench_tpi [-p part] [-n flash bytes] [-c tpi clock hz] [-u usb us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include "avr_tpi.h"
+#include "session.h"
+#include "usbasp.h"
+
+using namespace sim;
+
+struct Phase {
+    ns_t t0, t1;
+    TpiStats s0, s1;
+    uint64_t bytes;
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: bench_tpi [-p part] [-n flash bytes] "
+            "[-c tpi clock hz] [-u usb packet us]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const Part *part = findPart("t10");
+    uint32_t flashBytes = 1024, hz = 0;
+    ns_t packetNs = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "p:n:c:u:")) != -1) {
+        switch (c) {
+        case 'p': part = findPart(optarg); break;
+        case 'n': flashBytes = strtoul(optarg, 0, 0); break;
+        case 'c': hz = strtoul(optarg, 0, 0); break;
+        case 'u': packetNs = strtoul(optarg, 0, 0) * 1000; break;
+        default: usage();
+        }
+    }
+    if (!part || part->bus != TPI)
+        usage();
+    if (flashBytes > part->flashWords * 2)
+        flashBytes = part->flashWords * 2;
+
+    reset();
+    TpiAvr avr(*part);
+    attach(&avr);
+
+    std::vector<uint8_t> image(flashBytes);
+    srand(1);
+    for (auto &b : image) b = rand();
+
+    Session s;
+    s.tag = "enter";
+    s.tpiConnect(hz ? 1500000 / hz : 0);
+    s.tpiEnable();
+    s.tpiRead(TPI_DEVICE_ID, 3);
+    s.tag = "erase";
+    s.tpiErase(TPI_FLASH, false);
+    s.tag = "flash write";
+    s.tpiWrite(TPI_FLASH, image);
+    s.tag = "flash read";
+    s.tpiRead(TPI_FLASH, flashBytes);
+    s.tag = "";
+    s.tpiDisconnect();
+
+    std::map<std::string, Phase> phases;
+    std::vector<std::string> order;
+    UsbHost host;
+    host.packetNs = packetNs;
+    host.script = s.transfers;
+    host.onStart = [&](Transfer &t) {
+        if (!phases.count(t.tag)) {
+            phases[t.tag] = Phase{ now(), 0, avr.stats, {}, 0 };
+            order.push_back(t.tag);
+        }
+    };
+    host.onDone = [&](Transfer &t) {
+        Phase &p = phases[t.tag];
+        p.t1 = now();
+        p.s1 = avr.stats;
+        uint8_t f = t.setup[1];
+        if (f == USBASP_FUNC_TPI_READBLOCK || f == USBASP_FUNC_TPI_WRITEBLOCK)
+            p.bytes += t.length();
+    };
+    host.run();
+
+    int fail = 0;
+    std::vector<uint8_t> sig(part->sig, part->sig + 3);
+    if (Session::collect(host.script, USBASP_FUNC_TPI_READBLOCK, "enter") != sig) {
+        printf("FAIL: signature read back differs\n");
+        fail = 1;
+    }
+    for (const Transfer &t : host.script) {
+        if (t.setup[1] == USBASP_FUNC_TPI_ERASE && (t.data.empty() || t.data[0])) {
+            printf("FAIL: erase timed out\n");
+            fail = 1;
+        }
+    }
+    if (memcmp(avr.flash.data(), image.data(), flashBytes)) {
+        printf("FAIL: flash contents differ from the image\n");
+        fail = 1;
+    }
+    if (Session::collect(host.script, USBASP_FUNC_TPI_READBLOCK, "flash read") != image) {
+        printf("FAIL: flash read back differs\n");
+        fail = 1;
+    }
+
+    printf("%s, TPI, clock %s, USB packet %.0f us\n", part->name,
+           hz ? (std::to_string(hz) + " Hz").c_str() : "free running",
+           packetNs / 1000.0);
+    printf("%-13s %7s %10s %9s %8s %7s %7s %6s\n", "phase", "bytes", "ms",
+           "us/byte", "clocks/B", "rx/B", "tx/B", "NVM");
+    for (const std::string &name : order) {
+        if (name.empty())
+            continue;
+        const Phase &p = phases[name];
+        double ms = (p.t1 - p.t0) / 1e6;
+        double n = p.bytes ? p.bytes : 1;
+        printf("%-13s %7llu %10.3f %9.2f %8.2f %7.2f %7.2f %6llu\n",
+               name.c_str(), (unsigned long long) p.bytes, ms,
+               p.bytes ? ms * 1000 / n : 0.0,
+               (p.s1.clocks - p.s0.clocks) / n,
+               (p.s1.rxFrames - p.s0.rxFrames) / n,
+               (p.s1.txFrames - p.s0.txFrames) / n,
+               (unsigned long long) (p.s1.wordWrites - p.s0.wordWrites +
+                                     p.s1.erases - p.s0.erases));
+    }
+    printf("USB: %llu transfers, %llu packets, %llu NAKs\n",
+           (unsigned long long) host.stats.transfers,
+           (unsigned long long) host.stats.packets,
+           (unsigned long long) host.stats.naks);
+
+    if (!avr.violations.empty()) {
+        printf("FAIL: %zu protocol violations\n", avr.violations.size());
+        for (size_t i = 0; i < avr.violations.size() && i < 20; i++)
+            printf("  %s\n", avr.violations[i].c_str());
+        fail = 1;
+    }
+    return fail;
+}
@@ -0,0 +1,240 @@
+/*
+ * capture.cpp - text capture format and usbmon pcap reader
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include "capture.h"
+#include "usbasp.h"
+
+namespace sim {
+
+/* pcap link types of the Linux usbmon binary interface */
+static const uint32_t DLT_USB_LINUX = 189;              /* 48 byte header */
+static const uint32_t DLT_USB_LINUX_MMAPPED = 220;      /* 64 byte header */
+
+std::string funcName(uint8_t func)
+{
+    static const char *const names[] = {
+        0, "CONNECT", "DISCONNECT", "TRANSMIT", "READFLASH", "ENABLEPROG",
+        "WRITEFLASH", "READEEPROM", "WRITEEEPROM", "SETLONGADDRESS",
+        "SETISPSCK", "TPI_CONNECT", "TPI_DISCONNECT", "TPI_RAWREAD",
+        "TPI_RAWWRITE", "TPI_READBLOCK", "TPI_WRITEBLOCK", "GETSTATUS",
+        "GETIDENTITY", "TPI_SETCLOCK", "TPI_ERASE", "PROFILE"
+    };
+
+    if (func < sizeof(names) / sizeof(names[0]) && names[func])
+        return names[func];
+    if (func == USBASP_FUNC_GETCAPABILITIES)
+        return "GETCAPABILITIES";
+    return std::to_string(func);
+}
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parseLine(const char *s, Transfer &t)
+{
+    unsigned type, req, value, index, length;
+    int n;
+
+    if (sscanf(s, "%x %x %x %x %x%n", &type, &req, &value, &index, &length,
+               &n) != 5 || type > 0xFF || req > 0xFF)
+        return false;
+    t.setup[0] = type;
+    t.setup[1] = req;
+    t.setup[2] = value;
+    t.setup[3] = value >> 8;
+    t.setup[4] = index;
+    t.setup[5] = index >> 8;
+    t.setup[6] = length;
+    t.setup[7] = length >> 8;
+
+    s += n;
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (*s != ':')
+        return *s == 0 || *s == '#' || *s == '\n' || *s == '\r';
+    for (s++; *s && *s != '#'; s++) {
+        if (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')
+            continue;
+        int hi = hexDigit(s[0]), lo = hexDigit(s[1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        t.data.push_back(hi << 4 | lo);
+        s++;
+    }
+    return true;
+}
+
+static bool readText(FILE *f, Capture &c, std::string &err)
+{
+    std::string tag, line;
+    char buf[256];
+    int lineNo = 0;
+
+    while (fgets(buf, sizeof(buf), f)) {
+        line += buf;
+        if (line.back() != '\n' && !feof(f))
+            continue;                   /* long data line */
+        lineNo++;
+        size_t i = line.find_first_not_of(" \t\r\n");
+        if (i == std::string::npos || line[i] == '#') {
+            line.clear();
+            continue;
+        }
+        if (line[i] == '@') {
+            size_t a = line.find_first_not_of(" \t", i + 1);
+            size_t b = line.find_last_not_of(" \t\r\n");
+            tag = a == std::string::npos || a > b ? "" : line.substr(a, b - a + 1);
+            line.clear();
+            continue;
+        }
+        Transfer t = Transfer();
+        if (!parseLine(line.c_str() + i, t)) {
+            err = "line " + std::to_string(lineNo) + ": cannot parse";
+            return false;
+        }
+        if (!t.in() && t.data.size() != t.length()) {
+            err = "line " + std::to_string(lineNo) +
+                  ": OUT data does not match wLength";
+            return false;
+        }
+        t.tag = tag;
+        c.transfers.push_back(t);
+        line.clear();
+    }
+    return true;
+}
+
+static uint32_t get32(const uint8_t *p, bool swap)
+{
+    return swap ? (p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3])
+                : (p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+/* usbmon records are in host order of the capturing machine, which is
+ * the byte order of the pcap header */
+static bool readPcap(FILE *f, bool swap, Capture &c, std::string &err)
+{
+    uint8_t hdr[24], rec[16];
+    std::map<uint64_t, Transfer> pending;
+    ns_t first = 0, last = 0;
+
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+        err = "short pcap header";
+        return false;
+    }
+    uint32_t link = get32(hdr + 20, swap);
+    if (link != DLT_USB_LINUX && link != DLT_USB_LINUX_MMAPPED) {
+        err = "pcap link type " + std::to_string(link) + " is not usbmon";
+        return false;
+    }
+    size_t urbHdr = link == DLT_USB_LINUX ? 48 : 64;
+
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec)) {
+        uint32_t incl = get32(rec + 8, swap);
+        std::vector<uint8_t> p(incl);
+        if (fread(p.data(), 1, incl, f) != incl) {
+            err = "truncated pcap record";
+            return false;
+        }
+        if (incl < urbHdr || p[9] != 2 || (p[10] & 0x7F) != 0)
+            continue;                   /* not control endpoint 0 */
+
+        uint64_t id;                    /* opaque, only matched */
+        memcpy(&id, p.data(), 8);
+        ns_t ts = (ns_t) get32(rec, swap) * 1000000000ULL +
+                  (ns_t) get32(rec + 4, swap) * 1000;
+        uint32_t captured = get32(p.data() + 36, swap);
+        const uint8_t *data = p.data() + urbHdr;
+        size_t n = std::min<size_t>(captured, incl - urbHdr);
+
+        if (p[8] == 'S') {
+            if (p[14] != 0 || (p[40] & 0x60) != 0x40)
+                continue;               /* no setup, or not a vendor request */
+            Transfer t = Transfer();
+            memcpy(t.setup, p.data() + 40, 8);
+            if (!t.in())
+                t.data.assign(data, data + n);
+            t.tStart = ts;
+            pending[id] = t;
+            if (!first)
+                first = ts;
+        } else if (p[8] == 'C' && pending.count(id)) {
+            Transfer t = pending[id];
+            pending.erase(id);
+            if (t.in())
+                t.data.assign(data, data + n);
+            t.stalled = get32(p.data() + 28, swap) != 0;
+            t.tEnd = ts;
+            last = ts;
+            c.transfers.push_back(t);
+        }
+    }
+    c.recordedNs = last > first ? last - first : 0;
+    return true;
+}
+
+bool readCapture(const char *path, Capture &c, std::string &err)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t magic[4];
+    bool ok;
+
+    c.transfers.clear();
+    c.recordedNs = 0;
+    if (!f) {
+        err = strerror(errno);
+        return false;
+    }
+    if (fread(magic, 1, 4, f) == 4 && get32(magic, false) == 0xA1B2C3D4) {
+        rewind(f);
+        ok = readPcap(f, false, c, err);
+    } else if (get32(magic, true) == 0xA1B2C3D4) {
+        rewind(f);
+        ok = readPcap(f, true, c, err);
+    } else {
+        rewind(f);
+        ok = readText(f, c, err);
+    }
+    fclose(f);
+    return ok;
+}
+
+bool writeCapture(const char *path, const std::vector<Transfer> &t)
+{
+    FILE *f = fopen(path, "w");
+    std::string tag;
+
+    if (!f)
+        return false;
+    fprintf(f, "# USBasp vendor requests: bmRequestType bRequest wValue "
+            "wIndex wLength [: data]\n");
+    for (const Transfer &x : t) {
+        if (x.tag != tag) {
+            fprintf(f, "@ %s\n", x.tag.c_str());
+            tag = x.tag;
+        }
+        fprintf(f, "%02x %02x %04x %04x %04x", x.setup[0], x.setup[1],
+                x.setup[2] | x.setup[3] << 8, x.setup[4] | x.setup[5] << 8,
+                x.length());
+        if (!x.data.empty()) {
+            fputs(" : ", f);
+            for (uint8_t b : x.data)
+                fprintf(f, "%02x", b);
+        }
+        fprintf(f, "  # %s\n", funcName(x.setup[1]).c_str());
+    }
+    return fclose(f) == 0;
+}
+
+}
@@ -0,0 +1,41 @@
+/*
+ * capture.h - recorded USBasp vendor request streams
+ *
+ * Text captures hold one control transfer per line:
+ *
+ *   # comment
+ *   @ phase name                       tag for the transfers that follow
+ *   c0 04 0000 0000 00c8 : 0c94...     bmRequestType bRequest wValue
+ *                                      wIndex wLength [: data]
+ *
+ * The data is the OUT payload, or for IN transfers the reply that was
+ * recorded (optional, compared on replay). Captures of real avrdude runs
+ * come from usbmon as pcap files (Wireshark, tcpdump -i usbmonN); those
+ * are read directly, keeping the vendor control transfers.
+ */
+
+#ifndef SIM_CAPTURE_H
+#define SIM_CAPTURE_H
+
+#include <string>
+#include <vector>
+#include "usbhost.h"
+
+namespace sim {
+
+struct Capture {
+    std::vector<Transfer> transfers;
+    /* wall time from the first setup to the last completion, pcap only */
+    ns_t recordedNs;
+};
+
+/* text or pcap, by content; false and a message in err on failure */
+bool readCapture(const char *path, Capture &c, std::string &err);
+bool writeCapture(const char *path, const std::vector<Transfer> &t);
+
+/* USBASP_FUNC_* name, or the number */
+std::string funcName(uint8_t func);
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * parts.cpp - memory layout and datasheet timing of the simulated parts
+ */
+
+#include <string.h>
+#include "parts.h"
+
+namespace sim {
+
+/* ATmega16/128/2560 and ATtiny2313 share the parallel table */
+static const Timing megaTiming = {
+    67, 200, 150, 67, 150, 67, 150, 67, 67, 67, 67, 150, 250,
+    100, 100, 50000,
+    0, 0, 0, 0, 0, 0, 0
+};
+
+/* ATtiny13/25/45/85; the parallel fields apply to the SII instructions */
+static const Timing hvspTiming = {
+    67, 200, 150, 67, 150, 67, 150, 67, 67, 67, 67, 150, 250,
+    100, 100, 50000,
+    110, 110, 50, 50, 20000, 10000, 300000
+};
+
+static const Part m16 = {
+    "ATmega16", "m16", FULL_BUS, { 0x1E, 0x94, 0x03 }, { 0xA8, 0xA9, 0xAA, 0xAB },
+    8192, 64, 512, 4, { 0xE1, 0x99, 0xFF, 0xFF }, { 0xFF, 0xFF, 0x00, 0x3F },
+    true,
+    3700000, 7500000, 3700000, 3700000, megaTiming
+};
+
+static const Part m128 = {
+    "ATmega128", "m128", FULL_BUS, { 0x1E, 0x97, 0x02 }, { 0xB0, 0xB1, 0xB2, 0xB3 },
+    65536, 128, 4096, 8, { 0xE1, 0x99, 0xFD, 0xFF }, { 0xFF, 0xFF, 0x03, 0x3F },
+    true,
+    3700000, 7500000, 3700000, 3700000, megaTiming
+};
+
+static const Part m2560 = {
+    "ATmega2560", "m2560", FULL_BUS, { 0x1E, 0x98, 0x01 }, { 0x9C, 0xFF, 0xFF, 0xFF },
+    131072, 128, 4096, 8, { 0x62, 0x99, 0xFF, 0xFF }, { 0xFF, 0xFF, 0x07, 0x3F },
+    true,
+    3700000, 7500000, 3700000, 3700000, megaTiming
+};
+
+static const Part t2313 = {
+    "ATtiny2313", "t2313", SHORT_BUS, { 0x1E, 0x91, 0x0A }, { 0x5C, 0x6A, 0xFF, 0xFF },
+    1024, 16, 128, 4, { 0x64, 0xDF, 0xFF, 0xFF }, { 0xFF, 0xFF, 0x01, 0x03 },
+    false,
+    3700000, 7500000, 3700000, 3700000, megaTiming
+};
+
+/* serial HV: wait delays of the ATtiny13/25/45/85 datasheets, the model's
+ * busy time after the WR instruction (SDO low) */
+static const Part t13 = {
+    "ATtiny13", "t13", SERIAL_HV, { 0x1E, 0x90, 0x07 }, { 0x52, 0xFF, 0xFF, 0xFF },
+    512, 16, 64, 4, { 0x6A, 0xFF, 0xFF, 0xFF }, { 0xFF, 0x1F, 0x00, 0x03 },
+    false,
+    4500000, 9000000, 4500000, 4000000, hvspTiming
+};
+
+static const Part t85 = {
+    "ATtiny85", "t85", SERIAL_HV, { 0x1E, 0x93, 0x0B }, { 0x8E, 0xFF, 0xFF, 0xFF },
+    4096, 32, 512, 4, { 0x62, 0xDF, 0xFF, 0xFF }, { 0xFF, 0xFF, 0x01, 0x03 },
+    false,
+    4500000, 9000000, 4500000, 4000000, hvspTiming
+};
+
+/* TPI: flash is written a word at a time, fuses[0] is the configuration
+ * byte; tWLRH is a section erase, tWLRH_FLASH a word write */
+static const Part t4 = {
+    "ATtiny4", "t4", TPI, { 0x1E, 0x8F, 0x0A }, { 0x5B, 0xFF, 0xFF, 0xFF },
+    256, 1, 0, 0, { 0xFF, 0xFF, 0xFF, 0xFF }, { 0xFF, 0xFF, 0xFF, 0xFF },
+    false,
+    4500000, 9000000, 2500000, 0, megaTiming
+};
+
+static const Part t10 = {
+    "ATtiny10", "t10", TPI, { 0x1E, 0x90, 0x03 }, { 0x5B, 0xFF, 0xFF, 0xFF },
+    512, 1, 0, 0, { 0xFF, 0xFF, 0xFF, 0xFF }, { 0xFF, 0xFF, 0xFF, 0xFF },
+    false,
+    4500000, 9000000, 2500000, 0, megaTiming
+};
+
+const Part *const parts[] = { &m16, &m128, &m2560, &t2313, &t13, &t85, &t4,
+                              &t10, 0 };
+
+const Part *findPart(const char *id)
+{
+    for (int i = 0; parts[i]; i++)
+        if (!strcmp(parts[i]->id, id))
+            return parts[i];
+    return 0;
+}
+
+}
@@ -0,0 +1,74 @@
+/*
+ * parts.h - target parts known to the models
+ */
+
+#ifndef SIM_PARTS_H
+#define SIM_PARTS_H
+
+#include <stdint.h>
+#include "sim.h"
+
+namespace sim {
+
+enum Bus { FULL_BUS, SHORT_BUS, SERIAL_HV, TPI };
+
+/* datasheet minimums checked by the models, ns: "Parallel Programming
+ * Characteristics", "High-voltage Serial Programming Characteristics" and
+ * the programming mode entry sequence */
+struct Timing {
+    ns_t tDVXH;         /* data and control valid to XTAL1 high */
+    ns_t tXLXH;         /* XTAL1 low to XTAL1 high */
+    ns_t tXHXL;         /* XTAL1 pulse width high */
+    ns_t tXLDX;         /* data and control hold after XTAL1 low */
+    ns_t tPLXH;         /* PAGEL low to XTAL1 high */
+    ns_t tBVPH;         /* BS1 valid to PAGEL high */
+    ns_t tPHPL;         /* PAGEL pulse width high */
+    ns_t tPLBX;         /* BS1 hold after PAGEL low */
+    ns_t tWLBX;         /* BS2/1 hold after WR low */
+    ns_t tPLWL;         /* PAGEL low to WR low */
+    ns_t tBVWL;         /* BS1/2 valid to WR low */
+    ns_t tWLWH;         /* WR pulse width low */
+    ns_t tOLDV;         /* OE low to data valid */
+    ns_t tPEVP;         /* Prog_enable set before VPP */
+    ns_t tVPPE;         /* Prog_enable held after VPP */
+    ns_t tVPCMD;        /* VPP to the first command */
+    ns_t tSHSL;         /* SCI pulse width high */
+    ns_t tSLSH;         /* SCI pulse width low */
+    ns_t tIVSH;         /* SDI, SII valid to SCI high */
+    ns_t tSHIX;         /* SDI, SII hold after SCI high */
+    ns_t tVCCVP;        /* VCC to VPP, at most */
+    ns_t tSDOHOLD;      /* Prog_enable held on SDO after VPP */
+    ns_t tFIRST;        /* VPP to the first serial instruction */
+};
+
+struct Part {
+    const char *name;
+    const char *id;             /* avrdude style short name */
+    Bus bus;
+    uint8_t sig[3];
+    uint8_t cal[4];
+    uint32_t flashWords;
+    uint16_t pageWords;
+    uint16_t eeSize;
+    uint8_t eePage;
+    uint8_t fuses[4];           /* low, high, ext, lock */
+    uint8_t fuseBits[4];        /* implemented bits, the rest read as 1 */
+    bool externalVdd;           /* adapter powers the target directly */
+    /* WR low to RDY/BSY high, the datasheet minimum: a wait shorter than
+     * this is always an error */
+    ns_t tWLRH;                 /* fuse / lock programming */
+    ns_t tWLRH_CE;              /* chip erase */
+    ns_t tWLRH_FLASH;           /* flash page */
+    ns_t tWLRH_EE;              /* EEPROM page */
+    Timing t;
+};
+
+/* NULL if unknown */
+const Part *findPart(const char *id);
+
+/* NULL terminated */
+extern const Part *const parts[];
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * replay.cpp - replays a recorded vendor request stream
+ *
+ * Feeds a capture (text or usbmon pcap, see capture.h) through
+ * usbFunctionSetup/Read/Write of the host build of the firmware against
+ * the model of the given part and reports transfers, packets, bytes and
+ * simulated time, in total and per USBASP_FUNC_*. With -c the IN replies
+ * are compared with the recorded ones and a difference fails the run;
+ * -o writes the replayed stream with the firmware's replies.
+ *
+ *   replay [-p part] [-u usb us] [-c] [-o capture] capture
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+#include "avr_serial.h"
+#include "avr_tpi.h"
+#include "capture.h"
+
+using namespace sim;
+
+struct FuncStats {
+    uint64_t transfers, bytes;
+    ns_t ns;
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: replay [-p part] [-u usb packet us] [-c] "
+            "[-o capture] capture\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const Part *part = findPart("m16");
+    const char *outPath = 0;
+    bool compare = false;
+    ns_t packetNs = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "p:u:co:")) != -1) {
+        switch (c) {
+        case 'p': part = findPart(optarg); break;
+        case 'u': packetNs = strtoul(optarg, 0, 0) * 1000; break;
+        case 'c': compare = true; break;
+        case 'o': outPath = optarg; break;
+        default: usage();
+        }
+    }
+    if (!part || optind != argc - 1)
+        usage();
+
+    Capture cap;
+    std::string err;
+    if (!readCapture(argv[optind], cap, err)) {
+        fprintf(stderr, "%s: %s\n", argv[optind], err.c_str());
+        return 2;
+    }
+
+    reset();
+    ParallelAvr parallel(*part);
+    SerialAvr serial(*part);
+    TpiAvr tpi(*part);
+    Device *target = part->bus == TPI ? (Device *) &tpi :
+                     part->bus == SERIAL_HV ? (Device *) &serial : &parallel;
+    const std::vector<std::string> &violations =
+        part->bus == TPI ? tpi.violations :
+        part->bus == SERIAL_HV ? serial.violations : parallel.violations;
+    attach(target);
+
+    std::map<uint8_t, FuncStats> funcs;
+    UsbHost host;
+    host.packetNs = packetNs;
+    host.script = cap.transfers;
+    host.onDone = [&](Transfer &t) {
+        FuncStats &f = funcs[t.setup[1]];
+        f.transfers++;
+        f.bytes += t.in() ? t.data.size() : t.length();
+        f.ns += t.tEnd - t.tStart;
+    };
+    ns_t t0 = now();
+    host.run();
+    ns_t total = now() - t0;
+
+    int fail = 0;
+    uint64_t differ = 0;
+    for (size_t i = 0; i < cap.transfers.size(); i++) {
+        const Transfer &rec = cap.transfers[i], &run = host.script[i];
+        if (!rec.in() || rec.data.empty() || rec.data == run.data)
+            continue;
+        if (compare && differ < 10)
+            printf("transfer %zu (%s): reply differs from the recording\n",
+                   i, funcName(rec.setup[1]).c_str());
+        differ++;
+    }
+    if (compare && differ) {
+        printf("FAIL: %llu replies differ\n", (unsigned long long) differ);
+        fail = 1;
+    }
+
+    printf("%s: %zu transfers against %s, USB packet %.0f us\n", argv[optind],
+           cap.transfers.size(), part->name, packetNs / 1000.0);
+    printf("%-16s %9s %9s %10s %9s\n", "request", "transfers", "bytes", "ms",
+           "us/xfer");
+    for (const auto &f : funcs)
+        printf("%-16s %9llu %9llu %10.3f %9.1f\n", funcName(f.first).c_str(),
+               (unsigned long long) f.second.transfers,
+               (unsigned long long) f.second.bytes, f.second.ns / 1e6,
+               f.second.ns / 1e3 / f.second.transfers);
+    printf("total: %llu transfers, %llu packets, %llu NAKs, %llu bytes out, "
+           "%llu bytes in, %.3f ms simulated",
+           (unsigned long long) host.stats.transfers,
+           (unsigned long long) host.stats.packets,
+           (unsigned long long) host.stats.naks,
+           (unsigned long long) host.stats.bytesOut,
+           (unsigned long long) host.stats.bytesIn, total / 1e6);
+    if (cap.recordedNs)
+        printf(", %.3f ms recorded", cap.recordedNs / 1e6);
+    printf("\n");
+    if (!compare && differ)
+        printf("%llu replies differ from the recording\n",
+               (unsigned long long) differ);
+
+    if (!violations.empty()) {
+        printf("FAIL: %zu timing/protocol violations\n", violations.size());
+        for (size_t i = 0; i < violations.size() && i < 20; i++)
+            printf("  %s\n", violations[i].c_str());
+        fail = 1;
+    }
+    if (outPath && !writeCapture(outPath, host.script)) {
+        perror(outPath);
+        fail = 1;
+    }
+    return fail;
+}
@@ -0,0 +1,197 @@
+/*
+ * session.cpp - avrdude style USBasp request sequences
+ */
+
+#include "session.h"
+#include "usbasp.h"
+#include "tpi_defs.h"
+
+namespace sim {
+
+void Session::control(bool in, uint8_t func, uint16_t value, uint16_t index,
+                      uint16_t length, const uint8_t *out)
+{
+    Transfer t = Transfer();
+
+    t.setup[0] = in ? 0xC0 : 0x40;  /* vendor, device */
+    t.setup[1] = func;
+    t.setup[2] = value;
+    t.setup[3] = value >> 8;
+    t.setup[4] = index;
+    t.setup[5] = index >> 8;
+    t.setup[6] = length;
+    t.setup[7] = length >> 8;
+    if (!in && out)
+        t.data.assign(out, out + length);
+    t.tag = tag;
+    transfers.push_back(t);
+}
+
+void Session::connect()
+{
+    control(true, USBASP_FUNC_CONNECT, 0, 0, 4);
+}
+
+void Session::disconnect()
+{
+    control(true, USBASP_FUNC_DISCONNECT, 0, 0, 4);
+}
+
+void Session::enableProg(uint8_t hint)
+{
+    control(true, USBASP_FUNC_ENABLEPROG, hint, 0, 4);
+}
+
+void Session::transmit(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+    control(true, USBASP_FUNC_TRANSMIT, a | (b << 8), c | (d << 8), 4);
+}
+
+void Session::chipErase()
+{
+    transmit(0xAC, 0x80, 0x00, 0x00);
+}
+
+void Session::writeFuse(uint8_t which, uint8_t value)
+{
+    transmit(0xAC, which, 0x00, value);
+}
+
+void Session::paged(uint8_t func, uint32_t addr,
+                    const std::vector<uint8_t> &data, unsigned pageSize)
+{
+    for (uint32_t off = 0; off < data.size(); off += BLOCKSIZE) {
+        uint32_t n = data.size() - off;
+        uint8_t flags = 0;
+        uint8_t la[4];
+
+        if (n > BLOCKSIZE)
+            n = BLOCKSIZE;
+        if (off == 0)
+            flags |= PROG_BLOCKFLAG_FIRST;
+        if (off + n == data.size())
+            flags |= PROG_BLOCKFLAG_LAST;
+        la[0] = addr + off;
+        la[1] = (addr + off) >> 8;
+        la[2] = (addr + off) >> 16;
+        la[3] = (addr + off) >> 24;
+        control(true, USBASP_FUNC_SETLONGADDRESS, la[0] | (la[1] << 8),
+                la[2] | (la[3] << 8), 4);
+        control(false, func, (addr + off) & 0xFFFF,
+                (pageSize & 0xFF) | ((flags | ((pageSize & 0xF00) >> 4)) << 8),
+                n, &data[off]);
+    }
+}
+
+void Session::blocks(uint8_t func, uint32_t addr, uint32_t len)
+{
+    for (uint32_t off = 0; off < len; off += BLOCKSIZE) {
+        uint32_t n = len - off;
+
+        if (n > BLOCKSIZE)
+            n = BLOCKSIZE;
+        control(true, USBASP_FUNC_SETLONGADDRESS, (addr + off) & 0xFFFF,
+                (addr + off) >> 16, 4);
+        control(true, func, (addr + off) & 0xFFFF, 0, n);
+    }
+}
+
+void Session::writeFlash(uint32_t addr, const std::vector<uint8_t> &image,
+                         unsigned pageSize)
+{
+    paged(USBASP_FUNC_WRITEFLASH, addr, image, pageSize);
+}
+
+void Session::readFlash(uint32_t addr, uint32_t len)
+{
+    blocks(USBASP_FUNC_READFLASH, addr, len);
+}
+
+void Session::writeEeprom(uint32_t addr, const std::vector<uint8_t> &data,
+                          unsigned pageSize)
+{
+    paged(USBASP_FUNC_WRITEEEPROM, addr, data, pageSize);
+}
+
+void Session::readEeprom(uint32_t addr, uint32_t len)
+{
+    blocks(USBASP_FUNC_READEEPROM, addr, len);
+}
+
+void Session::tpiConnect(uint16_t dly)
+{
+    control(true, USBASP_FUNC_TPI_CONNECT, dly, 0, 0);
+}
+
+void Session::tpiDisconnect()
+{
+    control(true, USBASP_FUNC_TPI_DISCONNECT, 0, 0, 0);
+}
+
+void Session::tpiSend(uint8_t b)
+{
+    control(true, USBASP_FUNC_TPI_RAWWRITE, b, 0, 0);
+}
+
+void Session::tpiRecv()
+{
+    control(true, USBASP_FUNC_TPI_RAWREAD, 0, 0, 1);
+}
+
+void Session::tpiEnable()
+{
+    static const uint8_t skey[8] = {
+        0x12, 0x89, 0xAB, 0x45, 0xCD, 0xD8, 0x88, 0xFF
+    };
+
+    tpiSend(TPI_OP_SSTCS(TPIPCR));
+    tpiSend(TPIPCR_GT_2b);
+    tpiSend(TPI_OP_SKEY);
+    for (int i = 7; i >= 0; i--)
+        tpiSend(skey[i]);
+    tpiSend(TPI_OP_SLDCS(TPIIR));
+    tpiRecv();
+    tpiSend(TPI_OP_SLDCS(TPISR));
+    tpiRecv();
+}
+
+void Session::tpiErase(uint16_t addr, bool section)
+{
+    control(true, USBASP_FUNC_TPI_ERASE, addr, section ? 1 : 0, 1);
+}
+
+void Session::tpiWrite(uint16_t addr, const std::vector<uint8_t> &data)
+{
+    for (uint32_t off = 0; off < data.size(); off += TPI_BLOCKSIZE) {
+        uint32_t n = data.size() - off;
+
+        if (n > TPI_BLOCKSIZE)
+            n = TPI_BLOCKSIZE;
+        control(false, USBASP_FUNC_TPI_WRITEBLOCK, addr + off, 0, n,
+                &data[off]);
+    }
+}
+
+void Session::tpiRead(uint16_t addr, uint32_t len)
+{
+    for (uint32_t off = 0; off < len; off += TPI_BLOCKSIZE) {
+        uint32_t n = len - off;
+
+        if (n > TPI_BLOCKSIZE)
+            n = TPI_BLOCKSIZE;
+        control(true, USBASP_FUNC_TPI_READBLOCK, addr + off, 0, n);
+    }
+}
+
+std::vector<uint8_t> Session::collect(const std::vector<Transfer> &t,
+                                      uint8_t func, const std::string &tag)
+{
+    std::vector<uint8_t> out;
+
+    for (const Transfer &x : t)
+        if (x.setup[1] == func && x.tag == tag && x.in())
+            out.insert(out.end(), x.data.begin(), x.data.end());
+    return out;
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+ * session.h - builds avrdude style USBasp transfer lists
+ *
+ * Mirrors avrdude's usbasp programmer: 200 byte blocks, a
+ * USBASP_FUNC_SETLONGADDRESS before each block, page size and block
+ * flags in wIndex.
+ */
+
+#ifndef SIM_SESSION_H
+#define SIM_SESSION_H
+
+#include <string>
+#include <vector>
+#include "usbhost.h"
+
+namespace sim {
+
+const unsigned BLOCKSIZE = 200;     /* USBASP_READBLOCKSIZE / WRITEBLOCKSIZE */
+const unsigned TPI_BLOCKSIZE = 32;  /* TPI_READBLOCK / TPI_WRITEBLOCK */
+
+class Session {
+public:
+    std::vector<Transfer> transfers;
+    std::string tag;                /* applied to transfers added from now */
+
+    void control(bool in, uint8_t func, uint16_t value, uint16_t index,
+                 uint16_t length, const uint8_t *out = 0);
+
+    void connect();
+    void disconnect();
+    void enableProg(uint8_t hint = 0);
+    void transmit(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+    void chipErase();
+    void writeFuse(uint8_t which, uint8_t value);   /* 0xA0, 0xA8, 0xA4, 0xE0 */
+    void writeFlash(uint32_t addr, const std::vector<uint8_t> &image,
+                    unsigned pageSize);
+    void readFlash(uint32_t addr, uint32_t len);
+    void writeEeprom(uint32_t addr, const std::vector<uint8_t> &data,
+                     unsigned pageSize);
+    void readEeprom(uint32_t addr, uint32_t len);
+
+    /* TPI: dly is avrdude's 1.5 MHz / bit clock, 0 - fastest */
+    void tpiConnect(uint16_t dly);
+    void tpiDisconnect();
+    void tpiSend(uint8_t b);
+    void tpiRecv();
+    /* avrdude's program enable: guard time, SKEY, TPIIR/TPISR check */
+    void tpiEnable();
+    void tpiErase(uint16_t addr, bool section);
+    void tpiWrite(uint16_t addr, const std::vector<uint8_t> &data);
+    void tpiRead(uint16_t addr, uint32_t len);
+
+    /* concatenated IN data of a run, transfers tagged with tag */
+    static std::vector<uint8_t> collect(const std::vector<Transfer> &t,
+                                        uint8_t func, const std::string &tag);
+
+private:
+    void paged(uint8_t func, uint32_t addr, const std::vector<uint8_t> &data,
+               unsigned pageSize);
+    void blocks(uint8_t func, uint32_t addr, uint32_t len);
+};
+
+}
+
+#endif
@@ -0,0 +1,16 @@
+/* host shim: SPM on the programmer flash, sim::flash */
+#ifndef SIM_AVR_BOOT_H
+#define SIM_AVR_BOOT_H
+
+#include <stdint.h>
+#include "sim.h"
+
+#define BOOTLOADER_SECTION
+
+#define boot_page_fill(addr, word)  sim::spmFill(addr, word)
+#define boot_page_erase(addr)       sim::spmErase(addr)
+#define boot_page_write(addr)       sim::spmWrite(addr)
+#define boot_spm_busy_wait()
+#define boot_rww_enable()
+
+#endif
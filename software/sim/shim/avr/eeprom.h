@@ -0,0 +1,36 @@
+/* host shim: programmer EEPROM is sim::eeprom */
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+#include "sim.h"
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p)
+{
+    return sim::eeprom[(uintptr_t) p & 0x3FF];
+}
+
+static inline void eeprom_update_byte(uint8_t *p, uint8_t v)
+{
+    sim::eeprom[(uintptr_t) p & 0x3FF] = v;
+}
+
+#define eeprom_write_byte   eeprom_update_byte
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    memcpy(dst, &sim::eeprom[(uintptr_t) src & 0x3FF], n);
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+    memcpy(&sim::eeprom[(uintptr_t) dst & 0x3FF], src, n);
+}
+
+#define eeprom_write_block  eeprom_update_block
+
+/* writes complete at once */
+#define eeprom_busy_wait()
+
+#endif
@@ -0,0 +1,10 @@
+/* host shim: interrupts are not simulated */
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#define sei()
+#define cli()
+#define ISR_NOBLOCK
+#define ISR(vector, ...)    void vector(void)
+
+#endif
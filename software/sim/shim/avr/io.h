@@ -0,0 +1,94 @@
+/* host shim: ATmega16 register names mapped to sim::Reg8 (see sim.h) */
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+#include "sim.h"
+
+#define __AVR_ATmega16__    1
+
+#define FLASHEND        0x3FFF
+#define SPM_PAGESIZE    128
+
+#define SIM_REG8(r)     (sim::Reg8{sim::R_##r})
+
+#define PORTA   SIM_REG8(PORTA)
+#define PORTB   SIM_REG8(PORTB)
+#define PORTC   SIM_REG8(PORTC)
+#define PORTD   SIM_REG8(PORTD)
+#define DDRA    SIM_REG8(DDRA)
+#define DDRB    SIM_REG8(DDRB)
+#define DDRC    SIM_REG8(DDRC)
+#define DDRD    SIM_REG8(DDRD)
+#define PINA    SIM_REG8(PINA)
+#define PINB    SIM_REG8(PINB)
+#define PINC    SIM_REG8(PINC)
+#define PIND    SIM_REG8(PIND)
+#define TCCR0   SIM_REG8(TCCR0)
+#define TCNT0   SIM_REG8(TCNT0)
+#define TIFR    SIM_REG8(TIFR)
+#define TIMSK   SIM_REG8(TIMSK)
+#define TCCR1A  SIM_REG8(TCCR1A)
+#define TCCR1B  SIM_REG8(TCCR1B)
+#define TCNT1   (sim::Reg16{sim::R_TCNT1})
+#define TCCR2   SIM_REG8(TCCR2)
+#define OCR2    SIM_REG8(OCR2)
+#define TCNT2   SIM_REG8(TCNT2)
+#define ASSR    SIM_REG8(ASSR)
+#define SPCR    SIM_REG8(SPCR)
+#define SPSR    SIM_REG8(SPSR)
+#define SREG    SIM_REG8(SREG)
+#define GICR    SIM_REG8(GICR)
+#define MCUCR   SIM_REG8(MCUCR)
+#define SPMCR   SIM_REG8(SPMCR)
+#define UCSRA   SIM_REG8(UCSRA)
+#define UCSRB   SIM_REG8(UCSRB)
+#define UCSRC   SIM_REG8(UCSRC)
+#define UDR     SIM_REG8(UDR)
+#define UBRRL   SIM_REG8(UBRRL)
+#define UBRRH   SIM_REG8(UBRRH)
+
+/* TCCR0 */
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define WGM01   3
+/* TCCR1B */
+#define CS10    0
+#define CS11    1
+#define CS12    2
+/* TCCR2 */
+#define CS20    0
+#define CS21    1
+#define CS22    2
+#define WGM21   3
+/* TIFR */
+#define TOV0    0
+#define OCF0    1
+#define TOV1    2
+#define OCF1B   3
+#define OCF1A   4
+#define TICIE1  5
+#define TOV2    6
+#define OCF2    7
+/* UART */
+#define TXC     6
+#define UDRE    5
+#define TXEN    3
+#define TXCIE   6
+#define UCSZ0   1
+#define URSEL   7
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define _SFR_IO_ADDR(x) 0
+#define _BV(b)  (1 << (b))
+
+#endif
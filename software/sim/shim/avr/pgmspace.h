@@ -0,0 +1,24 @@
+/* host shim: flash constants are ordinary data */
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#include "sim.h"
+
+/* a pointer to flash constants, or a programmer flash address */
+static inline uint8_t pgm_read_byte(const void *p)
+{
+    return *(const uint8_t *) p;
+}
+
+static inline uint8_t pgm_read_byte(uint32_t addr)
+{
+    return sim::flash[addr % sim::FLASH_SIZE];
+}
+
+#define pgm_read_word(p)        (*(const uint16_t *) (p))
+
+#endif
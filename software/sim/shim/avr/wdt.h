@@ -0,0 +1,13 @@
+/* host shim: no watchdog */
+#ifndef SIM_AVR_WDT_H
+#define SIM_AVR_WDT_H
+
+#define WDTO_15MS   0
+#define WDTO_1S     6
+#define WDTO_2S     7
+
+#define wdt_reset()
+#define wdt_enable(t)
+#define wdt_disable()
+
+#endif
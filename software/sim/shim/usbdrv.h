@@ -0,0 +1,45 @@
+/*
+ * host shim for usbdrv/usbdrv.h: the driver itself is replaced by the
+ * scripted host in usbhost.cpp, which calls the usbFunction* callbacks
+ * the way usbPoll() does on the device.
+ */
+#ifndef SIM_USBDRV_H
+#define SIM_USBDRV_H
+
+#include <stdint.h>
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+#ifndef schar
+#define schar   signed char
+#endif
+
+#define usbMsgLen_t     uchar
+#define USB_NO_MSG      ((usbMsgLen_t) -1)
+#define usbMsgPtr_t     uchar *
+#define USB_PUBLIC
+
+extern usbMsgPtr_t usbMsgPtr;
+extern uchar usbConfiguration;
+
+void usbInit(void);
+void usbPoll(void);
+
+#define USB_STRING_DESCRIPTOR_HEADER(stringLength) \
+    ((2 * (stringLength) + 2) | (3 << 8))
+
+#define usbDeviceConnect()
+#define usbDeviceDisconnect()
+
+/* V-USB flow control (USB_CFG_HAVE_FLOWCONTROL) */
+extern uchar usbRequestsDisabled;
+#define usbAllRequestsAreDisabled() (usbRequestsDisabled)
+#define usbDisableAllRequests()     (usbRequestsDisabled = 1)
+#define usbEnableAllRequests()      (usbRequestsDisabled = 0)
+
+usbMsgLen_t usbFunctionSetup(uchar data[8]);
+uchar usbFunctionRead(uchar *data, uchar len);
+uchar usbFunctionWrite(uchar *data, uchar len);
+
+#endif
@@ -0,0 +1,17 @@
+/* host shim: delays advance the simulated clock */
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#include "sim.h"
+
+static inline void _delay_us(double us)
+{
+    sim::advance((sim::ns_t) (us * 1000));
+}
+
+static inline void _delay_ms(double ms)
+{
+    sim::advance((sim::ns_t) (ms * 1000000));
+}
+
+#endif
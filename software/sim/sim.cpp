@@ -0,0 +1,195 @@
+/*
+ * sim.cpp - register file, pin resolution and simulated clock
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "sim.h"
+
+namespace sim {
+
+uint8_t eeprom[1024];
+uint8_t flash[FLASH_SIZE];
+static uint8_t spm_buf[SPM_PAGE];
+
+static ns_t clock_ns;
+static uint64_t accesses;
+static uint16_t regs[R_COUNT];
+static uint32_t tov1_ack;               /* Timer1 overflows acknowledged */
+static ns_t t2_start;                   /* Timer2 (re)started */
+static uint64_t ocf2_ack;               /* Timer2 compare matches acknowledged */
+static std::vector<Device *> devices;
+
+ns_t now()
+{
+    return clock_ns;
+}
+
+void advance(ns_t dt)
+{
+    clock_ns += dt;
+}
+
+void reset()
+{
+    clock_ns = 0;
+    accesses = 0;
+    tov1_ack = 0;
+    t2_start = 0;
+    ocf2_ack = 0;
+    memset(regs, 0, sizeof(regs));
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    memset(flash, 0xFF, sizeof(flash));
+    memset(spm_buf, 0xFF, sizeof(spm_buf));
+}
+
+void spmFill(uint32_t addr, uint16_t word)
+{
+    spm_buf[addr % SPM_PAGE & ~1] = word;
+    spm_buf[addr % SPM_PAGE | 1] = word >> 8;
+}
+
+void spmErase(uint32_t addr)
+{
+    memset(&flash[addr % FLASH_SIZE / SPM_PAGE * SPM_PAGE], 0xFF, SPM_PAGE);
+    advance(4000000);
+}
+
+/* the page buffer is cleared by the write, as on the device */
+void spmWrite(uint32_t addr)
+{
+    memcpy(&flash[addr % FLASH_SIZE / SPM_PAGE * SPM_PAGE], spm_buf, SPM_PAGE);
+    memset(spm_buf, 0xFF, sizeof(spm_buf));
+    advance(4000000);
+}
+
+void attach(Device *dev)
+{
+    devices.push_back(dev);
+}
+
+void detach(Device *dev)
+{
+    devices.erase(std::remove(devices.begin(), devices.end(), dev),
+                  devices.end());
+}
+
+uint8_t portOut(int port)
+{
+    return regs[R_PORTA + port] & regs[R_DDRA + port];
+}
+
+uint8_t portDdr(int port)
+{
+    return regs[R_DDRA + port];
+}
+
+uint8_t pinLevel(int port)
+{
+    uint8_t ddr = regs[R_DDRA + port];
+    uint8_t level = regs[R_PORTA + port];   /* outputs and pull-ups */
+    uint8_t mask = 0, value = 0;
+
+    for (Device *d : devices) {
+        uint8_t m = 0, v = 0;
+        d->drive(port, m, v);
+        mask |= m;
+        value = (value & ~m) | (v & m);
+    }
+    mask &= ~ddr;
+    return (level & ~mask) | (value & mask);
+}
+
+static void notify()
+{
+    for (Device *d : devices)
+        d->update();
+}
+
+/* Timer1 runs at F_CPU / 8 when CS11 is set, Timer0 at F_CPU / 64 */
+static uint32_t timer1Ticks()
+{
+    return (regs[R_TCCR1B] & 0x07) ? (uint32_t) (clock_ns / 500) : 0;
+}
+
+/* Timer2 in CTC mode: compare matches since it was started, prescalers
+ * of the ATmega16 (CS2 = 1..7) */
+static uint64_t timer2Matches()
+{
+    static const uint16_t prescaler[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+    uint16_t p = prescaler[regs[R_TCCR2] & 0x07];
+
+    if (!p)
+        return ocf2_ack;
+    /* 62.5 ns per CPU cycle */
+    return (clock_ns - t2_start) * 2 / (125ULL * p * (regs[R_OCR2] + 1));
+}
+
+uint16_t regRead(RegId id)
+{
+    accesses++;
+    clock_ns += ACCESS_NS;
+
+    switch (id) {
+    case R_PINA: case R_PINB: case R_PINC: case R_PIND:
+        return pinLevel(id - R_PINA);
+    case R_TCNT0:
+        return (regs[R_TCCR0] & 0x07) ? (uint8_t) (clock_ns / 4000) : 0;
+    case R_TCNT1:
+        return (uint16_t) timer1Ticks();
+    case R_TIFR: {
+        uint8_t flags = regs[R_TIFR] & ~((1 << 7) | (1 << 2));
+        if ((timer1Ticks() >> 16) != tov1_ack)
+            flags |= 1 << 2;                    /* TOV1 */
+        if (timer2Matches() != ocf2_ack)
+            flags |= 1 << 7;                    /* OCF2 */
+        return flags;
+    }
+    default:
+        return regs[id];
+    }
+}
+
+void regWrite(RegId id, uint16_t value)
+{
+    accesses++;
+    clock_ns += ACCESS_NS;
+
+    switch (id) {
+    case R_PINA: case R_PINB: case R_PINC: case R_PIND:
+        return;
+    case R_TIFR:
+        /* flags are cleared by writing one */
+        if (value & (1 << 2))
+            tov1_ack = timer1Ticks() >> 16;
+        if (value & (1 << 7))
+            ocf2_ack = timer2Matches();
+        regs[R_TIFR] &= ~value;
+        return;
+    case R_TCCR2:
+        regs[R_TCCR2] = value;
+        t2_start = clock_ns;
+        ocf2_ack = 0;
+        return;
+    default:
+        regs[id] = value;
+    }
+    if (id <= R_DDRD)
+        notify();
+}
+
+void regModify(RegId id, uint8_t keep, uint8_t set)
+{
+    accesses++;
+    clock_ns += ACCESS_NS;
+    regs[id] = (regs[id] & keep) | set;
+    if (id <= R_DDRD)
+        notify();
+}
+
+uint64_t accessCount()
+{
+    return accesses;
+}
+
+}
@@ -0,0 +1,113 @@
+/*
+ * sim.h - host simulation core for the USBasp parallel firmware
+ *
+ * The firmware sources are compiled as C++ against the headers in shim/,
+ * where every I/O register is a sim::Reg8. Each register access costs
+ * ACCESS_NS of simulated time, _delay_us()/_delay_ms() advance the clock
+ * by their argument, and Timer0/Timer1/Timer2 count simulated time, so the
+ * firmware's own busy waits terminate. Target models attach as Device
+ * and see every port write; the levels they drive show up on PINx.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace sim {
+
+typedef uint64_t ns_t;
+
+/* 16 MHz, one sbi/cbi/in/out with its operand setup */
+const ns_t CYCLE_NS = 62;
+const ns_t ACCESS_NS = 2 * CYCLE_NS;
+
+enum { PA, PB, PC, PD, NPORTS };
+
+enum RegId {
+    R_PORTA, R_PORTB, R_PORTC, R_PORTD,
+    R_DDRA, R_DDRB, R_DDRC, R_DDRD,
+    R_PINA, R_PINB, R_PINC, R_PIND,
+    R_TCCR0, R_TCNT0, R_TIFR, R_TIMSK,
+    R_TCCR1A, R_TCCR1B, R_TCNT1,
+    R_TCCR2, R_OCR2, R_TCNT2, R_ASSR,
+    R_SPCR, R_SPSR, R_SREG, R_GICR, R_MCUCR, R_SPMCR,
+    R_UCSRA, R_UCSRB, R_UCSRC, R_UDR, R_UBRRL, R_UBRRH,
+    R_COUNT
+};
+
+/* simulated time since start */
+ns_t now();
+
+/* let time pass (delays, USB frames) */
+void advance(ns_t dt);
+
+/* reset clock, registers and programmer EEPROM */
+void reset();
+
+class Device {
+public:
+    virtual ~Device() {}
+    /* called after every PORTx/DDRx write */
+    virtual void update() {}
+    /* levels driven onto port pins: bits set in mask are driven to value */
+    virtual void drive(int port, uint8_t &mask, uint8_t &value) {
+        (void) port; (void) mask; (void) value;
+    }
+};
+
+void attach(Device *dev);
+void detach(Device *dev);
+
+/* what the firmware drives on a port: output level where DDR is set */
+uint8_t portOut(int port);
+uint8_t portDdr(int port);
+
+/* resolved pin level: firmware outputs, device drive, pull-ups, else 0 */
+uint8_t pinLevel(int port);
+
+uint16_t regRead(RegId id);
+void regWrite(RegId id, uint16_t value);
+/* read-modify-write as one sbi/cbi style access: (reg & keep) | set */
+void regModify(RegId id, uint8_t keep, uint8_t set);
+
+/* number of register accesses so far */
+uint64_t accessCount();
+
+struct Reg8 {
+    RegId id;
+    operator uint8_t() const { return (uint8_t) regRead(id); }
+    Reg8 &operator=(unsigned v) { regWrite(id, (uint8_t) v); return *this; }
+    Reg8 &operator|=(unsigned v) { regModify(id, 0xFF, (uint8_t) v); return *this; }
+    Reg8 &operator&=(unsigned v) { regModify(id, (uint8_t) v, 0); return *this; }
+    Reg8 &operator^=(unsigned v) {
+        regWrite(id, regRead(id) ^ (uint8_t) v);
+        return *this;
+    }
+};
+
+struct Reg16 {
+    RegId id;
+    operator uint16_t() const { return regRead(id); }
+    Reg16 &operator=(unsigned v) { regWrite(id, (uint16_t) v); return *this; }
+};
+
+/* programmer EEPROM (eeprom_*_block) */
+extern uint8_t eeprom[1024];
+
+/* programmer flash for the image store (pgm_read_byte on an address);
+ * SPM fills the page buffer, erases and writes whole pages, 4 ms each */
+const unsigned FLASH_SIZE = 16384;
+const unsigned SPM_PAGE = 128;
+extern uint8_t flash[FLASH_SIZE];
+void spmFill(uint32_t addr, uint16_t word);
+void spmErase(uint32_t addr);
+void spmWrite(uint32_t addr);
+
+/* thrown by the USB host stand-in to leave the firmware main loop */
+struct Stop {};
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * simavr_core.cpp - sim.h port and clock functions on top of simavr
+ */
+
+#include <algorithm>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include "simavr_core.h"
+
+namespace sim {
+
+uint8_t eeprom[1024];
+
+static avr_t *avr;
+static uint8_t port[NPORTS], ddr[NPORTS];
+static uint8_t driven[NPORTS];          /* pins a model drove last time */
+static uint8_t input[NPORTS];           /* levels raised on those pins */
+static std::vector<Device *> devices;
+/* how often pin levels are refreshed without a port write, 1 us */
+static const avr_cycle_count_t TICK_CYCLES = 16;
+
+ns_t now()
+{
+    return avr ? avr->cycle * 1000000000ULL / avr->frequency : 0;
+}
+
+/* time is the simulated MCU's; nothing else may move it */
+void advance(ns_t dt)
+{
+    (void) dt;
+}
+
+void reset()
+{
+    std::fill(port, port + NPORTS, 0);
+    std::fill(ddr, ddr + NPORTS, 0);
+    std::fill(driven, driven + NPORTS, 0);
+}
+
+void attach(Device *dev)
+{
+    devices.push_back(dev);
+}
+
+void detach(Device *dev)
+{
+    devices.erase(std::remove(devices.begin(), devices.end(), dev),
+                  devices.end());
+}
+
+uint8_t portOut(int p)
+{
+    return port[p] & ddr[p];
+}
+
+uint8_t portDdr(int p)
+{
+    return ddr[p];
+}
+
+uint8_t pinLevel(int p)
+{
+    uint8_t mask = 0, value = 0;
+
+    for (Device *d : devices) {
+        uint8_t m = 0, v = 0;
+        d->drive(p, m, v);
+        mask |= m;
+        value = (value & ~m) | (v & m);
+    }
+    mask &= ~ddr[p];
+    return (port[p] & ~mask) | (value & mask);
+}
+
+/* raise what the models drive; released pins go back to the pull-up */
+static void refresh()
+{
+    for (int p = 0; p < NPORTS; p++) {
+        uint8_t mask = 0, value = 0;
+
+        for (Device *d : devices) {
+            uint8_t m = 0, v = 0;
+            d->drive(p, m, v);
+            mask |= m;
+            value = (value & ~m) | (v & m);
+        }
+        uint8_t level = (port[p] & ~mask) | (value & mask);
+        uint8_t pins = mask | driven[p];
+        for (int i = 0; i < 8; i++) {
+            uint8_t bit = 1 << i;
+            if (!(pins & bit))
+                continue;
+            if ((driven[p] & mask & bit) && !((input[p] ^ level) & bit))
+                continue;
+            avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('A' + p), i),
+                          (level & bit) ? 1 : 0);
+            input[p] = (input[p] & ~bit) | (level & bit);
+        }
+        driven[p] = mask;
+    }
+}
+
+static void notify()
+{
+    for (Device *d : devices)
+        d->update();
+    refresh();
+}
+
+/* models change their outputs on their own too (RDY/BSY, SDO) */
+static avr_cycle_count_t tick(avr_t *a, avr_cycle_count_t when, void *param)
+{
+    (void) a;
+    (void) param;
+    refresh();
+    return when + TICK_CYCLES;
+}
+
+static void portHook(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void) irq;
+    port[(intptr_t) param] = value;
+    notify();
+}
+
+static void ddrHook(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void) irq;
+    ddr[(intptr_t) param] = value;
+    notify();
+}
+
+void simavrConnect(avr_t *a)
+{
+    avr = a;
+    reset();
+    for (intptr_t p = 0; p < NPORTS; p++) {
+        avr_irq_t *irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('A' + p),
+                                       IOPORT_IRQ_REG_PORT);
+        if (!irq)
+            continue;
+        avr_irq_register_notify(irq, portHook, (void *) p);
+        avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('A' + p),
+                                              IOPORT_IRQ_DIRECTION_ALL),
+                                ddrHook, (void *) p);
+    }
+    avr_cycle_timer_register(avr, TICK_CYCLES, tick, 0);
+}
+
+}
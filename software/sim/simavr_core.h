@@ -0,0 +1,25 @@
+/*
+ * simavr_core.h - sim.h port and clock functions on top of simavr
+ *
+ * Takes the place of sim.cpp when the firmware runs as compiled AVR code
+ * in simavr: the target models see PORTA..PORTD of the simulated MCU
+ * through the ioport IRQs, now() is the MCU's cycle count, and the levels
+ * the models drive are raised on its pins. Only the parts of sim.h the
+ * models use are provided; regRead()/regWrite() have no meaning here.
+ */
+
+#ifndef SIM_SIMAVR_CORE_H
+#define SIM_SIMAVR_CORE_H
+
+#include "sim.h"
+
+struct avr_t;
+
+namespace sim {
+
+/* hook ports A..D of avr up to the attached models */
+void simavrConnect(avr_t *avr);
+
+}
+
+#endif
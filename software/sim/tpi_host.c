@@ -0,0 +1,163 @@
+/**
+ * \brief C port of tpi.S for the host build
+ * \file tpi_host.c
+ *
+ * Same pins, bit order, guard handling and block loops as tpi.S; the
+ * cycles tpi.S spends between port accesses are added with TPI_CYCLES()
+ * so a free running bit takes TPI_FREE_BIT_CYCLES like on the AVR.
+ * Keep it in step with tpi.S.
+ */
+#include <avr/io.h>
+#include "tpi.h"
+#include "tpi_defs.h"
+#include "prof.h"
+
+#define TPI_CLK_BIT     7
+#define TPI_DATA_BIT    5
+
+/* cycles of tpi_bit() that are not port accesses, before and after the
+ * clock rise (call, branches, the empty tpi_delay, ret, caller loop) */
+#define TPI_CYCLES(n)   sim::advance((n) * sim::CYCLE_NS)
+#define TPI_SETUP_CYCLES  20
+#define TPI_HOLD_CYCLES   14
+
+uint16_t tpi_dly_cnt;
+
+/* tpi_delay */
+static void tpi_delay(void)
+{
+	if (tpi_dly_cnt == 0)
+		return;
+	while (!(TPI_TIMER_TIFR & (1 << TPI_TIMER_OCF)))
+		;
+	TPI_TIMER_TIFR = (1 << TPI_TIMER_OCF);
+}
+
+/* exchange of one bit: drive bit (1 - pull-up), return the line level
+ * sampled after the clock rise */
+static uint8_t tpi_bit(uint8_t bit)
+{
+	DDRB &= ~(1 << TPI_DATA_BIT);
+	PORTB |= (1 << TPI_DATA_BIT);
+	if (!bit) {
+		PORTB &= ~(1 << TPI_DATA_BIT);
+		DDRB |= (1 << TPI_DATA_BIT);
+	}
+	TPI_CYCLES(TPI_SETUP_CYCLES);
+	tpi_delay();
+	PORTB |= (1 << TPI_CLK_BIT);
+	bit = (PINB >> TPI_DATA_BIT) & 1;
+	TPI_CYCLES(TPI_HOLD_CYCLES);
+	tpi_delay();
+	PORTB &= ~(1 << TPI_CLK_BIT);
+	return bit;
+}
+
+void tpi_init(void)
+{
+	uint8_t i;
+
+	DDRB |= (1 << TPI_CLK_BIT);
+	DDRB &= ~(1 << TPI_DATA_BIT);
+	PORTB |= (1 << TPI_DATA_BIT);
+	for (i = 0; i < 32; i++)
+		tpi_bit(1);
+}
+
+static void tpi_send_raw(uint8_t b)
+{
+	uint8_t i, parity = 0;
+
+	tpi_bit(0);
+	for (i = 0; i < 8; i++) {
+		parity ^= b;
+		tpi_bit(b & 1);
+		b >>= 1;
+	}
+	tpi_bit(parity & 1);
+	tpi_bit(1);
+	tpi_bit(1);
+}
+
+static uint8_t tpi_recv_raw(void)
+{
+	uint8_t i, b = 0, parity = 0;
+
+	/* waitfor(start_bit, 192) */
+	for (i = 192; i; i--)
+		if (!tpi_bit(1))
+			break;
+	if (i) {
+		for (i = 0; i < 8; i++) {
+			b = (b >> 1) | (tpi_bit(1) << 7);
+			parity ^= b;
+		}
+		parity = (parity >> 7) ^ tpi_bit(1);
+		if (!parity) {
+			tpi_bit(1);
+			tpi_bit(1);
+			return b;
+		}
+	}
+	/* no start bit or bad parity: 2 breaks, then idle */
+	for (i = 0; i < 26; i++)
+		tpi_bit(0);
+	tpi_bit(1);
+	return 0;
+}
+
+void tpi_send_byte(uint8_t b)
+{
+	PROF_BEGIN();
+	tpi_send_raw(b);
+	PROF_END(PROF_TPISEND);
+}
+
+uint8_t tpi_recv_byte(void)
+{
+	uint8_t b;
+	PROF_BEGIN();
+	b = tpi_recv_raw();
+	PROF_END(PROF_TPIRECV);
+	return b;
+}
+
+static void tpi_pr_update(uint16_t pr)
+{
+	tpi_send_byte(TPI_OP_SSTPR(0));
+	tpi_send_byte(pr & 0xFF);
+	tpi_send_byte(TPI_OP_SSTPR(1));
+	tpi_send_byte(pr >> 8);
+}
+
+void tpi_read_block(uint16_t addr, uint8_t* dptr, uint8_t len)
+{
+	tpi_pr_update(addr);
+	do {
+		tpi_send_byte(TPI_OP_SLD_INC);
+		*dptr++ = tpi_recv_byte();
+	} while (--len);
+}
+
+void tpi_write_block(uint16_t addr, const uint8_t* sptr, uint8_t len)
+{
+	uint8_t hi;
+
+	tpi_pr_update(addr);
+	tpi_send_byte(TPI_OP_SOUT(NVMCMD));
+	tpi_send_byte(NVMCMD_WORD_WRITE);
+	do {
+		tpi_send_byte(TPI_OP_SST_INC);
+		tpi_send_byte(*sptr++);
+		tpi_send_byte(TPI_OP_SST_INC);
+		hi = 0xFF;
+		if (--len) {
+			hi = *sptr++;
+			len--;
+		}
+		tpi_send_byte(hi);
+		do {
+			tpi_send_byte(TPI_OP_SIN(NVMCSR));
+		} while (tpi_recv_byte() & NVMCSR_BSY);
+	} while (len);
+}
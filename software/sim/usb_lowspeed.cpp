@@ -0,0 +1,419 @@
+/*
+ * usb_lowspeed.cpp - low speed USB host on the simavr ioport IRQs
+ * (USB 2.0 specification, chapters 7 and 8)
+ */
+
+#include <math.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include "usb_lowspeed.h"
+
+namespace sim {
+
+enum {
+    PID_OUT = 0xE1, PID_IN = 0x69, PID_SETUP = 0x2D,
+    PID_DATA0 = 0xC3, PID_DATA1 = 0x4B,
+    PID_ACK = 0xD2, PID_NAK = 0x5A, PID_STALL = 0x1E
+};
+
+/* device response timeout and inter-packet delay, in bit times */
+static const int RESPONSE_BITS = 32;
+static const int GAP_BITS = 4;
+/* a NAKed transaction is retried after this many microseconds */
+static const double NAK_RETRY_US = 20;
+static const int MAX_RETRIES = 100000;
+
+static uint8_t crc5(uint16_t data, int bits)
+{
+    uint8_t crc = 0x1F;
+
+    for (int i = 0; i < bits; i++) {
+        if ((crc ^ (data >> i)) & 1)
+            crc = (crc >> 1) ^ 0x14;
+        else
+            crc >>= 1;
+    }
+    return ~crc & 0x1F;
+}
+
+static uint16_t crc16(const uint8_t *data, int len)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return ~crc;
+}
+
+static void portHook(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void) irq;
+    ((LowSpeedHost *) param)->portWritten(value);
+}
+
+static void ddrHook(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void) irq;
+    ((LowSpeedHost *) param)->ddrWritten(value);
+}
+
+static avr_cycle_count_t txHook(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    (void) avr;
+    return ((LowSpeedHost *) param)->txStep(when);
+}
+
+LowSpeedHost::LowSpeedHost(avr_t *a, char port, int dplus, int dminus)
+    : irqOffCycles(0), stats(), avr(a), dpMask(1 << dplus),
+      dmMask(1 << dminus), portVal(0), ddrVal(0),
+      bitCycles(a->frequency / 1500000.0), nextFrame(0), listening(false),
+      txIndex(0), txStart(0)
+{
+    dp = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), dplus);
+    dm = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), dminus);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port),
+                                          IOPORT_IRQ_REG_PORT), portHook, this);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port),
+                                          IOPORT_IRQ_DIRECTION_ALL), ddrHook, this);
+    setLine(J);
+}
+
+uint64_t LowSpeedHost::cycles() const
+{
+    return avr->cycle;
+}
+
+int LowSpeedHost::deviceLevel() const
+{
+    if ((ddrVal & (dpMask | dmMask)) != (dpMask | dmMask))
+        return RELEASED;
+    if (portVal & dpMask)
+        return (portVal & dmMask) ? SE0 : K;   /* SE1 is not valid, as SE0 */
+    return (portVal & dmMask) ? J : SE0;
+}
+
+void LowSpeedHost::portWritten(uint8_t value)
+{
+    portVal = value;
+    if (listening)
+        events.push_back(std::make_pair((uint64_t) avr->cycle, deviceLevel()));
+}
+
+void LowSpeedHost::ddrWritten(uint8_t value)
+{
+    ddrVal = value;
+    if (listening)
+        events.push_back(std::make_pair((uint64_t) avr->cycle, deviceLevel()));
+}
+
+/* D+ and D- as seen by the MCU; the pull-up on D- makes idle J */
+void LowSpeedHost::setLine(int level)
+{
+    avr_raise_irq(dp, level == K);
+    avr_raise_irq(dm, level == J);
+}
+
+void LowSpeedHost::step()
+{
+    bool masked = !avr->sreg[S_I];
+    uint64_t c = avr->cycle;
+
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed)
+        throw Stop();
+    if (masked)
+        irqOffCycles += avr->cycle - c;
+}
+
+uint64_t LowSpeedHost::txStep(uint64_t when)
+{
+    (void) when;
+    setLine(txLevels[txIndex]);
+    if (++txIndex == txLevels.size())
+        return 0;
+    return txStart + llround(txIndex * bitCycles);
+}
+
+/* schedule the line levels and run the MCU until the EOP is out */
+void LowSpeedHost::send(uint8_t pid, const uint8_t *data, int len, bool crc16Field)
+{
+    std::vector<uint8_t> bytes;
+    int ones = 0, level = J;
+
+    while (txIndex < txLevels.size())       /* keep-alive still going out */
+        step();
+    bytes.push_back(0x80);                  /* SYNC */
+    bytes.push_back(pid);
+    bytes.insert(bytes.end(), data, data + len);
+    if (crc16Field) {
+        uint16_t crc = crc16(data, len);
+        bytes.push_back(crc & 0xFF);
+        bytes.push_back(crc >> 8);
+    }
+
+    txLevels.clear();
+    for (uint8_t b : bytes) {
+        for (int i = 0; i < 8; i++) {
+            if ((b >> i) & 1) {
+                txLevels.push_back(level);
+                if (++ones == 6) {          /* bit stuffing */
+                    level = level == J ? K : J;
+                    txLevels.push_back(level);
+                    ones = 0;
+                }
+            } else {
+                level = level == J ? K : J;
+                txLevels.push_back(level);
+                ones = 0;
+            }
+        }
+    }
+    txLevels.push_back(SE0);
+    txLevels.push_back(SE0);
+    txLevels.push_back(J);
+
+    txIndex = 0;
+    txStart = avr->cycle;
+    avr_cycle_timer_register(avr, 1, txHook, this);
+    uint64_t end = txStart + llround(txLevels.size() * bitCycles) + 1;
+    while (avr->cycle < end)
+        step();
+    stats.packets++;
+}
+
+void LowSpeedHost::token(uint8_t pid)
+{
+    /* address 0, endpoint 0 */
+    uint8_t field[2] = { 0, (uint8_t) (crc5(0, 11) << 3) };
+
+    send(pid, field, 2, false);
+}
+
+void LowSpeedHost::gap(int bits)
+{
+    runUntil(avr->cycle + llround(bits * bitCycles));
+}
+
+/* decode what the device sends; false if it stays silent */
+bool LowSpeedHost::receive(std::vector<uint8_t> &packet)
+{
+    uint64_t deadline = avr->cycle + llround(RESPONSE_BITS * bitCycles);
+    size_t start = 0;
+    bool started = false, ended = false;
+    uint64_t tEnd = 0;
+
+    packet.clear();
+    events.clear();
+    listening = true;
+    while (!ended || avr->cycle < tEnd) {
+        step();
+        if (!started) {
+            for (; start < events.size(); start++) {
+                if (events[start].second == K) {
+                    started = true;
+                    break;
+                }
+            }
+            if (!started && avr->cycle > deadline)
+                break;
+        }
+        if (started && !ended) {
+            for (size_t i = start; i < events.size(); i++) {
+                if (events[i].second == SE0) {
+                    ended = true;
+                    tEnd = events[i].first + llround(3 * bitCycles);
+                    break;
+                }
+            }
+        }
+    }
+    listening = false;
+    if (!started)
+        return false;
+
+    /* sample each bit in the middle of its cell */
+    uint64_t t0 = events[start].first;
+    size_t e = start;
+    int prev = J, ones = 0, nbits = 0;
+    uint32_t shift = 0;
+    for (int i = 0;; i++) {
+        uint64_t t = t0 + llround((i + 0.5) * bitCycles);
+        while (e + 1 < events.size() && events[e + 1].first <= t)
+            e++;
+        int level = events[e].second;
+        if (level == SE0 || level == RELEASED)
+            break;
+        int bit = level == prev;
+        prev = level;
+        if (ones == 6) {                    /* stuffed bit */
+            ones = 0;
+            continue;
+        }
+        ones = bit ? ones + 1 : 0;
+        shift |= bit << nbits;
+        if (++nbits == 8) {
+            packet.push_back(shift);
+            shift = 0;
+            nbits = 0;
+        }
+    }
+    if (packet.empty() || packet[0] != 0x80)
+        return false;
+    packet.erase(packet.begin());
+    return !packet.empty();
+}
+
+LowSpeedHost::Handshake LowSpeedHost::handshake()
+{
+    std::vector<uint8_t> p;
+
+    if (!receive(p))
+        return NONE;
+    if (p[0] == PID_ACK) return ACK;
+    if (p[0] == PID_NAK) return NAK;
+    if (p[0] == PID_STALL) return STALL;
+    return NONE;
+}
+
+LowSpeedHost::Handshake LowSpeedHost::in(std::vector<uint8_t> &data, bool toggle)
+{
+    std::vector<uint8_t> p;
+
+    token(PID_IN);
+    if (!receive(p))
+        return NONE;
+    if (p[0] == PID_NAK) return NAK;
+    if (p[0] == PID_STALL) return STALL;
+    if (p[0] != (toggle ? PID_DATA1 : PID_DATA0) || p.size() < 3 ||
+        crc16(&p[1], p.size() - 3) != (p[p.size() - 2] | (p.back() << 8)))
+        return NONE;
+    gap(GAP_BITS);
+    send(PID_ACK, 0, 0, false);
+    data.assign(p.begin() + 1, p.end() - 2);
+    return ACK;
+}
+
+LowSpeedHost::Handshake LowSpeedHost::out(const uint8_t *data, int len, bool toggle)
+{
+    token(PID_OUT);
+    gap(GAP_BITS);
+    send(toggle ? PID_DATA1 : PID_DATA0, data, len, true);
+    return handshake();
+}
+
+void LowSpeedHost::runUntil(uint64_t cycle)
+{
+    while (avr->cycle < cycle) {
+        if (avr->cycle >= nextFrame) {
+            /* keep-alive: low speed EOP once per frame */
+            nextFrame = avr->cycle + avr->frequency / 1000;
+            txLevels.assign({ SE0, SE0, J });
+            txIndex = 0;
+            txStart = avr->cycle;
+            avr_cycle_timer_register(avr, 1, txHook, this);
+        }
+        step();
+    }
+}
+
+void LowSpeedHost::runUs(double us)
+{
+    runUntil(avr->cycle + llround(us * avr->frequency / 1e6));
+}
+
+void LowSpeedHost::busReset()
+{
+    setLine(SE0);
+    runUs(10000);
+    setLine(J);
+    nextFrame = avr->cycle;
+    runUs(10000);
+}
+
+bool LowSpeedHost::control(Transfer &t)
+{
+    Handshake h;
+    int tries = 0;
+
+    stats.transfers++;
+    t.stalled = false;
+    do {
+        gap(GAP_BITS);
+        token(PID_SETUP);
+        gap(GAP_BITS);
+        send(PID_DATA0, t.setup, 8, true);
+        h = handshake();
+    } while (h != ACK && ++tries < 3);
+    if (h != ACK)
+        return false;
+
+    bool toggle = true;
+    uint16_t len = t.length();
+    if (t.in())
+        t.data.clear();
+    size_t done = 0;
+    tries = 0;
+    while (len && (t.in() ? t.data.size() < len : done < t.data.size())) {
+        gap(GAP_BITS);
+        if (t.in()) {
+            std::vector<uint8_t> chunk;
+            h = in(chunk, toggle);
+            if (h == ACK) {
+                t.data.insert(t.data.end(), chunk.begin(), chunk.end());
+                stats.bytesIn += chunk.size();
+                if (chunk.size() < 8)
+                    break;
+            }
+        } else {
+            int n = t.data.size() - done < 8 ? t.data.size() - done : 8;
+            h = out(&t.data[done], n, toggle);
+            if (h == ACK) {
+                done += n;
+                stats.bytesOut += n;
+            }
+        }
+        if (h == STALL) {
+            t.stalled = true;
+            return false;
+        }
+        if (h == ACK) {
+            toggle = !toggle;
+            tries = 0;
+        } else {
+            if (h == NAK)
+                stats.naks++;
+            if (++tries > MAX_RETRIES)
+                return false;
+            runUs(NAK_RETRY_US);
+        }
+    }
+
+    /* status stage: zero length packet the other way, always DATA1 */
+    tries = 0;
+    for (;;) {
+        gap(GAP_BITS);
+        if (t.in()) {
+            h = out(0, 0, true);
+        } else {
+            std::vector<uint8_t> empty;
+            h = in(empty, true);
+        }
+        if (h == ACK)
+            return true;
+        if (h == STALL) {
+            t.stalled = true;
+            return false;
+        }
+        if (h == NAK)
+            stats.naks++;
+        if (++tries > MAX_RETRIES)
+            return false;
+        runUs(NAK_RETRY_US);
+    }
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * usb_lowspeed.h - bit level low speed USB host for firmware under simavr
+ *
+ * Drives D+/D- of the simulated MCU through the ioport IRQs with real
+ * low speed packets (SYNC, NRZI, bit stuffing, CRC5/CRC16, EOP) at
+ * 1.5 Mbit/s and decodes what V-USB sends back from its port writes, so
+ * the compiled firmware runs its own interrupt handler and usbPoll().
+ * Transfers go to address 0, endpoint 0; there is no enumeration.
+ */
+
+#ifndef SIM_USB_LOWSPEED_H
+#define SIM_USB_LOWSPEED_H
+
+#include <stdint.h>
+#include <vector>
+#include "usbhost.h"
+
+struct avr_t;
+struct avr_irq_t;
+
+namespace sim {
+
+class LowSpeedHost {
+public:
+    /* D+ and D- on the same port, D+ on an INT0 capable pin */
+    LowSpeedHost(avr_t *avr, char port, int dplus, int dminus);
+
+    /* run the MCU until the given cycle, with keep-alives every 1 ms */
+    void runUntil(uint64_t cycle);
+    void runUs(double us);
+    /* SE0 for 10 ms, then idle */
+    void busReset();
+    /* setup, data and status stage; false if stalled or not answered */
+    bool control(Transfer &t);
+
+    uint64_t cycles() const;
+    /* cycles executed with the I flag clear (interrupt handlers, cli) */
+    uint64_t irqOffCycles;
+    UsbStats stats;
+
+    /* called by the IRQ and cycle timer hooks */
+    void portWritten(uint8_t value);
+    void ddrWritten(uint8_t value);
+    uint64_t txStep(uint64_t when);
+
+private:
+    enum Level { J, K, SE0, RELEASED };
+    enum Handshake { ACK, NAK, STALL, NONE };
+
+    void step();
+    void setLine(int level);
+    void send(uint8_t pid, const uint8_t *data, int len, bool crc16);
+    void token(uint8_t pid);
+    bool receive(std::vector<uint8_t> &packet);
+    Handshake handshake();
+    Handshake in(std::vector<uint8_t> &data, bool toggle);
+    Handshake out(const uint8_t *data, int len, bool toggle);
+    void gap(int bits);
+    int deviceLevel() const;
+
+    avr_t *avr;
+    avr_irq_t *dp, *dm;
+    uint8_t dpMask, dmMask;
+    uint8_t portVal, ddrVal;
+    double bitCycles;
+    uint64_t nextFrame;
+
+    bool listening;
+    std::vector<std::pair<uint64_t, int> > events;
+
+    std::vector<uint8_t> txLevels;
+    size_t txIndex;
+    uint64_t txStart;
+};
+
+}
+
+#endif
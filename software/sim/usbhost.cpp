@@ -0,0 +1,157 @@
+/*
+ * usbhost.cpp - usbPoll() replacement driving the firmware callbacks
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "usbhost.h"
+#include "usbdrv.h"
+#include "isp.h"
+#include "store.h"
+#include "auto.h"
+
+int firmware_main(void);
+
+usbMsgPtr_t usbMsgPtr;
+uchar usbRequestsDisabled;
+/* the scripted host stands for one that has configured the device */
+uchar usbConfiguration = 1;
+
+namespace sim {
+
+/* one pass of the firmware main loop when there is nothing to do */
+const ns_t POLL_NS = 2000;
+/* NAKed packets are retried no faster than one low speed packet time */
+const ns_t NAK_RETRY_NS = 20000;
+
+static UsbHost *active;
+
+UsbHost::UsbHost()
+    : packetNs(0), stats(), next(0), stage(IDLE), viaCallback(false),
+      remaining(0), slot(0)
+{
+}
+
+void UsbHost::run()
+{
+    active = this;
+    next = 0;
+    stage = IDLE;
+    slot = now();
+    try {
+        firmware_main();
+    } catch (Stop &) {
+    }
+    active = 0;
+}
+
+void UsbHost::poll()
+{
+    if (now() < slot) {
+        advance(std::min(POLL_NS, slot - now()));
+        return;
+    }
+
+    if (stage == IDLE) {
+        if (next == script.size()) {
+            if (refill && refill())
+                return;
+            if (!ispBusy() && !storeBusy() && !autoActive() &&
+                !usbAllRequestsAreDisabled())
+                throw Stop();
+            advance(POLL_NS);
+            return;
+        }
+        Transfer &t = script[next];
+        t.tStart = now();
+        t.stalled = false;
+        if (onStart)
+            onStart(t);
+        stats.transfers++;
+        stats.packets++;
+        usbMsgLen_t r = usbFunctionSetup(t.setup);
+        viaCallback = (r == USB_NO_MSG);
+        remaining = t.length();
+        if (t.in()) {
+            t.data.clear();
+            if (!viaCallback)
+                remaining = std::min<uint16_t>(remaining, r);
+        } else if (!viaCallback) {
+            remaining = 0;
+        }
+        stage = remaining ? DATA : STATUS;
+        slot = now() + packetNs;
+        return;
+    }
+
+    Transfer &t = script[next];
+
+    if (stage == DATA) {
+        uchar buf[8];
+        uchar n = std::min<uint16_t>(remaining, 8);
+
+        if (t.in()) {
+            if (viaCallback) {
+                uchar got = usbFunctionRead(buf, n);
+                if (got == 0xFF) {
+                    t.stalled = true;
+                    got = 0;
+                }
+                n = std::min(n, got);
+                if (n < 8)
+                    remaining = n;
+            } else {
+                memcpy(buf, usbMsgPtr, n);
+                usbMsgPtr += n;
+            }
+            t.data.insert(t.data.end(), buf, buf + n);
+            stats.bytesIn += n;
+            remaining -= n;
+        } else {
+            if (usbAllRequestsAreDisabled()) {
+                stats.naks++;
+                slot = now() + std::max(packetNs, NAK_RETRY_NS);
+                advance(POLL_NS);
+                return;
+            }
+            size_t off = t.length() - remaining;
+            memcpy(buf, &t.data[off], n);
+            uchar r = usbFunctionWrite(buf, n);
+            stats.bytesOut += n;
+            remaining -= n;
+            if (r == 0xFF) {
+                t.stalled = true;
+                remaining = 0;
+            } else if (r && remaining) {
+                remaining = 0;
+            }
+        }
+        stats.packets++;
+        if (!remaining && !t.stalled)
+            stage = STATUS;
+        else if (t.stalled)
+            stage = STATUS;
+        slot = now() + packetNs;
+        return;
+    }
+
+    /* status stage */
+    stats.packets++;
+    t.tEnd = now();
+    if (onDone)
+        onDone(t);
+    next++;
+    stage = IDLE;
+    slot = now() + packetNs;
+}
+
+}
+
+void usbInit(void)
+{
+}
+
+void usbPoll(void)
+{
+    sim::active->poll();
+}
@@ -0,0 +1,65 @@
+/*
+ * usbhost.h - scripted USB host standing in for usbdrv
+ *
+ * Runs the firmware main loop and feeds it a list of control transfers
+ * through usbFunctionSetup/Read/Write, one packet per usbPoll() call.
+ * Packets are spaced packetNs apart (0: back to back, firmware bound);
+ * OUT packets are NAKed while the firmware has requests disabled. When
+ * the script runs out, refill (if set) may append more transfers and
+ * return true; otherwise the run ends once the target is idle, no
+ * standalone run or store page write is pending and the program-on-insert
+ * loop is off.
+ */
+
+#ifndef SIM_USBHOST_H
+#define SIM_USBHOST_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "sim.h"
+
+namespace sim {
+
+struct Transfer {
+    uint8_t setup[8];           /* bmRequestType .. wLength */
+    std::vector<uint8_t> data;  /* OUT payload, IN reply */
+    std::string tag;            /* phase name for statistics */
+    ns_t tStart, tEnd;
+    bool stalled;
+
+    bool in() const { return setup[0] & 0x80; }
+    uint16_t length() const { return setup[6] | (setup[7] << 8); }
+};
+
+struct UsbStats {
+    uint64_t transfers, packets, naks, bytesIn, bytesOut;
+};
+
+class UsbHost {
+public:
+    UsbHost();
+
+    std::vector<Transfer> script;
+    ns_t packetNs;              /* time per USB packet */
+    std::function<void(Transfer &)> onStart, onDone;
+    std::function<bool()> refill;
+    UsbStats stats;
+
+    /* run the firmware until the script is done and the target idle */
+    void run();
+
+    void poll();
+
+private:
+    enum { IDLE, DATA, STATUS };
+    size_t next;
+    int stage;
+    bool viaCallback;
+    uint16_t remaining;
+    ns_t slot;
+};
+
+}
+
+#endif
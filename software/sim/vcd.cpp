@@ -0,0 +1,79 @@
+/*
+ * vcd.cpp - value change dump of the programming bus
+ */
+
+#include "avr_parallel.h"
+#include "vcd.h"
+
+namespace sim {
+
+/* PORTC bits; their identifier codes are 'a' + bit */
+static const char *const ctlNames[8] = {
+    "XA0", "PAGEL", "XTAL1", "XA1", "BS1", "BS2", "OE", "WR"
+};
+
+VcdTrace::VcdTrace()
+    : f(0), first(true), ctl(0), data(0), dataDdr(0), pwr(0)
+{
+}
+
+bool VcdTrace::open(const char *path)
+{
+    close();
+    f = fopen(path, "w");
+    if (!f)
+        return false;
+    fprintf(f, "$timescale 1ns $end\n$scope module usbasp $end\n");
+    for (int b = 0; b < 8; b++)
+        fprintf(f, "$var wire 1 %c %s $end\n", 'a' + b, ctlNames[b]);
+    fprintf(f, "$var wire 8 D DATA $end\n");
+    fprintf(f, "$var wire 1 v VDD $end\n$var wire 1 p VPP $end\n");
+    fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+    first = true;
+    return true;
+}
+
+void VcdTrace::close()
+{
+    if (f)
+        fclose(f);
+    f = 0;
+}
+
+static void vector(FILE *f, uint8_t v, uint8_t ddr)
+{
+    fputc('b', f);
+    for (int b = 7; b >= 0; b--)
+        fputc(!((ddr >> b) & 1) ? 'z' : (v >> b) & 1 ? '1' : '0', f);
+    fputs(" D\n", f);
+}
+
+void VcdTrace::update()
+{
+    if (!f)
+        return;
+
+    uint8_t c = portOut(PC), d = portOut(PA), dd = portDdr(PA);
+    uint8_t p = portOut(PD) & (PIN_VDD | PIN_VPP);
+    uint8_t dc = first ? 0xFF : c ^ ctl;
+
+    if (!first && !dc && d == data && dd == dataDdr && p == pwr)
+        return;
+    fprintf(f, "#%llu\n", (unsigned long long) now());
+    for (int b = 0; b < 8; b++)
+        if (dc & (1 << b))
+            fprintf(f, "%d%c\n", (c >> b) & 1, 'a' + b);
+    if (first || d != data || dd != dataDdr)
+        vector(f, d, dd);
+    if (first || ((p ^ pwr) & PIN_VDD))
+        fprintf(f, "%dv\n", p & PIN_VDD ? 1 : 0);
+    if (first || ((p ^ pwr) & PIN_VPP))
+        fprintf(f, "%dp\n", p & PIN_VPP ? 1 : 0);
+    first = false;
+    ctl = c;
+    data = d;
+    dataDdr = dd;
+    pwr = p;
+}
+
+}
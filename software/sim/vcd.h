@@ -0,0 +1,38 @@
+/*
+ * vcd.h - value change dump of the programming bus
+ *
+ * Records every change of the control lines (XA0/PAGEL/XTAL1/XA1/BS1/
+ * BS2/OE/WR on PORTC), the data bus as the programmer drives it (PORTA,
+ * z where DDRA is clear) and VDD/VPP, with 1 ns resolution. The target's
+ * side of the bus is left out: sampling it would count as a read in the
+ * model's timing checks. In serial HV mode the same PORTC bits carry
+ * SII/SDI/SCI and PA0 is SDO; the names stay the parallel ones.
+ */
+
+#ifndef SIM_VCD_H
+#define SIM_VCD_H
+
+#include <stdio.h>
+#include "sim.h"
+
+namespace sim {
+
+class VcdTrace : public Device {
+public:
+    VcdTrace();
+    /* false if the file cannot be created */
+    bool open(const char *path);
+    void close();
+    ~VcdTrace() override { close(); }
+
+    void update() override;
+
+private:
+    FILE *f;
+    bool first;
+    uint8_t ctl, data, dataDdr, pwr;
+};
+
+}
+
+#endif